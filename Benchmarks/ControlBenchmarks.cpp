@@ -0,0 +1,363 @@
+/*
+  Benchmarks of the control primitives in inc/common and inc/fbw, and of the
+  heading autopilot's per-frame path, built on the harness in benchmark.h.
+
+  Every benchmark updates a batch of N independent instances per iteration,
+  for N from 1 to 1M, so that the results show both the cost of a single
+  update and how throughput changes as the working set outgrows each cache.
+  Blocks used through SISOBlock are allocated individually, as the examples
+  do, and updated through the virtual interface.
+
+  The heading path decodes a position message with SimData, runs the
+  heading and bank controllers and sends the aileron to the local simulator
+  with SimData::Set, as HeadingAPExample does on every frame.
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "localsim/SimConnect.h"
+#include "localsim/LocalSimConnect.h"
+
+#include "common/PIDBank.h"
+#include "common/gain_schedule.h"
+#include "common/PIDController.h"
+#include "common/sim_data.h"
+#include "common/siso_blocks.h"
+#include "common/state_space.h"
+#include "common/util.h"
+#include "fbw/roll_control_law.h"
+
+#include "benchmark.h"
+
+/* Largest batch size */
+const size_t MAX_BATCH = 1 << 20;
+
+const double TIMESTEP = 1.0 / 30;
+
+/* Returns n inputs in [low, high], the same for every run */
+std::vector<double> RandomInputs(size_t n, double low, double high, uint64_t seed = 1) {
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> dist(low, high);
+  std::vector<double> inputs(n);
+  for (double& x : inputs) {
+    x = dist(rng);
+  }
+  return inputs;
+}
+
+/* Updates n blocks, each held individually and updated through SISOBlock */
+template <typename Block>
+void UpdateVirtualBlocks(BenchmarkState& state, std::vector<std::unique_ptr<SISOBlock>>& blocks) {
+  size_t n = state.Range();
+  std::vector<double> inputs = RandomInputs(n, -1, 1);
+  std::vector<double> outputs(n);
+
+  while (state.KeepRunning()) {
+    for (size_t k = 0; k < n; k++) {
+      outputs[k] = blocks[k]->Update(inputs[k], TIMESTEP);
+    }
+    DoNotOptimize(outputs.data());
+  }
+
+  state.SetItemsProcessed(state.Iterations() * n);
+  state.SetWorkingSetBytes(n * (sizeof(SISOBlock*) + sizeof(Block) + 2 * sizeof(double)));
+}
+
+/* Updates n statically dispatched blocks held in an array */
+template <typename Block>
+void UpdateStaticBlocks(BenchmarkState& state, std::vector<Block>& blocks) {
+  size_t n = state.Range();
+  std::vector<double> inputs = RandomInputs(n, -1, 1);
+  std::vector<double> outputs(n);
+
+  while (state.KeepRunning()) {
+    for (size_t k = 0; k < n; k++) {
+      outputs[k] = blocks[k].Update(inputs[k], TIMESTEP);
+    }
+    DoNotOptimize(outputs.data());
+  }
+
+  state.SetItemsProcessed(state.Iterations() * n);
+  state.SetWorkingSetBytes(n * (sizeof(Block) + 2 * sizeof(double)));
+}
+
+void BM_PIDController(BenchmarkState& state) {
+  std::vector<std::unique_ptr<SISOBlock>> blocks;
+  for (size_t k = 0; k < state.Range(); k++) {
+    blocks.emplace_back(new PIDController(1, 0.1, 0.5));
+  }
+  UpdateVirtualBlocks<PIDController>(state, blocks);
+}
+BENCHMARK(BM_PIDController)->Range(1, MAX_BATCH);
+
+void BM_ClampedPIDController(BenchmarkState& state) {
+  std::vector<std::unique_ptr<SISOBlock>> blocks;
+  for (size_t k = 0; k < state.Range(); k++) {
+    blocks.emplace_back(new ClampedPIDController(1, 0.1, 0.5, -1, 1));
+  }
+  UpdateVirtualBlocks<ClampedPIDController>(state, blocks);
+}
+BENCHMARK(BM_ClampedPIDController)->Range(1, MAX_BATCH);
+
+void BM_ClampedPID(BenchmarkState& state) {
+  std::vector<ClampedPID> blocks(state.Range(), ClampedPID(1, 0.1, 0.5, -1, 1));
+  UpdateStaticBlocks(state, blocks);
+}
+BENCHMARK(BM_ClampedPID)->Range(1, MAX_BATCH);
+
+void BM_ClampedPIDFiltered(BenchmarkState& state) {
+  ClampedPID prototype(1, 0.1, 0.5, -1, 1);
+  prototype.SetDerivativeFilter(100);
+  std::vector<ClampedPID> blocks(state.Range(), prototype);
+  UpdateStaticBlocks(state, blocks);
+}
+BENCHMARK(BM_ClampedPIDFiltered)->Range(1, MAX_BATCH);
+
+void BM_PIDBank(BenchmarkState& state) {
+  size_t n = state.Range();
+  PIDBank bank;
+  for (size_t k = 0; k < n; k++) {
+    bank.Add(1, 0.1, 0.5, -1, 1);
+  }
+  std::vector<double> inputs = RandomInputs(n, -1, 1);
+
+  while (state.KeepRunning()) {
+    bank.Update(inputs.data(), TIMESTEP);
+    DoNotOptimize(bank.Outputs());
+  }
+
+  state.SetItemsProcessed(state.Iterations() * n);
+  /* coefficients, limits, state, input and output of each controller */
+  state.SetWorkingSetBytes(n * 9 * sizeof(double));
+}
+BENCHMARK(BM_PIDBank)->Range(1, MAX_BATCH);
+
+void BM_FirstOrderResponseBlock(BenchmarkState& state) {
+  std::vector<std::unique_ptr<SISOBlock>> blocks;
+  for (size_t k = 0; k < state.Range(); k++) {
+    blocks.emplace_back(new FirstOrderResponseBlock(0.1, 1));
+  }
+  UpdateVirtualBlocks<FirstOrderResponseBlock>(state, blocks);
+}
+BENCHMARK(BM_FirstOrderResponseBlock)->Range(1, MAX_BATCH);
+
+void BM_FirstOrderResponse(BenchmarkState& state) {
+  std::vector<FirstOrderResponse> blocks(state.Range(), FirstOrderResponse(0.1, 1));
+  UpdateStaticBlocks(state, blocks);
+}
+BENCHMARK(BM_FirstOrderResponse)->Range(1, MAX_BATCH);
+
+/* The other discretisations, which only differ in how the coefficients are
+   computed when the timestep changes */
+void BM_FirstOrderResponseExact(BenchmarkState& state) {
+  std::vector<FirstOrderResponse> blocks(state.Range(), FirstOrderResponse(0.1, 1, 0, DISCRETISE_EXACT));
+  UpdateStaticBlocks(state, blocks);
+}
+BENCHMARK(BM_FirstOrderResponseExact)->Range(1, MAX_BATCH);
+
+/* The worst case, with a different timestep on every update */
+void BM_FirstOrderResponseExactVaryingTimestep(BenchmarkState& state) {
+  size_t n = state.Range();
+  std::vector<FirstOrderResponse> blocks(n, FirstOrderResponse(0.1, 1, 0, DISCRETISE_EXACT));
+  std::vector<double> inputs = RandomInputs(n, -1, 1);
+  std::vector<double> outputs(n);
+
+  double timestep = TIMESTEP;
+  while (state.KeepRunning()) {
+    timestep = (timestep == TIMESTEP) ? TIMESTEP * 1.01 : TIMESTEP;
+    for (size_t k = 0; k < n; k++) {
+      outputs[k] = blocks[k].Update(inputs[k], timestep);
+    }
+    DoNotOptimize(outputs.data());
+  }
+
+  state.SetItemsProcessed(state.Iterations() * n);
+  state.SetWorkingSetBytes(n * (sizeof(FirstOrderResponse) + 2 * sizeof(double)));
+}
+BENCHMARK(BM_FirstOrderResponseExactVaryingTimestep)->Range(1, MAX_BATCH);
+
+/* Second order actuator, 400 / (s^2 + 28s + 400) */
+void BM_StateSpace2(BenchmarkState& state) {
+  const double num[] = { 0, 0, 400 };
+  const double den[] = { 1, 28, 400 };
+  StateSpace<2> block = StateSpace<2>::FromTransferFunction(num, den);
+  block.Discretise(TIMESTEP);
+  std::vector<StateSpace<2>> blocks(state.Range(), block);
+  UpdateStaticBlocks(state, blocks);
+}
+BENCHMARK(BM_StateSpace2)->Range(1, MAX_BATCH);
+
+/* Two second order sections in series, as one fourth order block */
+void BM_StateSpace4(BenchmarkState& state) {
+  const double num[] = { 0, 0, 0, 0, 160000 };
+  const double den[] = { 1, 56, 1584, 22400, 160000 };
+  StateSpace<4> block = StateSpace<4>::FromTransferFunction(num, den);
+  block.Discretise(TIMESTEP);
+  std::vector<StateSpace<4>> blocks(state.Range(), block);
+  UpdateStaticBlocks(state, blocks);
+}
+BENCHMARK(BM_StateSpace4)->Range(1, MAX_BATCH);
+
+/* Gain scheduled controllers, each with its own table of 4x4 breakpoints,
+   as the airspeed of every aircraft drifts slowly across the table */
+void BM_GainScheduledPIDController(BenchmarkState& state) {
+  typedef GainScheduledPIDController<LookupTable2D<PIDGains>> Controller;
+  size_t n = state.Range();
+  std::vector<PIDGains> gains;
+  for (size_t k = 0; k < 16; k++) {
+    PIDGains g = { 10.0 + k, 0.1, 0.5 };
+    gains.push_back(g);
+  }
+  LookupTable2D<PIDGains> table({ 150, 220, 280, 350 }, { 0, 20000, 35000, 41000 }, gains);
+  std::vector<Controller> blocks(n, Controller(table, -1, 1));
+  std::vector<double> airspeeds = RandomInputs(n, 150, 350, 1);
+  std::vector<double> altitudes = RandomInputs(n, 0, 41000, 2);
+  std::vector<double> inputs = RandomInputs(n, -1, 1, 3);
+  std::vector<double> outputs(n);
+
+  double drift = 0;
+  while (state.KeepRunning()) {
+    drift = (drift < 50) ? drift + 0.01 : 0;
+    for (size_t k = 0; k < n; k++) {
+      blocks[k].Schedule(airspeeds[k] + drift, altitudes[k]);
+      outputs[k] = blocks[k].Update(inputs[k], TIMESTEP);
+    }
+    DoNotOptimize(outputs.data());
+  }
+
+  state.SetItemsProcessed(state.Iterations() * n);
+  state.SetWorkingSetBytes(n * (sizeof(Controller) + 16 * sizeof(PIDGains) + 8 * sizeof(double) +
+    4 * sizeof(double)));
+}
+BENCHMARK(BM_GainScheduledPIDController)->Range(1, 1 << 16);
+
+/* The roll control law, across the whole stick and bank envelope */
+void BM_CalculateDesiredRollRate(BenchmarkState& state) {
+  size_t n = state.Range();
+  std::vector<double> sticks = RandomInputs(n, -1, 1, 1);
+  std::vector<double> banks = RandomInputs(n, -radians(80), radians(80), 2);
+  std::vector<double> outputs(n);
+
+  while (state.KeepRunning()) {
+    for (size_t k = 0; k < n; k++) {
+      outputs[k] = CalculateDesiredRollRate(sticks[k], banks[k]);
+    }
+    DoNotOptimize(outputs.data());
+  }
+
+  state.SetItemsProcessed(state.Iterations() * n);
+  state.SetWorkingSetBytes(n * 3 * sizeof(double));
+}
+BENCHMARK(BM_CalculateDesiredRollRate)->Range(1, MAX_BATCH);
+
+/* The same, evaluated as one batch through the protection envelope */
+void BM_RollProtectionEnvelope(BenchmarkState& state) {
+  size_t n = state.Range();
+  std::vector<double> sticks = RandomInputs(n, -1, 1, 1);
+  std::vector<double> banks = RandomInputs(n, -radians(80), radians(80), 2);
+  std::vector<double> outputs(n);
+  RollProtectionEnvelope envelope;
+
+  while (state.KeepRunning()) {
+    envelope.DesiredRollRates(n, sticks.data(), banks.data(), outputs.data());
+    DoNotOptimize(outputs.data());
+  }
+
+  state.SetItemsProcessed(state.Iterations() * n);
+  state.SetWorkingSetBytes(n * 3 * sizeof(double));
+}
+BENCHMARK(BM_RollProtectionEnvelope)->Range(1, MAX_BATCH);
+
+/* Data exchanged by the heading autopilot, as in HeadingAPExample */
+struct BenchmarkPosition {
+  double sim_time_s;
+  float bank_rad;
+  float heading;
+};
+
+SIM_DATA_DEFINITION(BenchmarkPosition,
+  SIM_DATA_FIELD(sim_time_s, "SIMULATION TIME", "Seconds"),
+  SIM_DATA_FIELD(bank_rad, "PLANE BANK DEGREES", "Radians"),
+  SIM_DATA_FIELD(heading, "PLANE HEADING DEGREES TRUE", "Radians"));
+
+struct BenchmarkRollControl {
+  double aileronDeflect;
+};
+
+SIM_DATA_DEFINITION(BenchmarkRollControl,
+  SIM_DATA_FIELD(aileronDeflect, "AILERON POSITION", "Position"));
+
+/* The heading and bank controllers of one aircraft */
+struct HeadingAutopilot {
+  HeadingAutopilot()
+    : headingController(radians(3), 0, 0, -radians(20), radians(20)),
+      bankController(0.08 / radians(1), 0, 0, -1.0, 1.0) {}
+
+  ClampedPIDController headingController;
+  ClampedPIDController bankController;
+};
+
+/* One frame of the heading autopilot for each of N aircraft, from received
+   message to SetDataOnSimObject */
+void BM_HeadingUpdateControls(BenchmarkState& state) {
+  size_t n = state.Range();
+
+  LocalSimConfig config;
+  config.print_stats = false;
+  LocalSim_SetConfig(config);
+  HANDLE hSimConnect = NULL;
+  SimConnect_Open(&hSimConnect, "Benchmark", NULL, 0, NULL, 0);
+  SimData<BenchmarkPosition>::Register(hSimConnect);
+  SimData<BenchmarkRollControl>::Register(hSimConnect);
+
+  /* the messages as they would be received */
+  const size_t HEADER_SIZE = sizeof(SIMCONNECT_RECV_SIMOBJECT_DATA) - sizeof(DWORD);
+  const size_t MESSAGE_WORDS = (HEADER_SIZE + sizeof(BenchmarkPosition) + 7) / 8;
+  std::vector<uint64_t> storage(n * MESSAGE_WORDS);
+  std::vector<double> banks = RandomInputs(n, -radians(30), radians(30), 1);
+  std::vector<double> headings = RandomInputs(n, 0, radians(360), 2);
+  for (size_t k = 0; k < n; k++) {
+    auto* msg = reinterpret_cast<SIMCONNECT_RECV_SIMOBJECT_DATA*>(&storage[k * MESSAGE_WORDS]);
+    msg->dwSize = static_cast<DWORD>(HEADER_SIZE + sizeof(BenchmarkPosition));
+    msg->dwID = SIMCONNECT_RECV_ID_SIMOBJECT_DATA;
+    msg->dwDefineID = SimData<BenchmarkPosition>::DefineID();
+    msg->dwFlags = 0;
+    msg->dwDefineCount = SimData<BenchmarkPosition>::FieldCount();
+    BenchmarkPosition position = { 0, static_cast<float>(banks[k]), static_cast<float>(headings[k]) };
+    std::memcpy(&msg->dwData, &position, sizeof(position));
+  }
+
+  std::vector<std::unique_ptr<HeadingAutopilot>> autopilots;
+  for (size_t k = 0; k < n; k++) {
+    autopilots.emplace_back(new HeadingAutopilot());
+  }
+  const double selected_heading = 120;
+
+  while (state.KeepRunning()) {
+    for (size_t k = 0; k < n; k++) {
+      auto* msg = reinterpret_cast<SIMCONNECT_RECV_SIMOBJECT_DATA*>(&storage[k * MESSAGE_WORDS]);
+      const BenchmarkPosition* position = SimData<BenchmarkPosition>::Get(msg, msg->dwSize);
+      HeadingAutopilot& ap = *autopilots[k];
+
+      double heading_error = selected_heading - degrees(position->heading);
+      double requested_bank = ap.headingController.Update(heading_error, TIMESTEP);
+      double bank_error = requested_bank - -position->bank_rad;
+
+      BenchmarkRollControl control;
+      control.aileronDeflect = ap.bankController.Update(bank_error, TIMESTEP);
+      SimData<BenchmarkRollControl>::Set(hSimConnect, SIMCONNECT_OBJECT_ID_USER, control);
+    }
+  }
+
+  SimConnect_Close(hSimConnect);
+
+  state.SetItemsProcessed(state.Iterations() * n);
+  state.SetWorkingSetBytes(n * (MESSAGE_WORDS * 8 + sizeof(HeadingAutopilot*) + sizeof(HeadingAutopilot)));
+}
+BENCHMARK(BM_HeadingUpdateControls)->Range(1, MAX_BATCH);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,84 @@
+/*
+  Compares updating N clamped PID controllers held as individual objects,
+  called through SISOBlock's virtual interface, with updating a PIDBank of
+  the same controllers. Also checks that both produce bit-identical outputs.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "common/PIDBank.h"
+#include "common/PIDController.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/* Number of controller updates timed per case */
+const size_t UPDATES_PER_CASE = 50000000;
+
+/* Number of distinct error vectors cycled through */
+const size_t ERROR_FRAMES = 16;
+
+int main(int argc, char* argv[])
+{
+  const size_t sizes[] = { 1, 16, 256, 4096, 65536, 1048576 };
+  const double timestep = 1.0 / 30;
+
+  printf("%10s %12s %12s %9s %s\n", "N", "virtual ns", "bank ns", "speedup", "identical");
+
+  for (size_t n : sizes) {
+    std::mt19937_64 rng(n);
+    std::uniform_real_distribution<double> gain(0, 2);
+    std::uniform_real_distribution<double> error(-1, 1);
+
+    /* N heap allocated controllers, updated through the base class */
+    std::vector<std::unique_ptr<SISOBlock>> objects;
+    PIDBank bank;
+    for (size_t k = 0; k < n; k++) {
+      double p = gain(rng), d = gain(rng) * 0.1, i = gain(rng) * 0.5;
+      objects.emplace_back(new ClampedPIDController(p, d, i, -1, 1));
+      bank.Add(p, d, i, -1, 1);
+    }
+
+    std::vector<double> errors(ERROR_FRAMES * n);
+    for (double& e : errors) {
+      e = error(rng);
+    }
+    std::vector<double> object_outputs(n), bank_outputs(n);
+
+    size_t steps = UPDATES_PER_CASE / n;
+    if (steps < ERROR_FRAMES) {
+      steps = ERROR_FRAMES;
+    }
+
+    /* virtual dispatch */
+    bool identical = true;
+    Clock::time_point start = Clock::now();
+    for (size_t step = 0; step < steps; step++) {
+      const double* frame = &errors[(step % ERROR_FRAMES) * n];
+      for (size_t k = 0; k < n; k++) {
+        object_outputs[k] = objects[k]->Update(frame[k], timestep);
+      }
+    }
+    double virtual_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+    /* bank */
+    start = Clock::now();
+    for (size_t step = 0; step < steps; step++) {
+      bank.Update(&errors[(step % ERROR_FRAMES) * n], timestep, bank_outputs.data());
+    }
+    double bank_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+    identical = (std::memcmp(object_outputs.data(), bank_outputs.data(), n * sizeof(double)) == 0);
+
+    double updates = static_cast<double>(steps) * n;
+    printf("%10zu %12.3f %12.3f %8.1fx %s\n", n,
+      1e9 * virtual_s / updates, 1e9 * bank_s / updates, virtual_s / bank_s,
+      identical ? "yes" : "NO");
+  }
+
+  return 0;
+}
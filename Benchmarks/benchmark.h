@@ -0,0 +1,256 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+/*
+  A minimal microbenchmark harness with the same shape as Google Benchmark,
+  so the benchmarks need no external dependency:
+
+    void BM_Something(BenchmarkState& state) {
+      ... set up state.Range() items ...
+      while (state.KeepRunning()) {
+        ... update every item ...
+      }
+      state.SetItemsProcessed(state.Iterations() * state.Range());
+      state.SetWorkingSetBytes(...);
+    }
+    BENCHMARK(BM_Something)->Range(1, 1 << 20);
+
+    BENCHMARK_MAIN();
+
+  Each benchmark is run once for every argument in its range. Only the loop
+  is timed: the iteration count is increased until the loop runs for at
+  least the minimum time. For each run the time per iteration and per item
+  is printed, along with the working set and the smallest cache it fits in,
+  so that the cost of falling out of each cache level shows up as the batch
+  size grows.
+
+  Options:
+    --filter=TEXT    only run benchmarks whose name contains TEXT
+    --min_time=S     minimum time to run each benchmark for (0.2 s)
+*/
+
+/* Prevents the compiler from optimising away the computation of value */
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile const T* sink;
+  sink = &value;
+#endif
+}
+
+/* Passed to each benchmark function, which times its loop with KeepRunning */
+class BenchmarkState
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  BenchmarkState(size_t range, uint64_t iterations)
+    : range(range), iterations(iterations), remaining(iterations), started(false) {}
+
+  /* Returns true while there are iterations left to run, starting the timer
+     on the first call and stopping it after the last */
+  bool KeepRunning() {
+    if (!started) {
+      started = true;
+      start = Clock::now();
+    }
+    if (remaining > 0) {
+      remaining--;
+      return true;
+    }
+    stop = Clock::now();
+    return false;
+  }
+
+  /* The argument the benchmark is run with, normally the batch size */
+  size_t Range() const {
+    return range;
+  }
+
+  uint64_t Iterations() const {
+    return iterations;
+  }
+
+  /* Number of items processed by all the iterations, e.g. controller updates */
+  void SetItemsProcessed(uint64_t items) {
+    items_processed = items;
+  }
+
+  /* Bytes of memory touched by every iteration */
+  void SetWorkingSetBytes(size_t bytes) {
+    working_set_bytes = bytes;
+  }
+
+  double Seconds() const {
+    return std::chrono::duration<double>(stop - start).count();
+  }
+  uint64_t ItemsProcessed() const {
+    return items_processed;
+  }
+  size_t WorkingSetBytes() const {
+    return working_set_bytes;
+  }
+
+private:
+  size_t range;
+  uint64_t iterations;
+  uint64_t remaining;
+
+  bool started;
+  Clock::time_point start, stop;
+
+  uint64_t items_processed = 0;
+  size_t working_set_bytes = 0;
+};
+
+typedef void (*BenchmarkFunction)(BenchmarkState& state);
+
+/* A registered benchmark and the arguments it is run with */
+class Benchmark
+{
+public:
+  Benchmark(const char* name, BenchmarkFunction function)
+    : name(name), function(function) {}
+
+  /* Runs the benchmark with the given argument */
+  Benchmark* Arg(size_t arg) {
+    args.push_back(arg);
+    return this;
+  }
+
+  /* Runs the benchmark with every power of multiplier from low to high,
+     and with high itself */
+  Benchmark* Range(size_t low, size_t high, size_t multiplier = 8) {
+    for (size_t arg = low; arg < high; arg *= multiplier) {
+      args.push_back(arg);
+    }
+    args.push_back(high);
+    return this;
+  }
+
+  std::string name;
+  BenchmarkFunction function;
+  std::vector<size_t> args;
+};
+
+inline std::vector<Benchmark*>& RegisteredBenchmarks() {
+  static std::vector<Benchmark*> benchmarks;
+  return benchmarks;
+}
+
+inline Benchmark* RegisterBenchmark(const char* name, BenchmarkFunction function) {
+  Benchmark* benchmark = new Benchmark(name, function);
+  RegisteredBenchmarks().push_back(benchmark);
+  return benchmark;
+}
+
+#define BENCHMARK_CONCAT2(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT2(a, b)
+
+/* Registers a benchmark function, returning the Benchmark to add arguments to */
+#define BENCHMARK(function) \
+  static Benchmark* BENCHMARK_CONCAT(registered_benchmark_, __LINE__) = RegisterBenchmark(#function, function)
+
+/* Returns the name of the smallest data cache that holds bytes, if the cache
+   sizes are known */
+inline const char* CacheLevel(size_t bytes) {
+#if defined(__linux__) && defined(_SC_LEVEL1_DCACHE_SIZE)
+  static const long sizes[] = {
+    sysconf(_SC_LEVEL1_DCACHE_SIZE), sysconf(_SC_LEVEL2_CACHE_SIZE), sysconf(_SC_LEVEL3_CACHE_SIZE)
+  };
+  static const char* names[] = { "L1", "L2", "L3" };
+  if (sizes[0] <= 0) {
+    return "";
+  }
+  for (size_t level = 0; level < 3; level++) {
+    if (sizes[level] > 0 && bytes <= static_cast<size_t>(sizes[level])) {
+      return names[level];
+    }
+  }
+  return "memory";
+#else
+  (void)bytes;
+  return "";
+#endif
+}
+
+/* Runs every registered benchmark matching the command line filter */
+inline int RunBenchmarks(int argc, char* argv[]) {
+  std::string filter;
+  double min_time_s = 0.2;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--filter=", 9) == 0) {
+      filter = argv[i] + 9;
+    }
+    else if (std::strncmp(argv[i], "--min_time=", 11) == 0) {
+      min_time_s = std::atof(argv[i] + 11);
+    }
+    else {
+      fprintf(stderr, "usage: %s [--filter=TEXT] [--min_time=SECONDS]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  printf("%-36s %12s %12s %12s %12s %10s %s\n",
+    "Benchmark", "Iterations", "ns/iter", "ns/item", "Mitems/s", "Working set", "Fits in");
+
+  for (Benchmark* benchmark : RegisteredBenchmarks()) {
+    if (benchmark->name.find(filter) == std::string::npos) {
+      continue;
+    }
+    std::vector<size_t> args = benchmark->args;
+    if (args.empty()) {
+      args.push_back(1);
+    }
+
+    for (size_t arg : args) {
+      /* grow the iteration count until the loop runs for long enough,
+         aiming a little over the minimum time */
+      uint64_t iterations = 1;
+      for (;;) {
+        BenchmarkState state(arg, iterations);
+        benchmark->function(state);
+        double seconds = state.Seconds();
+
+        if (seconds >= min_time_s || iterations >= 1000000000) {
+          std::string name = benchmark->name + "/" + std::to_string(arg);
+          double items = static_cast<double>(state.ItemsProcessed());
+          size_t working_set = state.WorkingSetBytes();
+          printf("%-36s %12llu %12.1f %12.3f %12.2f %8zu KiB %s\n", name.c_str(),
+            static_cast<unsigned long long>(iterations), 1e9 * seconds / iterations,
+            items > 0 ? 1e9 * seconds / items : 0, items > 0 ? items / seconds / 1e6 : 0,
+            (working_set + 1023) / 1024, CacheLevel(working_set));
+          fflush(stdout);
+          break;
+        }
+
+        double scale = (seconds > 0) ? 1.4 * min_time_s / seconds : 10;
+        scale = std::max(2.0, std::min(scale, 100.0));
+        iterations = static_cast<uint64_t>(iterations * scale);
+      }
+    }
+  }
+  return 0;
+}
+
+/* Defines main to run the benchmarks */
+#define BENCHMARK_MAIN() \
+  int main(int argc, char* argv[]) { return RunBenchmarks(argc, argv); } \
+  int main(int argc, char* argv[])
+
+#endif
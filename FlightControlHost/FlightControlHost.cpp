@@ -0,0 +1,408 @@
+/*
+  Hosts several control loops in one process, sharing a single SimConnect
+  connection and a single per-frame data request, with the slowly changing
+  data they need sent only when it changes (see common/subscriptions.h):
+
+  * Heading autopilot (5 Hz): selects a bank angle to fly the autopilot heading
+  * Bank hold (10 Hz): selects a roll rate to hold that bank angle
+  * Roll control law (every frame): flies the roll rate through the roll FBW
+    control law, with its bank angle protection, with the roll rate gain
+    scheduled on airspeed and altitude
+
+  The autopilot flies through the same control law as the pilot, by
+  commanding the side-stick deflection that requests its roll rate. Any
+  pilot input on the side-stick overrides the autopilot.
+
+  Each loop runs at its own rate, scheduled from the SIMULATION TIME of each
+  frame (see common/scheduler.h and common/frame_clock.h). The loops write
+  their outputs to one staged struct, which is sent at the end of the frame
+  in a single call, with only the outputs that have changed
+  (see common/output_stage.h).
+
+  The loops run on a control thread of their own (see
+  common/control_pipeline.h). The main thread dispatches the SimConnect
+  messages, posts each frame's inputs to the control thread and sends the
+  outputs it posts back, so the loops never wait on SimConnect, the console
+  or the flight recording, and the main thread never waits on the loops: it
+  keeps dispatching while a frame is with the control thread, which runs
+  the newest frame when it is free and skips the stale ones.
+
+  The exception is the local simulator in lockstep, or replaying a
+  recording, which only simulates a frame when messages are dispatched.
+  There the main thread does not dispatch while a frame is with the control
+  thread, so each frame's outputs are sent before the next is simulated, as
+  they would be were the loops run in the dispatch handler, and runs stay
+  reproducible.
+*/
+
+#ifdef _WIN32
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include <strsafe.h>
+
+#include "external/SimConnect.h"
+#else
+#include <stdio.h>
+
+#include "localsim/SimConnect.h"
+#endif
+
+#include <cmath>
+
+#include "common/PIDController.h"
+#include "common/connection.h"
+#include "common/control_pipeline.h"
+#include "common/flight_recording.h"
+#include "common/frame_clock.h"
+#include "common/gain_schedule.h"
+#include "common/output_stage.h"
+#include "common/scheduler.h"
+#include "common/subscriptions.h"
+#include "common/util.h"
+#include "fbw/roll_control_law.h"
+
+#include "SimConnectInterface.h"
+
+int     quit = 0;
+HANDLE  hSimConnect = NULL;
+HANDLE  hDispatchEvent = NULL;
+
+/* Records the flight if FLIGHT_RECORDING names a file, see flight_recording.h */
+FlightRecorder recorder;
+
+/* Struct to hold the current status of all pilot inputs */
+struct PilotInputs {
+  /* joystick axis readings are normalised into the range [-1, 1] */
+  double joystickX = 0; /* last known value of joystick's x-axis */
+};
+
+/* Everything the loops run on for one frame, posted by the main thread to
+   the control thread */
+struct ControlInputs {
+  structFrameData frame;
+  structFlightCondition condition;
+  PilotInputs pilot;
+};
+
+/* Inputs of the next frame, as received by the main thread: the frame data
+   and the last flight condition and pilot inputs received */
+ControlInputs received;
+
+/* Plans the data requests from what the loops need of each struct */
+SubscriptionManager subscriptions(SIM_UPDATE_RATE);
+
+/* The rest of the control state below belongs to the control thread */
+
+/* Inputs of the frame being run */
+static PilotInputs pilotInputs;
+static structFrameData frame;
+static structFlightCondition condition;
+
+/* Outputs of the outer loops, read by the inner loops */
+static struct AutopilotDemands {
+  double bank_rad = 0; /* requested bank angle, positive right */
+  double stick = 0; /* side-stick deflection that requests the roll rate to hold the bank */
+} autopilot;
+
+/* Control surface outputs of the frame being run, posted back to the main
+   thread at its end */
+static structControlOutputs controls;
+
+/* Measures the time between frames */
+FrameClock frame_clock(1 / SIM_UPDATE_RATE);
+
+/* Time the loops are scheduled by: the simulation time, except that it never
+   goes backwards and skips over long gaps, see FrameClock */
+double control_time = 0;
+
+Scheduler scheduler;
+
+/*
+  Heading autopilot: use PID control to generate target bank angle based on
+  heading error
+*/
+void UpdateHeadingAutopilot(double dt) {
+  /* Required bank per error in heading */
+  const double BANK_PER_DEGREE_HEADING_ERROR = radians(3);
+
+  /* Finds target bank angle to achieve set heading, clamping at 20 degrees */
+  static ClampedPID headingController(BANK_PER_DEGREE_HEADING_ERROR, 0, 0, -radians(20), radians(20));
+
+  /* Error between desired and actual heading, taking the shorter way round */
+  double heading_error = std::fmod(frame.ap_heading_deg - degrees(frame.heading) + 540, 360) - 180;
+
+  autopilot.bank_rad = headingController.Update(heading_error, dt);
+}
+
+/*
+  Bank hold: roll towards the requested bank, at a roll rate proportional to
+  the bank error
+*/
+void UpdateBankHold(double dt) {
+  /* Roll rate per bank error, so that the bank settles in about 2 seconds */
+  const double ROLL_RATE_PER_BANK_ERROR = 0.5;
+
+  /* The output is expressed as the side-stick deflection that requests the
+     roll rate, so that it is limited to what the pilot could request */
+  static ClampedPID bankController(ROLL_RATE_PER_BANK_ERROR / RAD_S_PER_UNIT_DEFLECTION, 0, 0, -1, 1);
+
+  /* Error between requested and actual bank */
+  double bank_error = autopilot.bank_rad - -frame.bank_rad;
+
+  autopilot.stick = bankController.Update(bank_error, dt);
+}
+
+/*
+  Roll control law: the pilot's side-stick input, or the autopilot's when
+  the pilot is not flying, commands the roll rate
+*/
+void UpdateRollControlLaw(double dt) {
+  double stick = (pilotInputs.joystickX != 0) ? pilotInputs.joystickX : autopilot.stick;
+
+  /* Calculate desired roll rate from side-stick input and protections */
+  double desired_roll_rate = CalculateDesiredRollRate(stick, frame.bank_rad);
+
+  /* Use a P-only controller for roll rate, clamped to the aileron range. The
+     ailerons are more effective the higher the dynamic pressure, so less
+     gain is needed the faster the aircraft flies; the gain of the roll FBW
+     example (10) is for the default 737-800 in cruise, at 280 kts and 35000
+     ft. The other values are illustrative, see gain_tuner. */
+  static GainScheduledPIDController<LookupTable2D<PIDGains>> aileron_command(
+    LookupTable2D<PIDGains>(
+      { 150, 220, 280, 350 },     /* indicated airspeed, kts */
+      { 0, 20000, 35000, 41000 }, /* altitude, ft */
+      {
+        { 17.0, 0, 0 }, { 18.0, 0, 0 }, { 18.7, 0, 0 }, { 19.5, 0, 0 },
+        { 11.5, 0, 0 }, { 12.0, 0, 0 }, { 12.7, 0, 0 }, { 13.2, 0, 0 },
+        { 9.0, 0, 0 }, { 9.5, 0, 0 }, { 10.0, 0, 0 }, { 10.4, 0, 0 },
+        { 7.2, 0, 0 }, { 7.6, 0, 0 }, { 8.0, 0, 0 }, { 8.3, 0, 0 },
+      }),
+    -1, 1);
+
+  aileron_command.Schedule(condition.indicated_airspeed_kts, condition.altitude_ft);
+  controls.aileronDeflect = aileron_command.Update(desired_roll_rate - frame.rotation_vel_x_rad_s, dt);
+}
+
+void setupControlLoops() {
+  /* Outer loops are added first, so that the inner loops use their outputs
+     from the same frame */
+  scheduler.Add("Heading autopilot", 1.0 / 5, UpdateHeadingAutopilot);
+  scheduler.Add("Bank hold", 1.0 / 10, UpdateBankHold);
+  scheduler.Add("Roll control law", 0, UpdateRollControlLaw);
+}
+
+void setupEvents()
+{
+  // Set up private events
+  ASSERT_SC_SUCCESS(SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_XAXIS));
+
+  // Add private events to notification group (don't mask for now)
+  ASSERT_SC_SUCCESS(SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_0, EVENT_XAXIS));
+
+  // Set highest priority so we recieve event before ESP
+  ASSERT_SC_SUCCESS(SimConnect_SetNotificationGroupPriority(hSimConnect, GROUP_0, SIMCONNECT_GROUP_PRIORITY_HIGHEST));
+
+  // Map joystick event to this
+  ASSERT_SC_SUCCESS(SimConnect_MapInputEventToClientEvent(hSimConnect, INPUT_XAXIS, "joystick:0:XAxis", EVENT_XAXIS));
+
+  // Turn joystick events on
+  ASSERT_SC_SUCCESS(SimConnect_SetInputGroupState(hSimConnect, INPUT_XAXIS, SIMCONNECT_STATE_ON));
+}
+
+void setupDatadef() {
+  /* Fields are declared in SimConnectInterface.h, the data received is
+     registered as it is subscribed to */
+  ASSERT_SC_SUCCESS(SimData<structControlOutputs>::Register(hSimConnect));
+}
+
+void setupInitialDataRequests() {
+  /* The gain schedule changes slowly with airspeed and altitude. It is
+     subscribed to first, so that on the first frame it arrives before the
+     frame data that runs the loops. */
+  ASSERT_SC_SUCCESS(
+    subscriptions.Subscribe<structFlightCondition>(hSimConnect, "Flight condition",
+      SubscriptionNeeds::OnChange(2).Resolution("AIRSPEED INDICATED", 1).Resolution("PLANE ALTITUDE", 50))
+  );
+
+  /* The aircraft state, which runs the loops, every sim frame */
+  ASSERT_SC_SUCCESS(
+    subscriptions.Subscribe<structFrameData>(hSimConnect, "Frame data", SubscriptionNeeds::EveryFrame())
+  );
+}
+
+/* Runs the loops due on a frame, on the control thread */
+void RunControlLoops(const ControlInputs& inputs, structControlOutputs& outputs) {
+  frame = inputs.frame;
+  condition = inputs.condition;
+  pilotInputs = inputs.pilot;
+
+  control_time += frame_clock.Stamp(frame.sim_time_s);
+  scheduler.Tick(control_time);
+
+  outputs = controls;
+}
+
+/* Runs the loops on the control thread, fed by the main thread */
+ControlPipeline<ControlInputs, structControlOutputs> pipeline(RunControlLoops);
+
+/* Control surface outputs, sent to the simulator at the end of each frame.
+   Aileron deflections are sent however small the change, as the roll loop
+   closes through them, and as the joystick events are not masked, FSX's
+   own stick handling moves the ailerons too, so they are resent every
+   frame to override it, changed or not. */
+OutputStage<structControlOutputs> outputs;
+const uint64_t OUTPUT_REFRESH_FRAMES = 1;
+
+/* Sends the outputs of the frames the control thread has run */
+void SendOutputs() {
+  while (pipeline.Collect(outputs.Frame())) {
+    /* Send the outputs that changed to FSX, in one call */
+    ASSERT_SC_SUCCESS(outputs.Flush(hSimConnect, SIMCONNECT_OBJECT_ID_USER));
+    if (outputs.Sent()) {
+      recorder.RecordOutput(SimData<structControlOutputs>::DefineID(), SIMCONNECT_OBJECT_ID_USER,
+        outputs.SentData(), outputs.SentSize());
+    }
+  }
+}
+
+void CALLBACK SC_Dispatch_Handler(SIMCONNECT_RECV* pData, DWORD cbData, void *pContext)
+{
+  recorder.RecordReceived(pData, cbData);
+
+  switch (pData->dwID)
+  {
+  case SIMCONNECT_RECV_ID_SIMOBJECT_DATA:
+  {
+    SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = reinterpret_cast<SIMCONNECT_RECV_SIMOBJECT_DATA*>(pData);
+
+    // Frame data: run the loops on the control thread
+    if (subscriptions.Receive(pObjData, cbData, received.frame)) {
+      pipeline.Post(received);
+    }
+    // Flight condition
+    else if (subscriptions.Receive(pObjData, cbData, received.condition)) {
+      // held for the loops to use from the next frame
+    }
+
+    break;
+  }
+  case SIMCONNECT_RECV_ID_EVENT:
+  {
+    SIMCONNECT_RECV_EVENT *evt = (SIMCONNECT_RECV_EVENT*)pData;
+
+    switch (evt->uEventID)
+    {
+
+    case EVENT_SIM_START:
+    {
+    }
+    break;
+    case EVENT_XAXIS:
+    {
+      /* raw data is unsigned, so need to convert to signed before double */
+      int32_t joystickIn = static_cast<int32_t>(evt->dwData);
+      received.pilot.joystickX = static_cast<double>(joystickIn) / 32768;
+    }
+    break;
+    default:
+      break;
+    }
+    break;
+  }
+
+  case SIMCONNECT_RECV_ID_QUIT:
+  {
+    quit = 1;
+    break;
+  }
+
+  default:
+    printf("\nReceived:%d", pData->dwID);
+    break;
+  }
+}
+
+bool runFlightControl()
+{
+  // Event signalled by SimConnect whenever messages are waiting
+  hDispatchEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+  if (!recorder.OpenFromEnvironment("FLIGHT_RECORDING")) {
+    printf("Error, could not create flight recording\n");
+  }
+
+  setupControlLoops();
+  outputs.SetRefreshInterval(OUTPUT_REFRESH_FRAMES);
+
+  // Run the loops on their own thread, which signals the dispatch event
+  // when it has outputs to send
+  pipeline.Start(hDispatchEvent, ControlThreadOptions::FromEnvironment());
+
+  // Establish connected to FSX
+  if (!OpenSimConnect(&hSimConnect, "Flight Control Host", hDispatchEvent)) {
+    printf("Error, could not connect to the simulator\n");
+    pipeline.Stop();
+    CloseHandle(hDispatchEvent);
+    return false;
+  }
+
+  printf("Connected...\n");
+
+  // Setup events
+  setupEvents();
+
+  // Setup data definitons
+  setupDatadef();
+
+  // Setup regular requests
+  setupInitialDataRequests();
+
+#ifdef _WIN32
+  const bool lockstep = false;
+#else
+  const bool lockstep = LocalSim_IsLockstep(hSimConnect);
+#endif
+
+  // Main loop: sleep until SimConnect signals that messages are waiting, or
+  // the control thread that outputs are, unless built to poll continuously
+  // for comparison. In lockstep messages are only dispatched once the
+  // control thread has run every frame posted to it.
+  while (0 == quit) {
+#ifndef SPIN_DISPATCH
+    if (WaitForSingleObject(hDispatchEvent, INFINITE) != WAIT_OBJECT_0) {
+      continue;
+    }
+#endif
+    SendOutputs();
+    if (!lockstep || pipeline.InFlight() == 0) {
+      SimConnect_CallDispatch(hSimConnect, SC_Dispatch_Handler, NULL);
+    }
+  }
+
+  // Run and send the newest frame received before the quit message
+  pipeline.Stop();
+  SendOutputs();
+
+  SimConnect_Close(hSimConnect);
+  CloseHandle(hDispatchEvent);
+  recorder.Close();
+
+  // Show the rate each loop actually ran at
+  frame_clock.PrintStats(stdout);
+  scheduler.PrintStats(stdout);
+  outputs.PrintStats(stdout);
+  subscriptions.PrintStats(stdout, control_time);
+  pipeline.PrintStats(stdout);
+
+  return true;
+}
+
+int main(int argc, _TCHAR* argv[])
+{
+  if (!runFlightControl()) {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef SIMCONNECTINTERFACE_H
+#define SIMCONNECTINTERFACE_H
+
+/* This file contains all required enums, constants and structures required to
+   exchange data with FS through the SimConnect interface.
+*/
+
+#include "common/sim_data.h"
+
+/* Nominal FSX simulation physics frames per second: the actual rate varies,
+   so the time between frames is measured (see common/frame_clock.h) */
+const double SIM_UPDATE_RATE = 30;
+
+/* Input Group IDs */
+enum GROUP_ID {
+  GROUP_0,
+};
+
+enum INPUT_ID {
+  INPUT_XAXIS,
+};
+
+enum EVENT_ID {
+  EVENT_SIM_START,
+  EVENT_XAXIS,
+};
+
+/* Start of Structure Definitions: data definition and request IDs are
+   allocated by SimData, see common/sim_data.h */
+
+/* The aircraft state the control loops run on, received once every sim
+   frame. The simulation time is kept in double precision as it grows
+   without bound, the rest is single precision to keep the message small. */
+struct structFrameData {
+  double sim_time_s; // simulation time in seconds, used to schedule the loops
+  float bank_rad; // bank angle in radians, positive left
+  float rotation_vel_x_rad_s; // roll rate in radians per second, positive rolling right
+  float heading; // true aircraft heading in radians
+  float ap_heading_deg; // heading selected on the autopilot panel in degrees, sent in what would
+                        // otherwise be padding
+};
+
+SIM_DATA_DEFINITION(structFrameData,
+  SIM_DATA_FIELD(sim_time_s, "SIMULATION TIME", "Seconds"),
+  SIM_DATA_FIELD(bank_rad, "PLANE BANK DEGREES", "Radians"),
+  SIM_DATA_FIELD(rotation_vel_x_rad_s, "ROTATION VELOCITY BODY X", "Radians per second"),
+  SIM_DATA_FIELD(heading, "PLANE HEADING DEGREES TRUE", "Radians"),
+  SIM_DATA_FIELD(ap_heading_deg, "AUTOPILOT HEADING LOCK DIR", "Degrees"));
+
+/* Flight condition the gains are scheduled on, received when it changes
+   enough to matter */
+struct structFlightCondition {
+  float indicated_airspeed_kts; // indicated airspeed in knots
+  float altitude_ft; // altitude in feet
+};
+
+SIM_DATA_DEFINITION(structFlightCondition,
+  SIM_DATA_FIELD(indicated_airspeed_kts, "AIRSPEED INDICATED", "Knots"),
+  SIM_DATA_FIELD(altitude_ft, "PLANE ALTITUDE", "Feet"));
+
+/* Outputs of all the control loops, staged by the loops over a frame and
+   sent to the simulator in one call at its end (see common/output_stage.h).
+   Outputs for further control surfaces are added as further fields. */
+struct structControlOutputs {
+  double aileronDeflect = 0;
+};
+
+SIM_DATA_DEFINITION(structControlOutputs,
+  SIM_DATA_FIELD(aileronDeflect, "AILERON POSITION", "Position"));
+
+#endif
@@ -0,0 +1,591 @@
+/*
+  Tunes the controller gains of the examples against the aircraft model,
+  rather than picking them by hand for one aircraft.
+
+  Two loops are tuned:
+  * roll: the roll rate controller of the roll FBW example (P, I and D,
+    behind the roll control law), flown through stick steps, reversals and
+    releases into the bank angle protections
+  * heading: the nested heading and bank controllers of the heading
+    autopilot example (BANK_PER_DEGREE_HEADING_ERROR and
+    AILERON_DEFL_PER_BANK_ERROR), flown through heading changes of up to
+    150 degrees in both directions
+
+  Each candidate set of gains is flown through every scenario of its loop,
+  several hundred simulated seconds in all, and scored by a cost made of:
+  * the integral of time-weighted absolute error (ITAE), from the start of
+    each scenario
+  * the overshoot past the target, squared
+  * the actuator effort: the integral of aileron squared and of the
+    magnitude of the aileron rate, which penalises chatter
+
+  The cost is minimised by Nelder-Mead, in coordinates normalised to the
+  range of each gain (logarithmic for the proportional gains). The simplex
+  method evaluates few points per iteration, so it is parallelised within
+  each iteration: the reflection, expansion and both contractions are flown
+  together, speculatively, as are all the points of a shrink, and the
+  scenarios of every candidate are spread across all cores. The costs are
+  summed in a fixed order, so the result does not depend on the number of
+  threads.
+
+  The result is a gain table with a row per aircraft and gain, for the
+  aircraft described in AIRCRAFT below. The roll gains are named by their
+  keys in the roll FBW example's configuration file (aileron_p, ...).
+
+  Usage: gain_tuner [options]
+    --aircraft NAME   only tune the named aircraft (default: all)
+    --loop LOOP       only tune roll or heading (default: both)
+    --iterations N    maximum Nelder-Mead iterations per tuning (default 200)
+    --threads T       number of threads (default: all hardware threads)
+    --plant METHOD    discretisation of the aircraft's roll mode: euler (as the local
+                      simulator, default), trapezoidal, rk4 or exact
+    --csv FILE        write the gain table to FILE
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "common/PIDController.h"
+#include "common/aircraft_model.h"
+#include "common/parallel_for.h"
+#include "common/util.h"
+#include "fbw/roll_control_law.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/* Simulated frame rate, as the examples run at */
+const double FRAME_RATE_HZ = 30;
+
+/* Weights of the cost terms, relative to the ITAE of each loop */
+const double OVERSHOOT_WEIGHT = 10;
+const double AILERON_WEIGHT = 0.1;
+const double AILERON_RATE_WEIGHT = 0.5;
+
+/* Nelder-Mead coefficients: reflection, expansion, contraction and shrink */
+const double NM_REFLECT = 1;
+const double NM_EXPAND = 2;
+const double NM_CONTRACT = 0.5;
+const double NM_SHRINK = 0.5;
+
+/* Convergence: the spread of the simplex's costs, relative to the best */
+const double NM_COST_TOLERANCE = 1e-6;
+
+/* Aircraft to tune for: the default model approximates a 737-800 in cruise */
+struct Aircraft {
+  const char* name;
+  AircraftParameters params;
+};
+
+AircraftParameters MakeParameters(double roll_time_constant_s, double roll_rate_per_aileron,
+  double true_airspeed_m_s, double indicated_airspeed_kts, double altitude_ft) {
+  AircraftParameters params;
+  params.roll_time_constant_s = roll_time_constant_s;
+  params.roll_rate_per_aileron = roll_rate_per_aileron;
+  params.true_airspeed_m_s = true_airspeed_m_s;
+  params.indicated_airspeed_kts = indicated_airspeed_kts;
+  params.altitude_ft = altitude_ft;
+  return params;
+}
+
+const Aircraft AIRCRAFT[] = {
+  { "737-800", AircraftParameters() },
+  { "light-single", MakeParameters(0.25, 1.5, 60, 115, 5000) },
+  { "regional-turboprop", MakeParameters(0.4, 0.8, 140, 240, 20000) },
+  { "widebody", MakeParameters(0.9, 0.35, 250, 300, 37000) },
+};
+
+/* A gain being tuned, searched between low and high */
+struct GainRange {
+  const char* name;
+  double initial;     /* the example's hand-picked value */
+  double low, high;
+  bool logarithmic;   /* searched on a log scale, for gains spanning decades */
+};
+
+/* Converts between gains and the normalised coordinates of the search */
+double ToGain(const GainRange& range, double x) {
+  x = std::max(0.0, std::min(1.0, x));
+  if (range.logarithmic) {
+    return range.low * std::pow(range.high / range.low, x);
+  }
+  return range.low + x * (range.high - range.low);
+}
+
+double FromGain(const GainRange& range, double gain) {
+  if (range.logarithmic) {
+    return std::log(gain / range.low) / std::log(range.high / range.low);
+  }
+  return (gain - range.low) / (range.high - range.low);
+}
+
+enum Loop {
+  LOOP_ROLL,
+  LOOP_HEADING,
+  NUM_LOOPS,
+};
+
+const char* const LOOP_NAMES[NUM_LOOPS] = { "roll", "heading" };
+
+const GainRange ROLL_GAINS[] = {
+  { "aileron_p", 10, 1, 50, true },
+  { "aileron_i", 0, 0, 10, false },
+  { "aileron_d", 0, 0, 1, false },
+};
+
+const GainRange HEADING_GAINS[] = {
+  { "bank_per_degree_heading_error", radians(3), 0.002, 1, true },
+  { "aileron_defl_per_bank_error", 0.08 / radians(1), 0.2, 30, true },
+};
+
+template <typename T, size_t N>
+constexpr size_t CountOf(const T (&)[N]) {
+  return N;
+}
+
+/* A scenario flown by every candidate of a loop */
+struct Scenario {
+  double initial_bank_deg;  /* positive left */
+  double stick;             /* roll: joystick deflection until released */
+  double reverse_s;         /* roll: stick reversed at this time, if positive */
+  double release_s;         /* roll: stick released at this time */
+  double heading_change_deg; /* heading: autopilot heading relative to the initial heading */
+  double duration_s;
+};
+
+const Scenario ROLL_SCENARIOS[] = {
+  /* steps to and from the nominal bank */
+  { 0, 1, 0, 4, 0, 20 },
+  { 0, -1, 0, 4, 0, 20 },
+  { 0, 0.3, 0, 6, 0, 20 },
+  { 0, -0.3, 0, 6, 0, 20 },
+  /* reversals */
+  { 20, 1, 3, 6, 0, 20 },
+  { -20, -1, 3, 6, 0, 20 },
+  /* held into the bank angle protection */
+  { 30, -1, 0, 15, 0, 30 },
+  { -30, 1, 0, 15, 0, 30 },
+  /* hands off recovery from beyond the nominal bank */
+  { 60, 0, 0, 0, 0, 30 },
+  { -60, 0, 0, 0, 0, 30 },
+};
+
+const Scenario HEADING_SCENARIOS[] = {
+  { 0, 0, 0, 0, 10, 60 },
+  { 0, 0, 0, 0, -10, 60 },
+  { 0, 0, 0, 0, 45, 120 },
+  { 0, 0, 0, 0, -45, 120 },
+  { 0, 0, 0, 0, 150, 240 },
+  { 0, 0, 0, 0, -150, 240 },
+};
+
+/* Accumulates the cost of a scenario frame by frame */
+class CostAccumulator
+{
+public:
+  CostAccumulator(double timestep)
+    : timestep(timestep), t(0), itae(0), overshoot(0), aileron_sq(0), aileron_rate(0), last_aileron(0) {}
+
+  /* error is the tracking error of the frame, overshoot how far the output
+     is past its target (negative if short of it) */
+  void Add(double error, double overshoot_now, double aileron) {
+    t += timestep;
+    itae += t * std::abs(error) * timestep;
+    overshoot = std::max(overshoot, overshoot_now);
+    aileron_sq += aileron * aileron * timestep;
+    aileron_rate += std::abs(aileron - last_aileron);
+    last_aileron = aileron;
+  }
+
+  /* Total cost, with the errors scaled by error_scale into the units the
+     overshoot and effort weights are relative to */
+  double Cost(double error_scale) const {
+    double o = overshoot * error_scale;
+    return itae * error_scale + OVERSHOOT_WEIGHT * o * o +
+      AILERON_WEIGHT * aileron_sq + AILERON_RATE_WEIGHT * aileron_rate;
+  }
+
+private:
+  double timestep;
+  double t;
+  double itae, overshoot, aileron_sq, aileron_rate;
+  double last_aileron;
+};
+
+/* Joystick position at time t, quantised as the example receives it */
+double Joystick(const Scenario& s, double t) {
+  if (t >= s.release_s) {
+    return 0;
+  }
+  double x = (s.reverse_s > 0 && t >= s.reverse_s) ? -s.stick : s.stick;
+  return std::max(-32768.0, std::min(32767.0, std::round(x * 32768))) / 32768;
+}
+
+/* Flies a roll scenario: the roll control law and the roll rate controller,
+   as in the roll FBW example, which has no derivative filter */
+double FlyRoll(const AircraftParameters& params, const double* gains, const Scenario& s) {
+  AircraftState initial;
+  initial.bank_rad = radians(s.initial_bank_deg);
+  AircraftModel aircraft(params, initial);
+
+  ClampedPID aileron_command(gains[0], gains[2], gains[1], -1, 1);
+
+  const double timestep = 1 / FRAME_RATE_HZ;
+  size_t frames = static_cast<size_t>(s.duration_s * FRAME_RATE_HZ);
+  CostAccumulator cost(timestep);
+
+  for (size_t frame = 0; frame < frames; frame++) {
+    double desired_roll_rate = CalculateDesiredRollRate(Joystick(s, frame * timestep), aircraft.BankRad());
+    double error = desired_roll_rate - aircraft.RollRateRad_s();
+    aircraft.SetAileron(aileron_command.Update(error, timestep));
+    aircraft.Step(timestep);
+
+    /* overshoot of the roll rate past the demand, and of the bank past the
+       protection limit, a degree of bank counting as a degree per second */
+    double rate_overshoot = (desired_roll_rate != 0) ?
+      (aircraft.RollRateRad_s() - desired_roll_rate) * sign(desired_roll_rate) : 0;
+    double bank_overshoot = std::abs(aircraft.BankRad()) - MAX_BANK_ANGLE;
+    cost.Add(error, std::max(rate_overshoot, bank_overshoot), aircraft.Aileron());
+  }
+
+  /* roll rate errors, relative to the largest roll rate the stick requests */
+  return cost.Cost(1 / MAX_REQUESTABLE_ROLL_RATE);
+}
+
+/* Flies a heading scenario: the heading and bank controllers of the heading
+   autopilot example */
+double FlyHeading(const AircraftParameters& params, const double* gains, const Scenario& s) {
+  AircraftModel aircraft(params);
+  double target_deg = s.heading_change_deg;
+
+  ClampedPID heading_controller(gains[0], 0, 0, -radians(20), radians(20));
+  ClampedPID bank_controller(gains[1], 0, 0, -1, 1);
+
+  const double timestep = 1 / FRAME_RATE_HZ;
+  size_t frames = static_cast<size_t>(s.duration_s * FRAME_RATE_HZ);
+  CostAccumulator cost(timestep);
+
+  for (size_t frame = 0; frame < frames; frame++) {
+    /* error taking the shorter way round */
+    double error = std::fmod(target_deg - degrees(aircraft.HeadingRad()) + 540, 360) - 180;
+    double requested_bank = heading_controller.Update(error, timestep);
+    double bank_error = requested_bank - -aircraft.BankRad();
+    aircraft.SetAileron(bank_controller.Update(bank_error, timestep));
+    aircraft.Step(timestep);
+
+    double overshoot = -error * sign(target_deg);
+    cost.Add(error, overshoot, aircraft.Aileron());
+  }
+
+  /* heading errors in tens of degrees, and the whole cost in tens of
+     seconds, as the heading loop is that much slower than the roll rate loop */
+  return cost.Cost(0.1) * 0.1;
+}
+
+/* Tunes the gains of one loop for one aircraft */
+class GainTuning
+{
+public:
+  GainTuning(const AircraftParameters& params, Loop loop, unsigned threads)
+    : params(params), loop(loop), threads(threads), evaluations(0), frames(0) {
+    if (loop == LOOP_ROLL) {
+      ranges.assign(ROLL_GAINS, ROLL_GAINS + CountOf(ROLL_GAINS));
+      scenarios.assign(ROLL_SCENARIOS, ROLL_SCENARIOS + CountOf(ROLL_SCENARIOS));
+    }
+    else {
+      ranges.assign(HEADING_GAINS, HEADING_GAINS + CountOf(HEADING_GAINS));
+      scenarios.assign(HEADING_SCENARIOS, HEADING_SCENARIOS + CountOf(HEADING_SCENARIOS));
+    }
+  }
+
+  /* Gains at a point of the search */
+  std::vector<double> Gains(const std::vector<double>& x) const {
+    std::vector<double> gains(ranges.size());
+    for (size_t k = 0; k < ranges.size(); k++) {
+      gains[k] = ToGain(ranges[k], x[k]);
+    }
+    return gains;
+  }
+
+  /* Costs of a batch of points, flying every scenario of every point at once */
+  std::vector<double> Evaluate(const std::vector<std::vector<double>>& points) {
+    size_t n = scenarios.size();
+    std::vector<std::vector<double>> gains(points.size());
+    for (size_t c = 0; c < points.size(); c++) {
+      gains[c] = Gains(points[c]);
+    }
+
+    std::vector<double> costs(points.size() * n);
+    ParallelFor(costs.size(), 1, [&](size_t begin, size_t end, unsigned) {
+      for (size_t k = begin; k < end; k++) {
+        const double* g = gains[k / n].data();
+        const Scenario& s = scenarios[k % n];
+        costs[k] = (loop == LOOP_ROLL) ? FlyRoll(params, g, s) : FlyHeading(params, g, s);
+      }
+    }, threads);
+
+    /* sum in scenario order, whichever thread flew them */
+    std::vector<double> totals(points.size(), 0);
+    for (size_t k = 0; k < costs.size(); k++) {
+      totals[k / n] += costs[k];
+    }
+
+    evaluations += points.size();
+    for (const Scenario& s : scenarios) {
+      frames += points.size() * static_cast<size_t>(s.duration_s * FRAME_RATE_HZ);
+    }
+    return totals;
+  }
+
+  /* Minimises the cost from the initial gains, returning the best point */
+  std::vector<double> Minimise(size_t max_iterations, double& best_cost, double& initial_cost) {
+    size_t dims = ranges.size();
+
+    /* initial simplex: the hand-picked gains, and a step of a fifth of the
+       range along each axis, towards the middle of the range */
+    std::vector<std::vector<double>> simplex(dims + 1, std::vector<double>(dims));
+    for (size_t k = 0; k < dims; k++) {
+      simplex[0][k] = FromGain(ranges[k], ranges[k].initial);
+    }
+    for (size_t v = 1; v <= dims; v++) {
+      simplex[v] = simplex[0];
+      size_t k = v - 1;
+      simplex[v][k] += (simplex[0][k] < 0.5) ? 0.2 : -0.2;
+    }
+    std::vector<double> costs = Evaluate(simplex);
+    initial_cost = costs[0];
+
+    for (iterations = 0; iterations < max_iterations; iterations++) {
+      /* order the vertices from best to worst */
+      std::vector<size_t> order(dims + 1);
+      for (size_t v = 0; v <= dims; v++) {
+        order[v] = v;
+      }
+      std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return costs[a] < costs[b]; });
+      std::vector<std::vector<double>> sorted_simplex(dims + 1);
+      std::vector<double> sorted_costs(dims + 1);
+      for (size_t v = 0; v <= dims; v++) {
+        sorted_simplex[v] = simplex[order[v]];
+        sorted_costs[v] = costs[order[v]];
+      }
+      simplex.swap(sorted_simplex);
+      costs.swap(sorted_costs);
+
+      if (costs[dims] - costs[0] <= NM_COST_TOLERANCE * std::abs(costs[0])) {
+        break;
+      }
+
+      /* centroid of all but the worst vertex */
+      std::vector<double> centroid(dims, 0);
+      for (size_t v = 0; v < dims; v++) {
+        for (size_t k = 0; k < dims; k++) {
+          centroid[k] += simplex[v][k] / dims;
+        }
+      }
+
+      /* fly the reflection, expansion and both contractions together, as
+         all of them may be needed */
+      std::vector<std::vector<double>> trial(4, std::vector<double>(dims));
+      const double steps[4] = { NM_REFLECT, NM_REFLECT * NM_EXPAND, NM_REFLECT * NM_CONTRACT, -NM_CONTRACT };
+      for (size_t t = 0; t < 4; t++) {
+        for (size_t k = 0; k < dims; k++) {
+          double x = centroid[k] + steps[t] * (centroid[k] - simplex[dims][k]);
+          trial[t][k] = std::max(0.0, std::min(1.0, x));
+        }
+      }
+      std::vector<double> trial_costs = Evaluate(trial);
+      double reflected = trial_costs[0], expanded = trial_costs[1];
+      double contracted_out = trial_costs[2], contracted_in = trial_costs[3];
+
+      int accept = -1;
+      if (reflected < costs[0]) {
+        accept = (expanded < reflected) ? 1 : 0;
+      }
+      else if (reflected < costs[dims - 1]) {
+        accept = 0;
+      }
+      else if (reflected < costs[dims]) {
+        accept = (contracted_out <= reflected) ? 2 : -1;
+      }
+      else {
+        accept = (contracted_in < costs[dims]) ? 3 : -1;
+      }
+
+      if (accept >= 0) {
+        simplex[dims] = trial[accept];
+        costs[dims] = trial_costs[accept];
+      }
+      else {
+        /* shrink towards the best vertex */
+        std::vector<std::vector<double>> shrunk(simplex.begin() + 1, simplex.end());
+        for (std::vector<double>& vertex : shrunk) {
+          for (size_t k = 0; k < dims; k++) {
+            vertex[k] = simplex[0][k] + NM_SHRINK * (vertex[k] - simplex[0][k]);
+          }
+        }
+        std::vector<double> shrunk_costs = Evaluate(shrunk);
+        for (size_t v = 1; v <= dims; v++) {
+          simplex[v] = shrunk[v - 1];
+          costs[v] = shrunk_costs[v - 1];
+        }
+      }
+    }
+
+    size_t best = std::min_element(costs.begin(), costs.end()) - costs.begin();
+    best_cost = costs[best];
+    return simplex[best];
+  }
+
+  const std::vector<GainRange>& Ranges() const {
+    return ranges;
+  }
+
+  /* Nelder-Mead iterations run, candidates flown and frames simulated */
+  size_t Iterations() const {
+    return iterations;
+  }
+  size_t Evaluations() const {
+    return evaluations;
+  }
+  double Frames() const {
+    return static_cast<double>(frames);
+  }
+
+private:
+  AircraftParameters params;
+  Loop loop;
+  unsigned threads;
+  std::vector<GainRange> ranges;
+  std::vector<Scenario> scenarios;
+
+  size_t iterations = 0;
+  size_t evaluations;
+  size_t frames;
+};
+
+const char* const DISCRETISATION_NAMES[] = { "euler", "trapezoidal", "rk4", "exact" };
+
+/* A row of the gain table */
+struct TunedGain {
+  const char* aircraft;
+  Loop loop;
+  const char* gain;
+  double initial, tuned;
+};
+
+void Usage(const char* program) {
+  fprintf(stderr, "Usage: %s [--aircraft NAME] [--loop roll|heading] [--iterations N] [--threads T] "
+    "[--plant METHOD] [--csv FILE]\n", program);
+  exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+  const char* aircraft_name = nullptr;
+  int only_loop = -1;
+  size_t max_iterations = 200;
+  unsigned threads = HardwareThreads();
+  Discretisation plant = DISCRETISE_EULER;
+  const char* csv_path = nullptr;
+
+  for (int arg = 1; arg < argc; arg++) {
+    bool has_value = (arg + 1 < argc);
+    if (strcmp(argv[arg], "--aircraft") == 0 && has_value) {
+      aircraft_name = argv[++arg];
+    }
+    else if (strcmp(argv[arg], "--loop") == 0 && has_value) {
+      const char* name = argv[++arg];
+      for (int loop = 0; loop < NUM_LOOPS; loop++) {
+        if (strcmp(name, LOOP_NAMES[loop]) == 0) {
+          only_loop = loop;
+        }
+      }
+      if (only_loop < 0) {
+        Usage(argv[0]);
+      }
+    }
+    else if (strcmp(argv[arg], "--iterations") == 0 && has_value) {
+      max_iterations = strtoull(argv[++arg], nullptr, 10);
+    }
+    else if (strcmp(argv[arg], "--threads") == 0 && has_value) {
+      threads = static_cast<unsigned>(strtoul(argv[++arg], nullptr, 10));
+    }
+    else if (strcmp(argv[arg], "--plant") == 0 && has_value) {
+      const char* name = argv[++arg];
+      size_t method = 0;
+      while (method < CountOf(DISCRETISATION_NAMES) && strcmp(name, DISCRETISATION_NAMES[method]) != 0) {
+        method++;
+      }
+      if (method == CountOf(DISCRETISATION_NAMES)) {
+        Usage(argv[0]);
+      }
+      plant = static_cast<Discretisation>(method);
+    }
+    else if (strcmp(argv[arg], "--csv") == 0 && has_value) {
+      csv_path = argv[++arg];
+    }
+    else {
+      Usage(argv[0]);
+    }
+  }
+  if (threads == 0) {
+    threads = HardwareThreads();
+  }
+
+  std::vector<TunedGain> table;
+  bool found = false;
+  for (const Aircraft& aircraft : AIRCRAFT) {
+    if (aircraft_name && strcmp(aircraft_name, aircraft.name) != 0) {
+      continue;
+    }
+    found = true;
+    AircraftParameters params = aircraft.params;
+    params.roll_discretisation = plant;
+
+    for (int l = 0; l < NUM_LOOPS; l++) {
+      if (only_loop >= 0 && l != only_loop) {
+        continue;
+      }
+      Loop loop = static_cast<Loop>(l);
+      GainTuning tuning(params, loop, threads);
+
+      Clock::time_point start = Clock::now();
+      double best_cost, initial_cost;
+      std::vector<double> gains = tuning.Gains(tuning.Minimise(max_iterations, best_cost, initial_cost));
+      double elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+      printf("%s %s: cost %.4g -> %.4g, %zu iterations, %zu candidates in %.2fs (%.1f M frames/s)\n",
+        aircraft.name, LOOP_NAMES[loop], initial_cost, best_cost, tuning.Iterations(),
+        tuning.Evaluations(), elapsed_s, tuning.Frames() / elapsed_s / 1e6);
+      for (size_t k = 0; k < gains.size(); k++) {
+        const GainRange& range = tuning.Ranges()[k];
+        printf("  %-32s %10.5f (was %.5f)\n", range.name, gains[k], range.initial);
+        TunedGain row = { aircraft.name, loop, range.name, range.initial, gains[k] };
+        table.push_back(row);
+      }
+    }
+  }
+  if (!found) {
+    fprintf(stderr, "Unknown aircraft %s\n", aircraft_name);
+    return 1;
+  }
+
+  if (csv_path) {
+    FILE* csv = fopen(csv_path, "w");
+    if (!csv) {
+      fprintf(stderr, "Error, could not open %s\n", csv_path);
+      return 1;
+    }
+    fprintf(csv, "aircraft,loop,gain,initial,tuned\n");
+    for (const TunedGain& row : table) {
+      fprintf(csv, "%s,%s,%s,%.6g,%.6g\n", row.aircraft, LOOP_NAMES[row.loop], row.gain, row.initial, row.tuned);
+    }
+    fclose(csv);
+  }
+
+  return 0;
+}
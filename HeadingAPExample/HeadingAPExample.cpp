@@ -3,20 +3,34 @@ The project simulates:
 * A simple aircraft lateral heading controller
 */
 
+#ifdef _WIN32
 #include <windows.h> 
 #include <tchar.h> 
 #include <stdio.h> 
 #include <strsafe.h> 
 
 #include "external/SimConnect.h" 
+#else
+#include <stdio.h>
+
+#include "localsim/SimConnect.h"
+#endif
 
 #include "common/PIDController.h"
+#include "common/connection.h"
+#include "common/flight_recording.h"
+#include "common/frame_clock.h"
+#include "common/telemetry.h"
 #include "common/util.h"
 
 #include "SimConnectInterface.h"
 
 int     quit = 0;
 HANDLE  hSimConnect = NULL;
+HANDLE  hDispatchEvent = NULL;
+
+/* Records the flight if FLIGHT_RECORDING names a file, see flight_recording.h */
+FlightRecorder recorder;
 
 /* Struct to hold the current status of all pilot inputs */
 static struct PilotInputs {
@@ -27,35 +41,74 @@ static struct PilotInputs {
 /* Actual aircraft status */
 structAircraftPosition aircraft_status;
 
+/* Measures the time between position updates */
+FrameClock frame_clock(1 / SIM_UPDATE_RATE);
+
 /* Selected autopilot heading */
 structAutopilotSelectedHeading ap_selected_heading;
 
-void setupDatadef() {
-  ASSERT_SC_SUCCESS(SimConnect_AddToDataDefinition(hSimConnect, DEFINITION_AIRCRAFT_POSITION, "PLANE BANK DEGREES", "Radians"));
-  ASSERT_SC_SUCCESS(SimConnect_AddToDataDefinition(hSimConnect, DEFINITION_AIRCRAFT_POSITION, "PLANE HEADING DEGREES TRUE", "Radians"));
+/* Record logged from the control path, written out by a background thread */
+struct TelemetryRecord {
+  enum Type {
+    CONTROL_UPDATE,       /* outputs of UpdateControls */
+    AUTOPILOT_HEADING,    /* a new selected heading was received */
+    UNKNOWN_MESSAGE,      /* an unhandled SimConnect message was received */
+  } type;
+  uint64_t timestamp_ns;
+
+  double selected_heading_deg;
+  double heading_deg;
+  double heading_error_deg;
+  double requested_bank_deg;
+  double bank_deg;          /* positive left */
+  double bank_error_deg;
+  double aileron;
+  DWORD message_id;
+};
+
+void FormatTelemetry(FILE* out, const TelemetryRecord& record) {
+  switch (record.type) {
+  case TelemetryRecord::CONTROL_UPDATE:
+    fprintf(out, "HEADING: Req: %lf , Act: %lf , Err = %lf, Bank = %lf\n",
+      record.selected_heading_deg, record.heading_deg,
+      record.heading_error_deg, record.requested_bank_deg);
+    /* uncomment this to see aileron control calculations */
+    //fprintf(out, "BANK: Req: %lf , Act: %lf , Err = %lf, Aileron = %lf\n",
+    //  record.requested_bank_deg, record.bank_deg, record.bank_error_deg, record.aileron);
+    break;
+  case TelemetryRecord::AUTOPILOT_HEADING:
+    fprintf(out, "New autopilot heading: %lf\n", record.selected_heading_deg);
+    break;
+  case TelemetryRecord::UNKNOWN_MESSAGE:
+    fprintf(out, "Received:%d\n", static_cast<int>(record.message_id));
+    break;
+  }
+}
 
-  ASSERT_SC_SUCCESS(SimConnect_AddToDataDefinition(hSimConnect, DEFINITION_AUTOPILOT_SELECTED_HEADING, "AUTOPILOT HEADING LOCK DIR", "Degrees"));
+Telemetry<TelemetryRecord> telemetry(FormatTelemetry);
 
-  ASSERT_SC_SUCCESS(SimConnect_AddToDataDefinition(hSimConnect, DEFINITION_AIRCRAFT_ROLL_CONTROL, "AILERON POSITION", "Position"));
+void setupDatadef() {
+  /* Fields are declared in SimConnectInterface.h */
+  ASSERT_SC_SUCCESS(SimData<structAircraftPosition>::Register(hSimConnect));
+  ASSERT_SC_SUCCESS(SimData<structAutopilotSelectedHeading>::Register(hSimConnect));
+  ASSERT_SC_SUCCESS(SimData<structAircraftRollControl>::Register(hSimConnect));
 }
 
 void setupInitialDataRequests() {
   /* Get position information for every sim frame */
   ASSERT_SC_SUCCESS(
-    SimConnect_RequestDataOnSimObject(hSimConnect, REQUEST_AIRCRAFT_POSITION,
-      DEFINITION_AIRCRAFT_POSITION, SIMCONNECT_OBJECT_ID_USER, SIMCONNECT_PERIOD_SIM_FRAME, 0)
+    SimData<structAircraftPosition>::Request(hSimConnect, SIMCONNECT_OBJECT_ID_USER, SIMCONNECT_PERIOD_SIM_FRAME)
   );
 
   /* Get autopilot heading only when it changes */
   ASSERT_SC_SUCCESS(
-    SimConnect_RequestDataOnSimObject(hSimConnect, REQUEST_AUTOPILOT_HEADING,
-      DEFINITION_AUTOPILOT_SELECTED_HEADING, SIMCONNECT_OBJECT_ID_USER,
+    SimData<structAutopilotSelectedHeading>::Request(hSimConnect, SIMCONNECT_OBJECT_ID_USER,
       SIMCONNECT_PERIOD_SIM_FRAME, SIMCONNECT_DATA_REQUEST_FLAG_CHANGED)
   );
 
 }
 
-void UpdateControls() {
+void UpdateControls(double timestep) {
   /*
     Use PID control to generate target bank angle based on heading error
   */
@@ -73,12 +126,7 @@ void UpdateControls() {
   double heading_error = ap_selected_heading.heading - degrees(aircraft_status.heading);
 
   /* Update PID controller */
-  double requested_bank = headingController.Update(heading_error, 1);
-
-  /* Dump to screen: uncomment this to see desired roll calculations */
-  printf("HEADING: Req: %lf , Act: %lf , Err = %lf, Bank = %lf\n", 
-    ap_selected_heading.heading, degrees(aircraft_status.heading), 
-    heading_error, degrees(requested_bank));
+  double requested_bank = headingController.Update(heading_error, timestep);
 
   /* Required aileron deflection per bank error */
   const double AILERON_DEFL_PER_BANK_ERROR = 0.08 / radians(1); // 0.08 units per degree
@@ -93,22 +141,35 @@ void UpdateControls() {
   double bank_error = requested_bank - -aircraft_status.bank_rad;
 
   /* Update PID controller */
-  double aileron_defl = bankController.Update(bank_error, 1);
+  double aileron_defl = bankController.Update(bank_error, timestep);
 
   /* Update FSX */
   structAircraftRollControl rollControlSettings;
   rollControlSettings.aileronDeflect = aileron_defl;
   ASSERT_SC_SUCCESS(
-    SimConnect_SetDataOnSimObject(hSimConnect, DEFINITION_AIRCRAFT_ROLL_CONTROL,
-      SIMCONNECT_OBJECT_ID_USER, 0, 1, sizeof(rollControlSettings), &rollControlSettings));
-
-  /* Dump to screen: uncomment this to see aileron control calculations */
-  //printf("BANK: Req: %lf , Act: %lf , Err = %lf, Bank = %lf\n",
-  //  requested_bank, aircraft_status.bank_rad, bank_error, aileron_defl);
+    SimData<structAircraftRollControl>::Set(hSimConnect, SIMCONNECT_OBJECT_ID_USER, rollControlSettings));
+  recorder.RecordOutput(SimData<structAircraftRollControl>::DefineID(), SIMCONNECT_OBJECT_ID_USER,
+    &rollControlSettings, sizeof(rollControlSettings));
+
+  /* Log the calculations, see FormatTelemetry for what is printed */
+  TelemetryRecord record;
+  record.type = TelemetryRecord::CONTROL_UPDATE;
+  record.timestamp_ns = MonotonicTimeNs();
+  record.selected_heading_deg = ap_selected_heading.heading;
+  record.heading_deg = degrees(aircraft_status.heading);
+  record.heading_error_deg = heading_error;
+  record.requested_bank_deg = degrees(requested_bank);
+  record.bank_deg = degrees(aircraft_status.bank_rad);
+  record.bank_error_deg = degrees(bank_error);
+  record.aileron = aileron_defl;
+  record.message_id = 0;
+  telemetry.Log(record);
 }
 
 void CALLBACK SC_Dispatch_Handler(SIMCONNECT_RECV* pData, DWORD cbData, void *pContext)
 {
+  recorder.RecordReceived(pData, cbData);
+
   switch (pData->dwID)
   {
   case SIMCONNECT_RECV_ID_SIMOBJECT_DATA:
@@ -116,19 +177,22 @@ void CALLBACK SC_Dispatch_Handler(SIMCONNECT_RECV* pData, DWORD cbData, void *pC
     SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = reinterpret_cast<SIMCONNECT_RECV_SIMOBJECT_DATA*>(pData);
 
     // Position data:
-    if (pObjData->dwRequestID == REQUEST_AIRCRAFT_POSITION) {
+    if (const structAircraftPosition* position = SimData<structAircraftPosition>::Get(pObjData, cbData)) {
       // update aircraft status struct
-      aircraft_status =
-        *reinterpret_cast<structAircraftPosition*>(&pObjData->dwData);
+      aircraft_status = *position;
 
-      UpdateControls();
+      UpdateControls(frame_clock.Stamp(position->sim_time_s));
     }
     // Autopilot settings
-    else if (pObjData->dwDefineID == REQUEST_AUTOPILOT_HEADING) {
+    else if (const structAutopilotSelectedHeading* heading = SimData<structAutopilotSelectedHeading>::Get(pObjData, cbData)) {
       // update autopilot heading struct
-      ap_selected_heading = 
-        *reinterpret_cast<structAutopilotSelectedHeading*>(&pObjData->dwData);
-      printf("New autopilot heading: %lf\n", ap_selected_heading.heading);
+      ap_selected_heading = *heading;
+
+      TelemetryRecord record = TelemetryRecord();
+      record.type = TelemetryRecord::AUTOPILOT_HEADING;
+      record.timestamp_ns = MonotonicTimeNs();
+      record.selected_heading_deg = ap_selected_heading.heading;
+      telemetry.Log(record);
     }
 
     break;
@@ -147,7 +211,7 @@ void CALLBACK SC_Dispatch_Handler(SIMCONNECT_RECV* pData, DWORD cbData, void *pC
     case EVENT_XAXIS:
     {
       /* raw data is unsigned, so need to convert to signed before double */
-      long int joystickIn = evt->dwData;
+      int32_t joystickIn = static_cast<int32_t>(evt->dwData);
       pilotInputs.joystickX = static_cast<double>(joystickIn) / 32768;
     }
     break;
@@ -164,15 +228,32 @@ void CALLBACK SC_Dispatch_Handler(SIMCONNECT_RECV* pData, DWORD cbData, void *pC
   }
 
   default:
-    printf("\nReceived:%d", pData->dwID);
+  {
+    TelemetryRecord record = TelemetryRecord();
+    record.type = TelemetryRecord::UNKNOWN_MESSAGE;
+    record.timestamp_ns = MonotonicTimeNs();
+    record.message_id = pData->dwID;
+    telemetry.Log(record);
     break;
   }
+  }
 }
 
-void runHeadingControl()
+bool runHeadingControl()
 {
+  // Event signalled by SimConnect whenever messages are waiting
+  hDispatchEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+  if (!recorder.OpenFromEnvironment("FLIGHT_RECORDING")) {
+    printf("Error, could not create flight recording\n");
+  }
+
   // Establish connected to FSX
-  while (SimConnect_Open(&hSimConnect, "Heading Autopilot", NULL, 0, 0, 0) != S_OK);
+  if (!OpenSimConnect(&hSimConnect, "Heading Autopilot", hDispatchEvent)) {
+    printf("Error, could not connect to the simulator\n");
+    CloseHandle(hDispatchEvent);
+    return false;
+  }
 
   printf("Connected...\b");
 
@@ -182,17 +263,34 @@ void runHeadingControl()
   // Setup regular requests
   setupInitialDataRequests();
 
-  // Main loop
+  // Main loop: sleep until SimConnect signals that messages are waiting,
+  // unless built to poll continuously for comparison
   while (0 == quit) {
+#ifndef SPIN_DISPATCH
+    if (WaitForSingleObject(hDispatchEvent, INFINITE) != WAIT_OBJECT_0) {
+      continue;
+    }
+#endif
     SimConnect_CallDispatch(hSimConnect, SC_Dispatch_Handler, NULL);
   }
 
   SimConnect_Close(hSimConnect);
+  CloseHandle(hDispatchEvent);
+  recorder.Close();
+
+  return true;
 }
 
 int main(int argc, _TCHAR* argv[])
 {
-  runHeadingControl();
+  /* Write telemetry to the console from a background thread */
+  telemetry.Start(stdout);
+
+  bool connected = runHeadingControl();
+
+  telemetry.Stop();
+
+  frame_clock.PrintStats(stdout);
 
-  return 0;
+  return connected ? 0 : 1;
 }
\ No newline at end of file
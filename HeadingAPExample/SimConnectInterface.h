@@ -5,8 +5,10 @@
 exchange data with FS through the SimConnect interface.
 */
 
-/* FSX Simulation phyiscs frames rate per second: this is actually variable
-but we don't currently make use of it.
+#include "common/sim_data.h"
+
+/* Nominal FSX simulation physics frames per second: the actual rate varies,
+so the time between frames is measured (see common/frame_clock.h).
 */
 const double SIM_UPDATE_RATE = 30;
 
@@ -24,36 +26,39 @@ enum EVENT_ID {
   EVENT_XAXIS,
 };
 
-enum REQUEST_ID {
-  REQUEST_AIRCRAFT_POSITION,
-  REQUEST_AUTOPILOT_HEADING,
-};
-
-/* Structure Definition ID's */
-enum DATA_DEFINE_ID {
-  DEFINITION_AIRCRAFT_POSITION,
-  DEFINITION_AUTOPILOT_SELECTED_HEADING,
-  DEFINITION_AIRCRAFT_ROLL_CONTROL,
-};
-
-/* Start of Structure Definitions */
+/* Start of Structure Definitions: data definition and request IDs are
+allocated by SimData, see common/sim_data.h */
 
-/* Struct used to get position from simulator */
+/* Struct used to get position from simulator: received every frame, so
+single precision is used to halve the message size, except for the
+simulation time, which grows without bound */
 struct structAircraftPosition {
-  double bank_rad; // bank angle in radians
-  double heading; // true aircraft heading in radians
+  double sim_time_s; // simulation time in seconds, used to measure the time between frames
+  float bank_rad; // bank angle in radians
+  float heading; // true aircraft heading in radians
 };
 
+SIM_DATA_DEFINITION(structAircraftPosition,
+  SIM_DATA_FIELD(sim_time_s, "SIMULATION TIME", "Seconds"),
+  SIM_DATA_FIELD(bank_rad, "PLANE BANK DEGREES", "Radians"),
+  SIM_DATA_FIELD(heading, "PLANE HEADING DEGREES TRUE", "Radians"));
+
 /* Struct used to get the heading from the autopilot panel */
 struct structAutopilotSelectedHeading {
-  double heading; // set heading in degrees
+  float heading; // set heading in degrees
 };
 
+SIM_DATA_DEFINITION(structAutopilotSelectedHeading,
+  SIM_DATA_FIELD(heading, "AUTOPILOT HEADING LOCK DIR", "Degrees"));
+
 /* Struct used to send controls to the simulator */
 struct structAircraftRollControl {
   double aileronDeflect = 0;
 };
 
+SIM_DATA_DEFINITION(structAircraftRollControl,
+  SIM_DATA_FIELD(aileronDeflect, "AILERON POSITION", "Position"));
+
 #endif
 
 
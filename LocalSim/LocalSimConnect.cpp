@@ -0,0 +1,1181 @@
+/*
+  Local implementation of the subset of the SimConnect API used by the
+  examples, backed by AircraftModel. See inc/localsim/LocalSimConnect.h for a
+  description of its behaviour and configuration.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/flight_recording.h"
+#include "localsim/SimConnect.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const double PI = 3.14159265358979323846;
+
+/* The object ID reported for the user aircraft, AI aircraft follow it */
+const DWORD USER_OBJECT_ID = 1;
+
+/* Physical quantities a SimVar can be expressed in */
+enum Quantity {
+  QUANTITY_ANGLE,         /* base unit: radians */
+  QUANTITY_ANGULAR_RATE,  /* base unit: radians per second */
+  QUANTITY_RATIO,         /* base unit: position, in [-1, 1] */
+  QUANTITY_SPEED,         /* base unit: knots */
+  QUANTITY_LENGTH,        /* base unit: feet */
+  QUANTITY_TIME,          /* base unit: seconds */
+  QUANTITY_LOAD_FACTOR,   /* base unit: gforce */
+};
+
+/* Units accepted by SimConnect_AddToDataDefinition */
+struct Unit {
+  const char* name;
+  Quantity quantity;
+  double per_base;  /* value in this unit of one base unit */
+};
+
+const Unit UNITS[] = {
+  { "radians",            QUANTITY_ANGLE,        1 },
+  { "radian",             QUANTITY_ANGLE,        1 },
+  { "degrees",            QUANTITY_ANGLE,        180 / PI },
+  { "degree",             QUANTITY_ANGLE,        180 / PI },
+  { "radians per second", QUANTITY_ANGULAR_RATE, 1 },
+  { "degrees per second", QUANTITY_ANGULAR_RATE, 180 / PI },
+  { "position",           QUANTITY_RATIO,        1 },
+  { "gforce",             QUANTITY_LOAD_FACTOR,  1 },
+  { "knots",              QUANTITY_SPEED,        1 },
+  { "feet",               QUANTITY_LENGTH,       1 },
+  { "seconds",            QUANTITY_TIME,         1 },
+};
+
+struct Session;
+
+/* SimVars known to the local simulator, values are in base units */
+struct SimVar {
+  const char* name;
+  Quantity quantity;
+  double (*get)(const Session&, const AircraftModel&);
+  void (*set)(AircraftModel&, double);  /* null if the SimVar is read-only */
+};
+
+/* A single field of a data definition */
+struct Datum {
+  const SimVar* var;
+  double per_base;
+  SIMCONNECT_DATATYPE type;
+  DWORD size;
+  DWORD datum_id;   /* identifies the datum in tagged data */
+  float epsilon;    /* smallest change that counts, for SIMCONNECT_DATA_REQUEST_FLAG_CHANGED */
+};
+
+/* A periodic data request */
+struct Request {
+  DWORD request_id;
+  DWORD define_id;
+  DWORD object_id;       /* never SIMCONNECT_OBJECT_ID_USER, the user aircraft's actual ID */
+  DWORD flags;
+  DWORD period_frames;   /* frames per SIMCONNECT_PERIOD */
+  DWORD interval;        /* periods skipped between transmissions */
+  DWORD limit;           /* transmissions before the request ends, 0 if unlimited */
+  bool  once;
+  DWORD frames_to_next;
+  DWORD sent;
+  std::vector<uint8_t> last_payload;   /* the value of each datum when last sent */
+};
+
+/* An input event mapped to a client event */
+struct InputMapping {
+  DWORD group_id;
+  std::string definition;
+  DWORD event_id;
+};
+
+/* Message queue: messages are stored back to back, 8-byte aligned, along
+   with the time at which they were posted */
+class MessageQueue
+{
+public:
+  /* Reserves space for a message of the given size and returns it zeroed */
+  void* Append(DWORD size, Clock::time_point posted) {
+    size_t words = (size + 7) / 8;
+    offsets.push_back(storage.size());
+    sizes.push_back(size);
+    posted_at.push_back(posted);
+    storage.resize(storage.size() + words, 0);
+    return &storage[offsets.back()];
+  }
+
+  size_t Count() const {
+    return offsets.size();
+  }
+  SIMCONNECT_RECV* At(size_t i) {
+    return reinterpret_cast<SIMCONNECT_RECV*>(&storage[offsets[i]]);
+  }
+  DWORD SizeAt(size_t i) const {
+    return sizes[i];
+  }
+  Clock::time_point PostedAt(size_t i) const {
+    return posted_at[i];
+  }
+
+  void Clear() {
+    storage.clear();
+    offsets.clear();
+    sizes.clear();
+    posted_at.clear();
+  }
+
+  void Swap(MessageQueue& other) {
+    storage.swap(other.storage);
+    offsets.swap(other.offsets);
+    sizes.swap(other.sizes);
+    posted_at.swap(other.posted_at);
+  }
+
+private:
+  std::vector<uint64_t> storage;
+  std::vector<size_t> offsets;
+  std::vector<DWORD> sizes;
+  std::vector<Clock::time_point> posted_at;
+};
+
+/* State of one connection to the local simulator */
+struct Session {
+  Session(const LocalSimConfig& config, HANDLE event)
+    : config(config), aircraft(config.aircraft, config.initial_state), event(event) {
+    /* AI aircraft start at headings spread evenly around the compass */
+    for (size_t i = 0; i < config.ai_aircraft; i++) {
+      AircraftModel::State state = config.initial_state;
+      state.heading_rad = std::fmod(state.heading_rad + 2 * PI * (i + 1) / (config.ai_aircraft + 1), 2 * PI);
+      ai_aircraft.emplace_back(config.aircraft, state);
+    }
+  }
+
+  LocalSimConfig config;
+  AircraftModel aircraft;
+  std::vector<AircraftModel> ai_aircraft;   /* object IDs USER_OBJECT_ID + 1 onwards */
+  double sim_time = 0;
+
+  std::map<DWORD, std::vector<Datum>> definitions;
+  std::vector<Request> requests;
+
+  std::map<DWORD, DWORD> event_groups;       /* client event -> notification group */
+  std::map<DWORD, bool> input_group_state;   /* input group -> enabled */
+  std::vector<InputMapping> input_mappings;
+  double last_joystick_x = 0;
+  double last_joystick_y = 0;
+
+  bool open_sent = false;
+  bool quit_sent = false;
+
+  /* signalled whenever messages are waiting, may be null */
+  HANDLE event;
+
+  /* in real time mode frames are generated by this thread, and mutex guards
+     everything above as well as the pending queue */
+  std::thread frame_thread;
+  std::mutex mutex;
+  bool stopping = false;
+
+  MessageQueue pending;
+  MessageQueue delivering;
+  size_t next_delivery = 0;
+
+  /* when the data message currently being handled was posted, and whether
+     the client has responded to it yet */
+  Clock::time_point handling_posted;
+  bool awaiting_output = false;
+
+  /* recording being replayed, if any, with the positions of the next message
+     to deliver and the next output to compare */
+  std::unique_ptr<FlightRecording> replay;
+  FlightRecording::Cursor replay_message;
+  FlightRecording::Cursor replay_output;
+
+  LocalSimStats stats;
+  Clock::time_point opened = Clock::now();
+  std::clock_t cpu_opened = std::clock();
+};
+
+bool IsRealTime(const Session& s) {
+  return s.config.realtime_speed > 0;
+}
+
+/* Locks the session if it is shared with a frame thread */
+class SessionLock
+{
+public:
+  explicit SessionLock(Session& s)
+    : lock(s.mutex, std::defer_lock) {
+    if (IsRealTime(s)) {
+      lock.lock();
+    }
+  }
+private:
+  std::unique_lock<std::mutex> lock;
+};
+
+/* Returns the aircraft with the given object ID, or null if there is none */
+AircraftModel* FindObject(Session& s, DWORD object_id) {
+  if (object_id == SIMCONNECT_OBJECT_ID_USER || object_id == USER_OBJECT_ID) {
+    return &s.aircraft;
+  }
+  if (object_id > USER_OBJECT_ID && object_id - USER_OBJECT_ID <= s.ai_aircraft.size()) {
+    return &s.ai_aircraft[object_id - USER_OBJECT_ID - 1];
+  }
+  return nullptr;
+}
+
+/* Every aircraft is given the same selected heading, so that AI traffic
+   turns with the user aircraft */
+double AutopilotHeading(const Session& s, const AircraftModel&) {
+  return s.config.autopilot_heading_deg(s.sim_time) * PI / 180;
+}
+
+void SetAileron(AircraftModel& aircraft, double value) {
+  aircraft.SetAileron(value);
+}
+
+void SetElevator(AircraftModel& aircraft, double value) {
+  aircraft.SetElevator(value);
+}
+
+void SetRudder(AircraftModel& aircraft, double value) {
+  aircraft.SetRudder(value);
+}
+
+const SimVar SIMVARS[] = {
+  { "PLANE BANK DEGREES",         QUANTITY_ANGLE,
+    [](const Session&, const AircraftModel& a) { return a.BankRad(); }, nullptr },
+  /* the roll rate, as the examples read it: in FSX this is the pitch rate,
+     see aircraft_model.h */
+  { "ROTATION VELOCITY BODY X",   QUANTITY_ANGULAR_RATE,
+    [](const Session&, const AircraftModel& a) { return a.RollRateRad_s(); }, nullptr },
+  { "PLANE HEADING DEGREES TRUE", QUANTITY_ANGLE,
+    [](const Session&, const AircraftModel& a) { return a.HeadingRad(); }, nullptr },
+  { "AUTOPILOT HEADING LOCK DIR", QUANTITY_ANGLE, AutopilotHeading, nullptr },
+  { "AILERON POSITION",           QUANTITY_RATIO,
+    [](const Session&, const AircraftModel& a) { return a.Aileron(); }, SetAileron },
+  { "PLANE PITCH DEGREES",        QUANTITY_ANGLE,
+    [](const Session&, const AircraftModel& a) { return a.PitchRad(); }, nullptr },
+  { "ROTATION VELOCITY BODY Y",   QUANTITY_ANGULAR_RATE,
+    [](const Session&, const AircraftModel& a) { return a.YawRateRad_s(); }, nullptr },
+  { "ROTATION VELOCITY BODY Z",   QUANTITY_ANGULAR_RATE,
+    [](const Session&, const AircraftModel& a) { return a.RollRateRad_s(); }, nullptr },
+  { "G FORCE",                    QUANTITY_LOAD_FACTOR,
+    [](const Session&, const AircraftModel& a) { return a.LoadFactor(); }, nullptr },
+  { "ELEVATOR POSITION",          QUANTITY_RATIO,
+    [](const Session&, const AircraftModel& a) { return a.Elevator(); }, SetElevator },
+  { "RUDDER POSITION",            QUANTITY_RATIO,
+    [](const Session&, const AircraftModel& a) { return a.Rudder(); }, SetRudder },
+  { "AIRSPEED INDICATED",         QUANTITY_SPEED,
+    [](const Session&, const AircraftModel& a) { return a.GetParameters().indicated_airspeed_kts; }, nullptr },
+  { "PLANE ALTITUDE",             QUANTITY_LENGTH,
+    [](const Session&, const AircraftModel& a) { return a.GetParameters().altitude_ft; }, nullptr },
+  { "SIMULATION TIME",            QUANTITY_TIME,
+    [](const Session& s, const AircraftModel&) { return s.sim_time; }, nullptr },
+};
+
+/* Case-insensitive string comparison, as used by SimConnect for names */
+bool NamesEqual(const char* a, const char* b) {
+  for (; *a && *b; ++a, ++b) {
+    if (std::tolower(static_cast<unsigned char>(*a)) != std::tolower(static_cast<unsigned char>(*b))) {
+      return false;
+    }
+  }
+  return *a == *b;
+}
+
+std::string ToLower(const char* str) {
+  std::string res(str);
+  std::transform(res.begin(), res.end(), res.begin(),
+    [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return res;
+}
+
+DWORD DataTypeSize(SIMCONNECT_DATATYPE type) {
+  switch (type) {
+  case SIMCONNECT_DATATYPE_INT32:
+  case SIMCONNECT_DATATYPE_FLOAT32:
+    return 4;
+  case SIMCONNECT_DATATYPE_INT64:
+  case SIMCONNECT_DATATYPE_FLOAT64:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+DWORD DefinitionSize(const std::vector<Datum>& definition) {
+  DWORD size = 0;
+  for (const Datum& datum : definition) {
+    size += datum.size;
+  }
+  return size;
+}
+
+/* Offset of one of the datums of a definition in its data */
+size_t DatumOffset(const std::vector<Datum>& definition, const Datum* datum) {
+  size_t offset = 0;
+  for (const Datum* d = definition.data(); d != datum; ++d) {
+    offset += d->size;
+  }
+  return offset;
+}
+
+/* Encodes the current value of each datum of an aircraft into dest */
+void EncodeDefinition(const Session& s, const AircraftModel& aircraft, const std::vector<Datum>& definition,
+  uint8_t* dest) {
+  for (const Datum& datum : definition) {
+    double value = datum.var->get(s, aircraft) * datum.per_base;
+    switch (datum.type) {
+    case SIMCONNECT_DATATYPE_INT32: {
+      int32_t v = static_cast<int32_t>(value);
+      std::memcpy(dest, &v, sizeof(v));
+      break;
+    }
+    case SIMCONNECT_DATATYPE_INT64: {
+      int64_t v = static_cast<int64_t>(value);
+      std::memcpy(dest, &v, sizeof(v));
+      break;
+    }
+    case SIMCONNECT_DATATYPE_FLOAT32: {
+      float v = static_cast<float>(value);
+      std::memcpy(dest, &v, sizeof(v));
+      break;
+    }
+    default: {
+      std::memcpy(dest, &value, sizeof(value));
+      break;
+    }
+    }
+    dest += datum.size;
+  }
+}
+
+/* Decodes a single datum from src, returning the value in the datum's units */
+double DatumValue(const Datum& datum, const uint8_t* src) {
+  switch (datum.type) {
+  case SIMCONNECT_DATATYPE_INT32: {
+    int32_t v;
+    std::memcpy(&v, src, sizeof(v));
+    return v;
+  }
+  case SIMCONNECT_DATATYPE_INT64: {
+    int64_t v;
+    std::memcpy(&v, src, sizeof(v));
+    return static_cast<double>(v);
+  }
+  case SIMCONNECT_DATATYPE_FLOAT32: {
+    float v;
+    std::memcpy(&v, src, sizeof(v));
+    return v;
+  }
+  default: {
+    double v;
+    std::memcpy(&v, src, sizeof(v));
+    return v;
+  }
+  }
+}
+
+/* Decodes a single datum from src, returning the value in base units */
+double DecodeDatum(const Datum& datum, const uint8_t* src) {
+  return DatumValue(datum, src) / datum.per_base;
+}
+
+/* Whether a datum has changed by more than its epsilon since it was last
+   sent; a NaN always counts as a change */
+bool DatumChanged(const Datum& datum, const uint8_t* value, const uint8_t* last) {
+  if (std::memcmp(value, last, datum.size) == 0) {
+    return false;
+  }
+  return !(std::abs(DatumValue(datum, value) - DatumValue(datum, last)) <= datum.epsilon);
+}
+
+void FillHeader(SIMCONNECT_RECV* msg, DWORD size, SIMCONNECT_RECV_ID id) {
+  msg->dwSize = size;
+  msg->dwVersion = 4;
+  msg->dwID = id;
+}
+
+void QueueEvent(Session& s, DWORD event_id, DWORD data, Clock::time_point now) {
+  auto group = s.event_groups.find(event_id);
+  auto* evt = static_cast<SIMCONNECT_RECV_EVENT*>(s.pending.Append(sizeof(SIMCONNECT_RECV_EVENT), now));
+  FillHeader(evt, sizeof(*evt), SIMCONNECT_RECV_ID_EVENT);
+  evt->uGroupID = (group != s.event_groups.end()) ? group->second : SIMCONNECT_RECV_EVENT::UNKNOWN_GROUP;
+  evt->uEventID = event_id;
+  evt->dwData = data;
+}
+
+/* Sends a joystick axis position to the client events mapped to it */
+void QueueAxisEvents(Session& s, const char* definition, double position, Clock::time_point now) {
+  /* axis events carry a signed 16 bit position */
+  double raw = std::max(-32768.0, std::min(32767.0, std::round(position * 32768)));
+  DWORD data = static_cast<DWORD>(static_cast<int32_t>(raw));
+
+  for (const InputMapping& mapping : s.input_mappings) {
+    if (mapping.definition == definition && s.input_group_state[mapping.group_id]) {
+      QueueEvent(s, mapping.event_id, data, now);
+    }
+  }
+}
+
+/* Sends the joystick position to mapped client events when it changes */
+void QueueInputEvents(Session& s, Clock::time_point now) {
+  double joystick_x = s.config.joystick_x(s.sim_time);
+  if (joystick_x != s.last_joystick_x) {
+    s.last_joystick_x = joystick_x;
+    QueueAxisEvents(s, "joystick:0:xaxis", joystick_x, now);
+  }
+  double joystick_y = s.config.joystick_y(s.sim_time);
+  if (joystick_y != s.last_joystick_y) {
+    s.last_joystick_y = joystick_y;
+    QueueAxisEvents(s, "joystick:0:yaxis", joystick_y, now);
+  }
+}
+
+/* Returns a pseudo-random number in [0, 1) for the current frame, the same
+   in every run with the same seed. salt selects independent sequences. */
+double FrameNoise(const Session& s, uint64_t salt) {
+  uint64_t z = s.stats.frames * 2 + salt + 0x9E3779B97F4A7C15ull + s.config.seed * 0xD1B54A32D192ED03ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  z = z ^ (z >> 31);
+  return static_cast<double>(z >> 11) / 9007199254740992.0;
+}
+
+/* Adds bytes to the hash of the run */
+void HashRun(Session& s, const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t hash = s.stats.run_hash;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+  }
+  s.stats.run_hash = hash;
+}
+
+/* Sends data for every request due in this frame, unless the frame is
+   dropped, in which case the requests still count the frame */
+void QueueRequestedData(Session& s, Clock::time_point now, bool dropped) {
+  const DWORD HEADER_SIZE = sizeof(SIMCONNECT_RECV_SIMOBJECT_DATA) - sizeof(DWORD);
+  std::vector<uint8_t> payload;
+  std::vector<const Datum*> changed;
+
+  for (auto it = s.requests.begin(); it != s.requests.end();) {
+    Request& req = *it;
+    if (req.frames_to_next > 0) {
+      req.frames_to_next--;
+      ++it;
+      continue;
+    }
+    req.frames_to_next = (req.interval + 1) * req.period_frames - 1;
+    if (dropped) {
+      ++it;
+      continue;
+    }
+
+    const std::vector<Datum>& definition = s.definitions[req.define_id];
+    DWORD size = DefinitionSize(definition);
+    payload.resize(size);
+    EncodeDefinition(s, *FindObject(s, req.object_id), definition, payload.data());
+
+    /* with the changed flag only the data which changed by more than its
+       epsilon is sent, the whole definition unless the tagged flag is set
+       too; the first transmission sends everything */
+    bool only_changed = (req.flags & SIMCONNECT_DATA_REQUEST_FLAG_CHANGED) && !req.last_payload.empty();
+    bool tagged = (req.flags & SIMCONNECT_DATA_REQUEST_FLAG_TAGGED) != 0;
+    if (req.last_payload.empty()) {
+      req.last_payload.assign(size, 0);
+    }
+    changed.clear();
+    DWORD data_size = 0;
+    DWORD offset = 0;
+    for (const Datum& datum : definition) {
+      if (!only_changed || DatumChanged(datum, &payload[offset], &req.last_payload[offset])) {
+        changed.push_back(&datum);
+        data_size += tagged ? sizeof(DWORD) + datum.size : 0;
+      }
+      offset += datum.size;
+    }
+    data_size = tagged ? data_size : size;
+
+    if (!changed.empty()) {
+      auto* msg = static_cast<SIMCONNECT_RECV_SIMOBJECT_DATA*>(s.pending.Append(HEADER_SIZE + data_size, now));
+      FillHeader(msg, HEADER_SIZE + data_size, SIMCONNECT_RECV_ID_SIMOBJECT_DATA);
+      msg->dwRequestID = req.request_id;
+      msg->dwObjectID = req.object_id;
+      msg->dwDefineID = req.define_id;
+      msg->dwFlags = req.flags;
+      msg->dwentrynumber = 1;
+      msg->dwoutof = 1;
+      uint8_t* dest = reinterpret_cast<uint8_t*>(&msg->dwData);
+      if (tagged) {
+        /* each datum's ID followed by its value */
+        msg->dwDefineCount = static_cast<DWORD>(changed.size());
+        for (const Datum* datum : changed) {
+          DWORD datum_offset = static_cast<DWORD>(DatumOffset(definition, datum));
+          std::memcpy(dest, &datum->datum_id, sizeof(DWORD));
+          std::memcpy(dest + sizeof(DWORD), &payload[datum_offset], datum->size);
+          std::memcpy(&req.last_payload[datum_offset], &payload[datum_offset], datum->size);
+          dest += sizeof(DWORD) + datum->size;
+        }
+      }
+      else {
+        msg->dwDefineCount = static_cast<DWORD>(definition.size());
+        std::memcpy(dest, payload.data(), size);
+        req.last_payload.swap(payload);
+      }
+      req.sent++;
+    }
+
+    if (req.once || (req.limit != 0 && req.sent >= req.limit)) {
+      it = s.requests.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+}
+
+/* Advances the simulation by one frame and queues the resulting messages */
+void GenerateFrame(Session& s) {
+  if (s.quit_sent) {
+    return;
+  }
+  Clock::time_point now = Clock::now();
+
+  if (!s.open_sent) {
+    auto* open = static_cast<SIMCONNECT_RECV_OPEN*>(s.pending.Append(sizeof(SIMCONNECT_RECV_OPEN), now));
+    FillHeader(open, sizeof(*open), SIMCONNECT_RECV_ID_OPEN);
+    std::strcpy(open->szApplicationName, "SimConnect_Examples Local Simulator");
+    open->dwSimConnectVersionMajor = 10;
+    s.open_sent = true;
+  }
+  else {
+    double timestep = 1 / s.config.frame_rate_hz;
+    if (s.config.frame_jitter > 0) {
+      timestep *= 1 + s.config.frame_jitter * (2 * FrameNoise(s, 0) - 1);
+    }
+    s.aircraft.Step(timestep);
+    for (AircraftModel& aircraft : s.ai_aircraft) {
+      aircraft.Step(timestep);
+    }
+    s.sim_time += timestep;
+  }
+
+  if (s.sim_time >= s.config.duration_s) {
+    auto* quit = static_cast<SIMCONNECT_RECV_QUIT*>(s.pending.Append(sizeof(SIMCONNECT_RECV_QUIT), now));
+    FillHeader(quit, sizeof(*quit), SIMCONNECT_RECV_ID_QUIT);
+    s.quit_sent = true;
+    return;
+  }
+
+  QueueInputEvents(s, now);
+  bool dropped = (s.config.frame_drop_rate > 0 && FrameNoise(s, 1) < s.config.frame_drop_rate);
+  if (dropped) {
+    s.stats.dropped_frames++;
+  }
+  QueueRequestedData(s, now, dropped);
+
+  s.stats.frames++;
+}
+
+/* Generates frames in real time, scaled by the configured speed */
+void RunFrameThread(Session* s) {
+  const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+    std::chrono::duration<double>(1 / (s->config.frame_rate_hz * s->config.realtime_speed)));
+  Clock::time_point next_frame = Clock::now();
+
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      if (s->stopping || s->quit_sent) {
+        break;
+      }
+      GenerateFrame(*s);
+    }
+    if (s->event) {
+      SetEvent(s->event);
+    }
+    next_frame += period;
+    std::this_thread::sleep_until(next_frame);
+  }
+}
+
+/* Returns the next recorded message, delivered in place from the mapped
+   recording, or a quit message once the recording has been replayed */
+SIMCONNECT_RECV* NextReplayedMessage(Session& s, DWORD* size) {
+  SessionLock lock(s);
+  if (s.quit_sent) {
+    return nullptr;
+  }
+  Clock::time_point now = Clock::now();
+
+  FlightRecord record;
+  SIMCONNECT_RECV* msg;
+  if (s.replay->Next(s.replay_message, FLIGHT_RECORD_RECEIVED, &record)) {
+    msg = static_cast<SIMCONNECT_RECV*>(record.data);
+    *size = record.size;
+    s.stats.replayed_messages++;
+  }
+  else {
+    msg = static_cast<SIMCONNECT_RECV*>(s.delivering.Append(sizeof(SIMCONNECT_RECV_QUIT), now));
+    FillHeader(msg, sizeof(SIMCONNECT_RECV_QUIT), SIMCONNECT_RECV_ID_QUIT);
+    *size = sizeof(SIMCONNECT_RECV_QUIT);
+    s.next_delivery = 1;
+  }
+
+  if (msg->dwID == SIMCONNECT_RECV_ID_QUIT) {
+    s.quit_sent = true;
+  }
+  else if (msg->dwID == SIMCONNECT_RECV_ID_SIMOBJECT_DATA) {
+    s.handling_posted = now;
+    s.awaiting_output = true;
+  }
+  return msg;
+}
+
+/* Compares data set by the client with the next recorded output */
+void CompareReplayedOutput(Session& s, DWORD define_id, DWORD object_id, DWORD size, const void* data) {
+  s.stats.replayed_outputs++;
+
+  FlightRecord record;
+  if (!s.replay->Next(s.replay_output, FLIGHT_RECORD_OUTPUT, &record) ||
+      record.id != define_id || record.object_id != object_id || record.size != size) {
+    s.stats.output_mismatches++;
+    return;
+  }
+  if (std::memcmp(record.data, data, size) == 0) {
+    return;
+  }
+  s.stats.output_mismatches++;
+
+  /* outputs are normally doubles, report by how much they differ */
+  for (DWORD offset = 0; offset + sizeof(double) <= size && size % sizeof(double) == 0; offset += sizeof(double)) {
+    double recorded, actual;
+    std::memcpy(&recorded, static_cast<const uint8_t*>(record.data) + offset, sizeof(double));
+    std::memcpy(&actual, static_cast<const uint8_t*>(data) + offset, sizeof(double));
+    s.stats.max_output_difference = std::max(s.stats.max_output_difference, std::abs(actual - recorded));
+  }
+}
+
+/* Returns the next message to deliver. Outside of real time mode a frame is
+   generated whenever no messages are pending. */
+SIMCONNECT_RECV* NextMessage(Session& s, DWORD* size) {
+  if (s.next_delivery >= s.delivering.Count()) {
+    s.delivering.Clear();
+    s.next_delivery = 0;
+    if (s.replay) {
+      return NextReplayedMessage(s, size);
+    }
+    {
+      SessionLock lock(s);
+      if (s.pending.Count() == 0 && !IsRealTime(s)) {
+        GenerateFrame(s);
+      }
+      s.delivering.Swap(s.pending);
+    }
+    if (s.delivering.Count() == 0) {
+      return nullptr;
+    }
+  }
+  *size = s.delivering.SizeAt(s.next_delivery);
+  if (s.delivering.At(s.next_delivery)->dwID == SIMCONNECT_RECV_ID_SIMOBJECT_DATA) {
+    SessionLock lock(s);
+    s.handling_posted = s.delivering.PostedAt(s.next_delivery);
+    s.awaiting_output = true;
+  }
+  return s.delivering.At(s.next_delivery++);
+}
+
+/* Counts a message delivered to the client, and adds it to the hash of the
+   run; under the lock, as LocalSim_GetStats may be called from another
+   thread, but not held while the client handles the message */
+void CountDelivered(Session& s, const SIMCONNECT_RECV* msg, DWORD size) {
+  SessionLock lock(s);
+  s.stats.messages++;
+  HashRun(s, msg, size);
+  if (msg->dwID == SIMCONNECT_RECV_ID_SIMOBJECT_DATA) {
+    s.stats.data_messages++;
+    s.stats.data_bytes += size;
+  }
+}
+
+const SimVar* FindSimVar(const char* name) {
+  for (const SimVar& var : SIMVARS) {
+    if (NamesEqual(var.name, name)) {
+      return &var;
+    }
+  }
+  return nullptr;
+}
+
+const Unit* FindUnit(const char* name) {
+  for (const Unit& unit : UNITS) {
+    if (NamesEqual(unit.name, name)) {
+      return &unit;
+    }
+  }
+  return nullptr;
+}
+
+double EnvDouble(const char* name, double default_value) {
+  const char* value = std::getenv(name);
+  return (value && *value) ? std::strtod(value, nullptr) : default_value;
+}
+
+/* Default pilot: full right stick, neutral, then holds full left stick into
+   the bank angle protection */
+double SteppedStick(double t) {
+  double phase = std::fmod(t, 60);
+  if (phase < 5) return 0;
+  if (phase < 10) return 1;
+  if (phase < 20) return 0;
+  if (phase < 40) return -1;
+  return 0;
+}
+
+/* Default pilot in pitch: pulls up while SteppedStick holds a 33 degree
+   bank, and pushes back down to about the same attitude once it holds it
+   again, after the roll into the bank angle protection */
+double SteppedPitchStick(double t) {
+  double phase = std::fmod(t, 60);
+  if (phase < 12) return 0;
+  if (phase < 17) return 0.5;
+  if (phase < 50) return 0;
+  if (phase < 55) return -0.375;
+  return 0;
+}
+
+/* Default autopilot: steps the selected heading either side of east */
+double SteppedHeading(double t) {
+  double phase = std::fmod(t, 180);
+  if (phase < 10) return 90;
+  if (phase < 90) return 120;
+  return 60;
+}
+
+LocalSimConfig g_config;
+bool g_config_set = false;
+
+} // namespace
+
+LocalSimConfig LocalSim_ConfigFromEnvironment() {
+  LocalSimConfig config;
+  config.duration_s = EnvDouble("LOCALSIM_DURATION", config.duration_s);
+  config.frame_rate_hz = EnvDouble("LOCALSIM_FRAME_RATE", config.frame_rate_hz);
+  config.realtime_speed = EnvDouble("LOCALSIM_REALTIME", config.realtime_speed);
+  config.frame_jitter = EnvDouble("LOCALSIM_FRAME_JITTER", config.frame_jitter);
+  config.frame_drop_rate = EnvDouble("LOCALSIM_DROP_FRAMES", config.frame_drop_rate);
+  const char* seed = std::getenv("LOCALSIM_SEED");
+  config.seed = (seed && *seed) ? std::strtoull(seed, nullptr, 10) : config.seed;
+  config.ai_aircraft = static_cast<size_t>(EnvDouble("LOCALSIM_AI_AIRCRAFT", 0));
+  config.print_stats = (std::getenv("LOCALSIM_QUIET") == nullptr);
+  const char* replay = std::getenv("LOCALSIM_REPLAY");
+  config.replay_path = replay ? replay : "";
+  config.initial_state.heading_rad = PI / 2;
+
+  const char* stick = std::getenv("LOCALSIM_STICK");
+  std::string profile = stick ? ToLower(stick) : "steps";
+  if (profile == "none") {
+    config.joystick_x = [](double) { return 0.0; };
+  }
+  else if (profile == "sine") {
+    config.joystick_x = [](double t) { return 0.8 * std::sin(2 * PI * t / 20); };
+  }
+  else {
+    config.joystick_x = SteppedStick;
+  }
+
+  const char* pitch_stick = std::getenv("LOCALSIM_PITCH_STICK");
+  std::string pitch_profile = pitch_stick ? ToLower(pitch_stick) : "steps";
+  if (pitch_profile == "none") {
+    config.joystick_y = [](double) { return 0.0; };
+  }
+  else if (pitch_profile == "sine") {
+    config.joystick_y = [](double t) { return 0.3 * std::sin(2 * PI * t / 30); };
+  }
+  else {
+    config.joystick_y = SteppedPitchStick;
+  }
+  config.autopilot_heading_deg = SteppedHeading;
+  return config;
+}
+
+void LocalSim_SetConfig(const LocalSimConfig& config) {
+  g_config = config;
+  g_config_set = true;
+}
+
+LocalSimStats LocalSim_GetStats(HANDLE hSimConnect) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  SessionLock lock(s);
+  LocalSimStats stats = s.stats;
+  stats.sim_time_s = s.sim_time;
+  stats.wall_time_s = std::chrono::duration<double>(Clock::now() - s.opened).count();
+  stats.cpu_time_s = static_cast<double>(std::clock() - s.cpu_opened) / CLOCKS_PER_SEC;
+  return stats;
+}
+
+bool LocalSim_IsLockstep(HANDLE hSimConnect) {
+  return !IsRealTime(*static_cast<Session*>(hSimConnect));
+}
+
+const AircraftModel& LocalSim_GetAircraft(HANDLE hSimConnect) {
+  return static_cast<Session*>(hSimConnect)->aircraft;
+}
+
+SIMCONNECTAPI SimConnect_Open(HANDLE * phSimConnect, LPCSTR szName, HWND hWnd, DWORD UserEventWin32, HANDLE hEventHandle, DWORD ConfigIndex) {
+  LocalSimConfig config = g_config_set ? g_config : LocalSim_ConfigFromEnvironment();
+  if (!config.joystick_x) {
+    config.joystick_x = [](double) { return 0.0; };
+  }
+  if (!config.joystick_y) {
+    config.joystick_y = [](double) { return 0.0; };
+  }
+  if (!config.autopilot_heading_deg) {
+    double heading = config.initial_state.heading_rad * 180 / PI;
+    config.autopilot_heading_deg = [heading](double) { return heading; };
+  }
+  if (!(config.frame_rate_hz > 0)) {
+    return E_FAIL;
+  }
+  std::unique_ptr<FlightRecording> replay;
+  if (!config.replay_path.empty()) {
+    replay.reset(new FlightRecording());
+    if (!replay->Open(config.replay_path.c_str())) {
+      /* not E_FAIL, which the examples take to mean that the simulator is
+         not running yet and retry */
+      fprintf(stderr, "LocalSim: could not read recording %s\n", config.replay_path.c_str());
+      return E_INVALIDARG;
+    }
+    /* recorded messages are replayed as fast as the client handles them */
+    config.realtime_speed = 0;
+  }
+
+  Session* s = new Session(config, hEventHandle);
+  s->replay = std::move(replay);
+  if (IsRealTime(*s)) {
+    s->frame_thread = std::thread(RunFrameThread, s);
+  }
+  else if (s->event) {
+    /* frames are generated on demand, so one is always waiting */
+    SetEvent(s->event);
+  }
+  *phSimConnect = s;
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_Close(HANDLE hSimConnect) {
+  Session* s = static_cast<Session*>(hSimConnect);
+  if (s->frame_thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->stopping = true;
+    }
+    s->frame_thread.join();
+  }
+  if (s->config.print_stats) {
+    LocalSimStats stats = LocalSim_GetStats(hSimConnect);
+    if (s->replay) {
+      fprintf(stderr, "LocalSim: replayed %llu messages in %.3f s (%.0f messages/s), "
+        "%llu outputs compared, %llu differ (max difference %g)\n",
+        static_cast<unsigned long long>(stats.replayed_messages), stats.wall_time_s,
+        stats.replayed_messages / std::max(stats.wall_time_s, 1e-9),
+        static_cast<unsigned long long>(stats.replayed_outputs),
+        static_cast<unsigned long long>(stats.output_mismatches), stats.max_output_difference);
+    }
+    else {
+      fprintf(stderr, "LocalSim: %llu frames (%llu dropped), %.1f s simulated in %.3f s (%.0fx real time)\n",
+        static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.dropped_frames),
+        stats.sim_time_s, stats.wall_time_s, stats.sim_time_s / std::max(stats.wall_time_s, 1e-9));
+      if (!s->ai_aircraft.empty()) {
+        fprintf(stderr, "LocalSim: %zu AI aircraft simulated alongside the user aircraft\n", s->ai_aircraft.size());
+      }
+    }
+    /* a replay simulates no time and generates no frames, so only the sizes
+       of the messages and calls are meaningful */
+    if (s->replay) {
+      fprintf(stderr, "LocalSim: %llu data messages (%.1f bytes each), "
+        "%.1f ns per data message in dispatch handler, %llu SetDataOnSimObject calls (%.1f bytes each)\n",
+        static_cast<unsigned long long>(stats.data_messages),
+        static_cast<double>(stats.data_bytes) / std::max<uint64_t>(stats.data_messages, 1),
+        1e9 * stats.dispatch_time_s / std::max<uint64_t>(stats.data_messages, 1),
+        static_cast<unsigned long long>(stats.set_data_calls),
+        static_cast<double>(stats.set_data_bytes) / std::max<uint64_t>(stats.set_data_calls, 1));
+    }
+    else {
+      fprintf(stderr, "LocalSim: %llu data messages (%.1f per simulated second, %.1f bytes per frame), "
+        "%.1f ns per data message in dispatch handler, %llu SetDataOnSimObject calls (%.1f bytes per frame)\n",
+        static_cast<unsigned long long>(stats.data_messages),
+        stats.data_messages / std::max(stats.sim_time_s, 1e-9),
+        static_cast<double>(stats.data_bytes) / std::max<uint64_t>(stats.frames, 1),
+        1e9 * stats.dispatch_time_s / std::max<uint64_t>(stats.data_messages, 1),
+        static_cast<unsigned long long>(stats.set_data_calls),
+        static_cast<double>(stats.set_data_bytes) / std::max<uint64_t>(stats.frames, 1));
+    }
+    fprintf(stderr, "LocalSim: %.3f s CPU time (%.0f%% of one core)\n",
+      stats.cpu_time_s, 100 * stats.cpu_time_s / std::max(stats.wall_time_s, 1e-9));
+    if (s->replay) {
+      fprintf(stderr, "LocalSim: run hash %016llx (replay)\n", static_cast<unsigned long long>(stats.run_hash));
+    }
+    else {
+      fprintf(stderr, "LocalSim: run hash %016llx (%s, seed %llu)\n",
+        static_cast<unsigned long long>(stats.run_hash), IsRealTime(*s) ? "real time" : "lockstep",
+        static_cast<unsigned long long>(s->config.seed));
+    }
+    stats.output_latency.Print(stderr, "LocalSim: frame to SetDataOnSimObject latency");
+  }
+  delete s;
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_CallDispatch(HANDLE hSimConnect, DispatchProc pfcnDispatch, void * pContext) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  DWORD size;
+  while (SIMCONNECT_RECV* msg = NextMessage(s, &size)) {
+    CountDelivered(s, msg, size);
+    if (msg->dwID == SIMCONNECT_RECV_ID_SIMOBJECT_DATA) {
+      Clock::time_point start = Clock::now();
+      pfcnDispatch(msg, size, pContext);
+      SessionLock lock(s);
+      s.stats.dispatch_time_s += std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    else {
+      pfcnDispatch(msg, size, pContext);
+    }
+    if (s.next_delivery >= s.delivering.Count()) {
+      break;
+    }
+  }
+  if (s.event && !IsRealTime(s) && !s.quit_sent) {
+    SetEvent(s.event);
+  }
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_GetNextDispatch(HANDLE hSimConnect, SIMCONNECT_RECV ** ppData, DWORD * pcbData) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  SIMCONNECT_RECV* msg = NextMessage(s, pcbData);
+  if (!msg) {
+    return E_FAIL;
+  }
+  CountDelivered(s, msg, *pcbData);
+  *ppData = msg;
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_MapClientEventToSimEvent(HANDLE hSimConnect, SIMCONNECT_CLIENT_EVENT_ID EventID, const char * EventName) {
+  /* only private client events are supported */
+  return (EventName == nullptr || *EventName == '\0') ? S_OK : E_FAIL;
+}
+
+SIMCONNECTAPI SimConnect_AddClientEventToNotificationGroup(HANDLE hSimConnect, SIMCONNECT_NOTIFICATION_GROUP_ID GroupID, SIMCONNECT_CLIENT_EVENT_ID EventID, BOOL bMaskable) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  SessionLock lock(s);
+  s.event_groups[EventID] = GroupID;
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_SetNotificationGroupPriority(HANDLE hSimConnect, SIMCONNECT_NOTIFICATION_GROUP_ID GroupID, DWORD uPriority) {
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_MapInputEventToClientEvent(HANDLE hSimConnect, SIMCONNECT_INPUT_GROUP_ID GroupID, const char * szInputDefinition, SIMCONNECT_CLIENT_EVENT_ID DownEventID, DWORD DownValue, SIMCONNECT_CLIENT_EVENT_ID UpEventID, DWORD UpValue, BOOL bMaskable) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  SessionLock lock(s);
+  s.input_mappings.push_back({ GroupID, ToLower(szInputDefinition), DownEventID });
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_SetInputGroupState(HANDLE hSimConnect, SIMCONNECT_INPUT_GROUP_ID GroupID, DWORD dwState) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  SessionLock lock(s);
+  s.input_group_state[GroupID] = (dwState == SIMCONNECT_STATE_ON);
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_AddToDataDefinition(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID DefineID, const char * DatumName, const char * UnitsName, SIMCONNECT_DATATYPE DatumType, float fEpsilon, DWORD DatumID) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  SessionLock lock(s);
+  const SimVar* var = FindSimVar(DatumName);
+  const Unit* unit = FindUnit(UnitsName);
+  DWORD size = DataTypeSize(DatumType);
+  if (!var || !unit || var->quantity != unit->quantity || size == 0) {
+    return E_FAIL;
+  }
+  s.definitions[DefineID].push_back({ var, unit->per_base, DatumType, size, DatumID, fEpsilon });
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_ClearDataDefinition(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID DefineID) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  SessionLock lock(s);
+  s.definitions.erase(DefineID);
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_RequestDataOnSimObject(HANDLE hSimConnect, SIMCONNECT_DATA_REQUEST_ID RequestID, SIMCONNECT_DATA_DEFINITION_ID DefineID, SIMCONNECT_OBJECT_ID ObjectID, SIMCONNECT_PERIOD Period, SIMCONNECT_DATA_REQUEST_FLAG Flags, DWORD origin, DWORD interval, DWORD limit) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  SessionLock lock(s);
+  if (!FindObject(s, ObjectID) || s.definitions.count(DefineID) == 0) {
+    return E_FAIL;
+  }
+
+  /* a new request replaces any existing request with the same ID */
+  s.requests.erase(std::remove_if(s.requests.begin(), s.requests.end(),
+    [RequestID](const Request& req) { return req.request_id == RequestID; }), s.requests.end());
+  if (Period == SIMCONNECT_PERIOD_NEVER) {
+    return S_OK;
+  }
+
+  Request req;
+  req.request_id = RequestID;
+  req.define_id = DefineID;
+  req.object_id = (ObjectID == SIMCONNECT_OBJECT_ID_USER) ? USER_OBJECT_ID : ObjectID;
+  req.flags = Flags;
+  req.period_frames = (Period == SIMCONNECT_PERIOD_SECOND)
+    ? std::max<DWORD>(1, static_cast<DWORD>(std::lround(s.config.frame_rate_hz))) : 1;
+  req.interval = interval;
+  req.limit = limit;
+  req.once = (Period == SIMCONNECT_PERIOD_ONCE);
+  req.frames_to_next = origin * req.period_frames;
+  req.sent = 0;
+  s.requests.push_back(req);
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_RequestDataOnSimObjectType(HANDLE hSimConnect, SIMCONNECT_DATA_REQUEST_ID RequestID, SIMCONNECT_DATA_DEFINITION_ID DefineID, DWORD dwRadiusMeters, SIMCONNECT_SIMOBJECT_TYPE type) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  SessionLock lock(s);
+  auto it = s.definitions.find(DefineID);
+  if (it == s.definitions.end()) {
+    return E_FAIL;
+  }
+
+  /* aircraft have no position, so every AI aircraft is within any radius;
+     as in SimConnect, a radius of 0 returns the user aircraft only */
+  std::vector<DWORD> objects;
+  if (type == SIMCONNECT_SIMOBJECT_TYPE_USER || type == SIMCONNECT_SIMOBJECT_TYPE_ALL ||
+      type == SIMCONNECT_SIMOBJECT_TYPE_AIRCRAFT) {
+    objects.push_back(USER_OBJECT_ID);
+  }
+  if ((type == SIMCONNECT_SIMOBJECT_TYPE_ALL || type == SIMCONNECT_SIMOBJECT_TYPE_AIRCRAFT) && dwRadiusMeters > 0) {
+    for (size_t i = 0; i < s.ai_aircraft.size(); i++) {
+      objects.push_back(USER_OBJECT_ID + 1 + static_cast<DWORD>(i));
+    }
+  }
+
+  /* one message per object, sent straight away */
+  const DWORD HEADER_SIZE = sizeof(SIMCONNECT_RECV_SIMOBJECT_DATA_BYTYPE) - sizeof(DWORD);
+  const std::vector<Datum>& definition = it->second;
+  DWORD size = DefinitionSize(definition);
+  Clock::time_point now = Clock::now();
+  for (size_t i = 0; i < objects.size(); i++) {
+    auto* msg = static_cast<SIMCONNECT_RECV_SIMOBJECT_DATA_BYTYPE*>(s.pending.Append(HEADER_SIZE + size, now));
+    FillHeader(msg, HEADER_SIZE + size, SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE);
+    msg->dwRequestID = RequestID;
+    msg->dwObjectID = objects[i];
+    msg->dwDefineID = DefineID;
+    msg->dwFlags = 0;
+    msg->dwentrynumber = static_cast<DWORD>(i + 1);
+    msg->dwoutof = static_cast<DWORD>(objects.size());
+    msg->dwDefineCount = static_cast<DWORD>(definition.size());
+    EncodeDefinition(s, *FindObject(s, objects[i]), definition, reinterpret_cast<uint8_t*>(&msg->dwData));
+  }
+  if (s.event && !objects.empty()) {
+    SetEvent(s.event);
+  }
+  return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_SetDataOnSimObject(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID DefineID, SIMCONNECT_OBJECT_ID ObjectID, SIMCONNECT_DATA_SET_FLAG Flags, DWORD ArrayCount, DWORD cbUnitSize, void * pDataSet) {
+  Session& s = *static_cast<Session*>(hSimConnect);
+  Clock::time_point now = Clock::now();
+  SessionLock lock(s);
+  if (s.awaiting_output) {
+    /* first output in response to the frame being handled */
+    s.awaiting_output = false;
+    s.stats.output_latency.Record(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now - s.handling_posted).count());
+  }
+
+  if (s.replay) {
+    CompareReplayedOutput(s, DefineID, ObjectID, ArrayCount * cbUnitSize, pDataSet);
+  }
+  const DWORD call[] = { DefineID, ObjectID, Flags, ArrayCount * cbUnitSize };
+  HashRun(s, call, sizeof(call));
+  HashRun(s, pDataSet, ArrayCount * cbUnitSize);
+
+  auto it = s.definitions.find(DefineID);
+  AircraftModel* aircraft = FindObject(s, ObjectID);
+  if (it == s.definitions.end() || !aircraft) {
+    return E_FAIL;
+  }
+  const std::vector<Datum>& definition = it->second;
+  const uint8_t* src = static_cast<const uint8_t*>(pDataSet);
+  DWORD size = ArrayCount * cbUnitSize;
+
+  /* the data is either the whole definition, or in tagged format a sequence
+     of datum IDs each followed by that datum's value, as many as fit in
+     ArrayCount * cbUnitSize bytes; check it all before setting any of it */
+  std::vector<std::pair<const Datum*, const uint8_t*>> values;
+  if (Flags == SIMCONNECT_DATA_SET_FLAG_DEFAULT) {
+    if (ArrayCount != 1 || cbUnitSize != DefinitionSize(definition)) {
+      return E_FAIL;
+    }
+    for (const Datum& datum : definition) {
+      values.emplace_back(&datum, src);
+      src += datum.size;
+    }
+  }
+  else if (Flags == SIMCONNECT_DATA_SET_FLAG_TAGGED) {
+    DWORD offset = 0;
+    while (offset < size) {
+      DWORD datum_id;
+      if (size - offset < sizeof(datum_id)) {
+        return E_FAIL;
+      }
+      std::memcpy(&datum_id, src + offset, sizeof(datum_id));
+      offset += sizeof(datum_id);
+      auto datum = std::find_if(definition.begin(), definition.end(),
+        [datum_id](const Datum& d) { return d.datum_id == datum_id; });
+      if (datum == definition.end() || size - offset < datum->size) {
+        return E_FAIL;
+      }
+      values.emplace_back(&*datum, src + offset);
+      offset += datum->size;
+    }
+  }
+  else {
+    return E_FAIL;
+  }
+  for (const auto& value : values) {
+    if (!value.first->var->set) {
+      return E_FAIL;
+    }
+  }
+
+  s.stats.set_data_calls++;
+  s.stats.set_data_bytes += size;
+  for (const auto& value : values) {
+    value.first->var->set(*aircraft, DecodeDatum(*value.first, value.second));
+  }
+  return S_OK;
+}
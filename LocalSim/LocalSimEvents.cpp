@@ -0,0 +1,77 @@
+/*
+  Event objects for the local SimConnect implementation, following the
+  semantics of the Win32 functions of the same names.
+*/
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "localsim/win_compat.h"
+
+namespace {
+
+struct Event {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool manual_reset;
+  bool signalled;
+};
+
+} // namespace
+
+HANDLE CreateEvent(void* lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCSTR lpName) {
+  if (lpName != nullptr) {
+    return nullptr;
+  }
+  Event* evt = new Event;
+  evt->manual_reset = (bManualReset != FALSE);
+  evt->signalled = (bInitialState != FALSE);
+  return evt;
+}
+
+BOOL SetEvent(HANDLE hEvent) {
+  Event* evt = static_cast<Event*>(hEvent);
+  {
+    std::lock_guard<std::mutex> lock(evt->mutex);
+    evt->signalled = true;
+  }
+  if (evt->manual_reset) {
+    evt->cv.notify_all();
+  }
+  else {
+    evt->cv.notify_one();
+  }
+  return TRUE;
+}
+
+BOOL ResetEvent(HANDLE hEvent) {
+  Event* evt = static_cast<Event*>(hEvent);
+  std::lock_guard<std::mutex> lock(evt->mutex);
+  evt->signalled = false;
+  return TRUE;
+}
+
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds) {
+  Event* evt = static_cast<Event*>(hHandle);
+  if (!evt) {
+    return WAIT_FAILED;
+  }
+  std::unique_lock<std::mutex> lock(evt->mutex);
+  auto signalled = [evt] { return evt->signalled; };
+  if (dwMilliseconds == INFINITE) {
+    evt->cv.wait(lock, signalled);
+  }
+  else if (!evt->cv.wait_for(lock, std::chrono::milliseconds(dwMilliseconds), signalled)) {
+    return WAIT_TIMEOUT;
+  }
+  if (!evt->manual_reset) {
+    evt->signalled = false;
+  }
+  return WAIT_OBJECT_0;
+}
+
+BOOL CloseHandle(HANDLE hObject) {
+  delete static_cast<Event*>(hObject);
+  return TRUE;
+}
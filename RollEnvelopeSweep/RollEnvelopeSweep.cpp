@@ -0,0 +1,390 @@
+/*
+  Sweeps the roll control law of the roll FBW example across the flight
+  envelope, to check the bank angle protections without flying by hand.
+
+  Each case flies the control law and a clamped PID roll rate controller
+  against the aircraft model, from a given initial bank angle and roll rate,
+  with a joystick profile that is held for a time and then released. Cases
+  are either sampled randomly (Monte-Carlo) or taken from a fixed grid, and
+  are distributed across all cores. For every case the tool reports:
+  * the maximum bank angle reached
+  * the overshoot beyond the 67 degree limit (or the initial bank angle, if
+    that was already beyond it)
+  * the settling time: the time from the stick being released until the bank
+    angle stays within SETTLING_BAND_DEG of its final value
+
+  Usage: roll_envelope_sweep [options]
+    --cases N       number of random cases (default 100000)
+    --grid          sweep the fixed grid instead of random cases
+    --seed S        seed of the random cases (default 1)
+    --threads T     number of threads (default: all hardware threads)
+    --duration S    simulated seconds per case (default 60)
+    --csv FILE      write the parameters and results of every case to FILE
+    --plant METHOD  discretisation of the aircraft's roll mode: euler (as the local
+                    simulator, default), trapezoidal, rk4 or exact
+    --envelope FILE write the roll rates commanded by the protection envelope
+                    to FILE instead of sweeping, for doc/AllowedRollRatesvsBank.gp
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "common/PIDController.h"
+#include "common/aircraft_model.h"
+#include "common/parallel_for.h"
+#include "common/util.h"
+#include "fbw/roll_control_law.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/* Simulated frame rate, as the example runs at */
+const double FRAME_RATE_HZ = 30;
+
+/* A case has settled once the bank angle stays this close to its final value */
+const double SETTLING_BAND_DEG = 1;
+
+/* ... and the final roll rate is below this */
+const double SETTLED_ROLL_RATE_DEG_S = 0.1;
+
+/* Number of cases claimed by a thread at a time */
+const size_t CASES_PER_CHUNK = 256;
+
+/* Joystick inputs applied until the stick is released */
+enum StickProfile {
+  STICK_NONE,       /* hands off throughout */
+  STICK_HOLD,       /* constant deflection */
+  STICK_REVERSAL,   /* constant deflection, reversed half way through */
+  STICK_SINE,       /* sinusoidal deflection with a 10s period */
+  NUM_STICK_PROFILES,
+};
+
+const char* const STICK_PROFILE_NAMES[NUM_STICK_PROFILES] = { "none", "hold", "reversal", "sine" };
+
+/* Parameters of a single case */
+struct SweepCase {
+  double initial_bank_deg;          /* positive left */
+  double initial_roll_rate_deg_s;   /* positive rolling right */
+  StickProfile profile;
+  double stick;                     /* peak joystick deflection in [-1, 1] */
+  double hold_s;                    /* time before the stick is released */
+  double p, i, d;                   /* roll rate controller gains */
+};
+
+/* Results of a single case */
+struct SweepResult {
+  double max_bank_deg;
+  double overshoot_deg;
+  double settling_time_s;   /* negative if not settled by the end of the case */
+};
+
+/* Returns the joystick position at time t, quantised as the example receives it */
+double Joystick(const SweepCase& c, double t) {
+  if (t >= c.hold_s) {
+    return 0;
+  }
+  double x = 0;
+  switch (c.profile) {
+  case STICK_HOLD:
+    x = c.stick;
+    break;
+  case STICK_REVERSAL:
+    x = (t < c.hold_s / 2) ? c.stick : -c.stick;
+    break;
+  case STICK_SINE:
+    x = c.stick * std::sin(2 * 3.14159265358979323846 * t / 10);
+    break;
+  default:
+    break;
+  }
+  return std::max(-32768.0, std::min(32767.0, std::round(x * 32768))) / 32768;
+}
+
+const char* const DISCRETISATION_NAMES[] = { "euler", "trapezoidal", "rk4", "exact" };
+
+/* Flies a case, bank is scratch space for the bank angle history */
+SweepResult FlyCase(const SweepCase& c, double duration_s, Discretisation plant, std::vector<double>& bank) {
+  AircraftModel::State initial;
+  initial.bank_rad = radians(c.initial_bank_deg);
+  initial.roll_rate_rad_s = radians(c.initial_roll_rate_deg_s);
+  AircraftModel::Parameters params;
+  params.roll_discretisation = plant;
+  AircraftModel aircraft(params, initial);
+
+  ClampedPID aileron_command(c.p, c.d, c.i, -1, 1);
+
+  const double timestep = 1 / FRAME_RATE_HZ;
+  size_t frames = static_cast<size_t>(duration_s * FRAME_RATE_HZ);
+  bank.resize(frames);
+
+  /* same order as the example: the controller sees the state at the start of
+     the frame, and its output is applied over the frame */
+  double max_bank = std::abs(aircraft.BankRad());
+  for (size_t frame = 0; frame < frames; frame++) {
+    double t = frame * timestep;
+    double desired_roll_rate = CalculateDesiredRollRate(Joystick(c, t), aircraft.BankRad());
+    aircraft.SetAileron(aileron_command.Update(desired_roll_rate - aircraft.RollRateRad_s(), timestep));
+    aircraft.Step(timestep);
+
+    bank[frame] = aircraft.BankRad();
+    max_bank = std::max(max_bank, std::abs(bank[frame]));
+  }
+
+  SweepResult result;
+  result.max_bank_deg = degrees(max_bank);
+  result.overshoot_deg = std::max(0.0,
+    result.max_bank_deg - std::max(degrees(MAX_BANK_ANGLE), std::abs(c.initial_bank_deg)));
+
+  /* settling time, from the last frame outside the band around the final value */
+  double release_s = (c.profile == STICK_NONE) ? 0 : std::min(c.hold_s, duration_s);
+  result.settling_time_s = -1;
+  if (frames > 0 && std::abs(degrees(aircraft.RollRateRad_s())) < SETTLED_ROLL_RATE_DEG_S) {
+    double final_bank = bank[frames - 1];
+    size_t last_outside = frames;
+    for (size_t frame = frames; frame-- > 0;) {
+      if (std::abs(degrees(bank[frame] - final_bank)) > SETTLING_BAND_DEG) {
+        last_outside = frame;
+        break;
+      }
+    }
+    double settled_at = (last_outside == frames) ? 0 : (last_outside + 1) * timestep;
+    result.settling_time_s = std::max(0.0, settled_at - release_s);
+  }
+  return result;
+}
+
+/* Uniformly distributed random numbers, hashed from the case number so that
+   every case can be generated independently (SplitMix64) */
+class CaseRandom
+{
+public:
+  CaseRandom(uint64_t seed, uint64_t index)
+    : state(seed * 0x9E3779B97F4A7C15ull + index) {}
+
+  /* Returns a value in [low, high) */
+  double Uniform(double low, double high) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return low + (high - low) * ((z >> 11) * (1.0 / 9007199254740992.0));
+  }
+
+private:
+  uint64_t state;
+};
+
+/* Returns random case number index */
+SweepCase RandomCase(uint64_t seed, size_t index) {
+  CaseRandom random(seed, index);
+  SweepCase c;
+  c.initial_bank_deg = random.Uniform(-80, 80);
+  c.initial_roll_rate_deg_s = random.Uniform(-20, 20);
+  c.profile = static_cast<StickProfile>(static_cast<int>(random.Uniform(0, NUM_STICK_PROFILES)));
+  c.stick = random.Uniform(-1, 1);
+  c.hold_s = random.Uniform(0, 20);
+  c.p = random.Uniform(2, 20);
+  c.i = random.Uniform(0, 2);
+  c.d = random.Uniform(0, 0.2);
+  return c;
+}
+
+/* Values swept by the grid */
+const double GRID_BANK_DEG[] = { -80, -70, -60, -50, -40, -30, -20, -10, 0, 10, 20, 30, 40, 50, 60, 70, 80 };
+const double GRID_ROLL_RATE_DEG_S[] = { -20, -10, 0, 10, 20 };
+const double GRID_STICK[] = { -1, -0.5, 0.5, 1 };
+const double GRID_HOLD_S[] = { 5, 15 };
+const double GRID_P[] = { 5, 10, 20 };
+const double GRID_I[] = { 0, 1 };
+
+template <typename T, size_t N>
+constexpr size_t CountOf(const T (&)[N]) {
+  return N;
+}
+
+const size_t GRID_CASES = CountOf(GRID_BANK_DEG) * CountOf(GRID_ROLL_RATE_DEG_S) * NUM_STICK_PROFILES *
+  CountOf(GRID_STICK) * CountOf(GRID_HOLD_S) * CountOf(GRID_P) * CountOf(GRID_I);
+
+/* Returns grid case number index, decoding the index one parameter at a time */
+SweepCase GridCase(size_t index) {
+  SweepCase c;
+  c.initial_bank_deg = GRID_BANK_DEG[index % CountOf(GRID_BANK_DEG)];
+  index /= CountOf(GRID_BANK_DEG);
+  c.initial_roll_rate_deg_s = GRID_ROLL_RATE_DEG_S[index % CountOf(GRID_ROLL_RATE_DEG_S)];
+  index /= CountOf(GRID_ROLL_RATE_DEG_S);
+  c.profile = static_cast<StickProfile>(index % NUM_STICK_PROFILES);
+  index /= NUM_STICK_PROFILES;
+  c.stick = GRID_STICK[index % CountOf(GRID_STICK)];
+  index /= CountOf(GRID_STICK);
+  c.hold_s = GRID_HOLD_S[index % CountOf(GRID_HOLD_S)];
+  index /= CountOf(GRID_HOLD_S);
+  c.p = GRID_P[index % CountOf(GRID_P)];
+  index /= CountOf(GRID_P);
+  c.i = GRID_I[index % CountOf(GRID_I)];
+  c.d = 0;
+  return c;
+}
+
+/* Returns the given percentile of sorted values */
+double Percentile(const std::vector<double>& sorted, double percentile) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t rank = static_cast<size_t>(percentile / 100 * (sorted.size() - 1) + 0.5);
+  return sorted[rank];
+}
+
+void Usage(const char* program) {
+  fprintf(stderr, "Usage: %s [--cases N] [--grid] [--seed S] [--threads T] [--duration S] [--csv FILE] [--plant METHOD] [--envelope FILE]\n", program);
+  exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+  size_t cases = 100000;
+  bool grid = false;
+  uint64_t seed = 1;
+  unsigned threads = HardwareThreads();
+  double duration_s = 60;
+  const char* csv_path = nullptr;
+  Discretisation plant = DISCRETISE_EULER;
+  const char* envelope_path = nullptr;
+
+  for (int arg = 1; arg < argc; arg++) {
+    bool has_value = (arg + 1 < argc);
+    if (strcmp(argv[arg], "--grid") == 0) {
+      grid = true;
+    }
+    else if (strcmp(argv[arg], "--cases") == 0 && has_value) {
+      cases = strtoull(argv[++arg], nullptr, 10);
+    }
+    else if (strcmp(argv[arg], "--seed") == 0 && has_value) {
+      seed = strtoull(argv[++arg], nullptr, 10);
+    }
+    else if (strcmp(argv[arg], "--threads") == 0 && has_value) {
+      threads = static_cast<unsigned>(strtoul(argv[++arg], nullptr, 10));
+    }
+    else if (strcmp(argv[arg], "--duration") == 0 && has_value) {
+      duration_s = strtod(argv[++arg], nullptr);
+    }
+    else if (strcmp(argv[arg], "--csv") == 0 && has_value) {
+      csv_path = argv[++arg];
+    }
+    else if (strcmp(argv[arg], "--envelope") == 0 && has_value) {
+      envelope_path = argv[++arg];
+    }
+    else if (strcmp(argv[arg], "--plant") == 0 && has_value) {
+      const char* name = argv[++arg];
+      size_t method = 0;
+      while (method < CountOf(DISCRETISATION_NAMES) && strcmp(name, DISCRETISATION_NAMES[method]) != 0) {
+        method++;
+      }
+      if (method == CountOf(DISCRETISATION_NAMES)) {
+        Usage(argv[0]);
+      }
+      plant = static_cast<Discretisation>(method);
+    }
+    else {
+      Usage(argv[0]);
+    }
+  }
+  if (envelope_path) {
+    FILE* out = fopen(envelope_path, "w");
+    if (!out) {
+      fprintf(stderr, "Error, could not open %s\n", envelope_path);
+      return 1;
+    }
+    RollProtectionEnvelope().WriteTable(out);
+    fclose(out);
+    return 0;
+  }
+  if (grid) {
+    cases = GRID_CASES;
+  }
+  if (threads == 0) {
+    threads = HardwareThreads();
+  }
+
+  auto make_case = [&](size_t index) {
+    return grid ? GridCase(index) : RandomCase(seed, index);
+  };
+
+  /* fly every case, each thread keeping its own bank angle history */
+  std::vector<SweepResult> results(cases);
+  std::vector<std::vector<double>> scratch(threads);
+
+  Clock::time_point start = Clock::now();
+  ParallelFor(cases, CASES_PER_CHUNK, [&](size_t begin, size_t end, unsigned thread) {
+    for (size_t k = begin; k < end; k++) {
+      results[k] = FlyCase(make_case(k), duration_s, plant, scratch[thread]);
+    }
+  }, threads);
+  double elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+  /* summary */
+  size_t worst_bank = 0, worst_overshoot = 0, overshooting = 0;
+  std::vector<double> settling_times;
+  for (size_t k = 0; k < cases; k++) {
+    const SweepResult& r = results[k];
+    if (r.max_bank_deg > results[worst_bank].max_bank_deg) {
+      worst_bank = k;
+    }
+    if (r.overshoot_deg > results[worst_overshoot].overshoot_deg) {
+      worst_overshoot = k;
+    }
+    if (r.overshoot_deg > 0) {
+      overshooting++;
+    }
+    if (r.settling_time_s >= 0) {
+      settling_times.push_back(r.settling_time_s);
+    }
+  }
+  std::sort(settling_times.begin(), settling_times.end());
+
+  double frames = static_cast<double>(cases) * static_cast<size_t>(duration_s * FRAME_RATE_HZ);
+  printf("%zu %s cases of %.0fs, %s plant, on %u threads in %.2fs (%.0f cases/s, %.1f M frames/s)\n",
+    cases, grid ? "grid" : "random", duration_s, DISCRETISATION_NAMES[plant], threads, elapsed_s,
+    cases / elapsed_s, frames / elapsed_s / 1e6);
+
+  if (cases > 0) {
+    auto print_case = [&](const char* name, double value_deg, size_t k) {
+      SweepCase c = make_case(k);
+      printf("%s: %.2f deg (case %zu: bank %.1f deg, roll rate %.1f deg/s, stick %s %.2f for %.1fs, PID %.2f %.2f %.3f)\n",
+        name, value_deg, k,
+        c.initial_bank_deg, c.initial_roll_rate_deg_s, STICK_PROFILE_NAMES[c.profile],
+        c.stick, c.hold_s, c.p, c.i, c.d);
+    };
+    print_case("max bank", results[worst_bank].max_bank_deg, worst_bank);
+    print_case("max overshoot", results[worst_overshoot].overshoot_deg, worst_overshoot);
+  }
+  printf("overshooting cases: %zu (%.2f%%)\n", overshooting, cases ? 100.0 * overshooting / cases : 0);
+  printf("settled cases: %zu (%.2f%%), settling time p50=%.2fs p90=%.2fs p99=%.2fs max=%.2fs\n",
+    settling_times.size(), cases ? 100.0 * settling_times.size() / cases : 0,
+    Percentile(settling_times, 50), Percentile(settling_times, 90),
+    Percentile(settling_times, 99), settling_times.empty() ? 0 : settling_times.back());
+
+  if (csv_path) {
+    FILE* csv = fopen(csv_path, "w");
+    if (!csv) {
+      fprintf(stderr, "Error, could not open %s\n", csv_path);
+      return 1;
+    }
+    fprintf(csv, "case,initial_bank_deg,initial_roll_rate_deg_s,profile,stick,hold_s,p,i,d,"
+      "max_bank_deg,overshoot_deg,settling_time_s\n");
+    for (size_t k = 0; k < cases; k++) {
+      SweepCase c = make_case(k);
+      const SweepResult& r = results[k];
+      fprintf(csv, "%zu,%.3f,%.3f,%s,%.4f,%.3f,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f\n",
+        k, c.initial_bank_deg, c.initial_roll_rate_deg_s, STICK_PROFILE_NAMES[c.profile],
+        c.stick, c.hold_s, c.p, c.i, c.d, r.max_bank_deg, r.overshoot_deg, r.settling_time_s);
+    }
+    fclose(csv);
+  }
+
+  return 0;
+}
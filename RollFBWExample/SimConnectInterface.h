@@ -5,8 +5,10 @@
    exchange data with FS through the SimConnect interface.
 */
 
-/* FSX Simulation phyiscs frames rate per second: this is actually variable
-   but we don't currently make use of it.
+#include "common/sim_data.h"
+
+/* Nominal FSX simulation physics frames per second: the actual rate varies,
+   so the time between frames is measured (see common/frame_clock.h).
 */
 const double SIM_UPDATE_RATE = 30;
 
@@ -17,36 +19,52 @@ enum GROUP_ID {
 
 enum INPUT_ID {
   INPUT_XAXIS,
+  INPUT_YAXIS,
 };
 
 enum EVENT_ID {
   EVENT_SIM_START,
   EVENT_XAXIS,
+  EVENT_YAXIS,
 };
 
-enum REQUEST_ID {
-  REQUEST_AIRCRAFT_POSITION,
-};
+/* Start of Structure Definitions: data definition and request IDs are
+   allocated by SimData, see common/sim_data.h */
 
-/* Structure Definition ID's */
-enum DATA_DEFINE_ID {
-  DEFINITION_AIRCRAFT_POSITION,
-  DEFINITION_AIRCRAFT_ROLL_CONTROL,
+/* Struct used to get the state of all three axes from the simulator, in one
+   request: received every frame, so single precision is used to halve the
+   message size, except for the simulation time, which grows without bound,
+   and the load factor, which keeps the fields packed without padding */
+struct structAircraftState {
+  double sim_time_s; // simulation time in seconds, used to measure the time between frames
+  float bank_rad; // bank angle in radians
+  float rotation_vel_x_rad_s; // roll rate in radians/second, as served by the local simulator (see common/aircraft_model.h)
+  float pitch_rad; // pitch angle in radians, positive nose down
+  float rotation_vel_y_rad_s; // yaw rate in radians/second, about the body's vertical axis
+  double load_factor; // normal load factor in g
 };
 
-/* Start of Structure Definitions */
+SIM_DATA_DEFINITION(structAircraftState,
+  SIM_DATA_FIELD(sim_time_s, "SIMULATION TIME", "Seconds"),
+  SIM_DATA_FIELD(bank_rad, "PLANE BANK DEGREES", "Radians"),
+  SIM_DATA_FIELD(rotation_vel_x_rad_s, "ROTATION VELOCITY BODY X", "Radians per second"),
+  SIM_DATA_FIELD(pitch_rad, "PLANE PITCH DEGREES", "Radians"),
+  SIM_DATA_FIELD(rotation_vel_y_rad_s, "ROTATION VELOCITY BODY Y", "Radians per second"),
+  SIM_DATA_FIELD(load_factor, "G FORCE", "GForce"));
 
-/* Struct used to get position from simulator */
-struct structAircraftPosition {
-  double bank_rad; // bank angle in radians
-  double rotation_vel_x_rad_s; // roll rate in radians/second
-};
-
-/* Struct used to send controls to the simulator */
-struct structAircraftRollControl {
+/* Struct used to send the controls of all three axes to the simulator, in
+   one call */
+struct structAircraftControls {
   double aileronDeflect = 0;
+  double elevatorDeflect = 0;
+  double rudderDeflect = 0;
 };
 
+SIM_DATA_DEFINITION(structAircraftControls,
+  SIM_DATA_FIELD(aileronDeflect, "AILERON POSITION", "Position"),
+  SIM_DATA_FIELD(elevatorDeflect, "ELEVATOR POSITION", "Position"),
+  SIM_DATA_FIELD(rudderDeflect, "RUDDER POSITION", "Position"));
+
 #endif
 
 
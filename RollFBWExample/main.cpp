@@ -6,172 +6,325 @@
   This project simulates:
   * Horizontal side-stick corresponds directly to roll angle
   * Bank angle protection mechanisms
+  * Fore-aft side-stick commands a load factor, with the flight path held
+    hands off, and load factor and pitch attitude protection
+  * A yaw damper
+
+  The three axes share one data request, for the state of the aircraft, and
+  one SetDataOnSimObject call a frame, for the aileron, elevator and rudder
+  (see common/output_stage.h).
+
+  The gains and clamping limits of the controllers and the angles and
+  limits of the protections can be changed while the client runs, by
+  editing the file named by CONTROLLER_CONFIG (see fbw_control.cfg and
+  common/controller_config.h).
+
+  The time each stage of the control path takes, and the frames missed, are
+  counted by common/instrumentation.h, printed on exit and dumped every 10
+  seconds to the file named by INSTRUMENTATION, if set. The control laws of
+  all three axes together have a budget of a small share of the frame
+  period, and the frames in which they take longer are counted.
 
   See http://www.airbusdriver.net/airbus_fltlaws.htm for overview of Airbus
   control laws.
 */
 
+#ifdef _WIN32
 #include <windows.h> 
 #include <tchar.h> 
 #include <stdio.h> 
 #include <strsafe.h> 
 
 #include "external/SimConnect.h" 
+#else
+#include <stdio.h>
+
+#include "localsim/SimConnect.h"
+#endif
 
 #include "common/PIDController.h"
+#include "common/connection.h"
+#include "common/controller_config.h"
+#include "common/flight_recording.h"
+#include "common/frame_clock.h"
+#include "common/instrumentation.h"
+#include "common/output_stage.h"
+#include "common/siso_chain.h"
 #include "common/util.h"
+#include "fbw/pitch_control_law.h"
+#include "fbw/roll_control_law.h"
+#include "fbw/yaw_damper.h"
 
 #include "SimConnectInterface.h"
 
 int     quit = 0;
 HANDLE  hSimConnect = NULL;
+HANDLE  hDispatchEvent = NULL;
+
+/* Records the flight if FLIGHT_RECORDING names a file, see flight_recording.h */
+FlightRecorder recorder;
 
 /* Struct to hold the current status of all pilot inputs */
 static struct PilotInputs {
   /* joystick axis readings are normalised into the range [-1, 1] */
   double joystickX = 0; /* last known value of joystick's x-axis */
+  double joystickY = 0; /* last known value of joystick's y-axis, positive pulled back */
 } pilotInputs;
 
 /* Actual aircraft status */
-structAircraftPosition aircraft_status;
+structAircraftState aircraft_status;
+
+/* The outputs of all three axes, sent in one call a frame, see output_stage.h */
+OutputStage<structAircraftControls> outputs;
+
+/* The joystick events are not masked, so FSX's own stick handling moves the
+   surfaces as well: they are resent every frame to override it, changed or
+   not */
+const uint64_t OUTPUT_REFRESH_FRAMES = 1;
+
+/* Measures the time between state updates */
+FrameClock frame_clock(1 / SIM_UPDATE_RATE);
+
+/* Times the stages of the control path, see instrumentation.h */
+Instrumentation instrumentation;
+const size_t STAGE_FRAME = instrumentation.AddStage("Frame");
+const size_t STAGE_ROLL_RATE = instrumentation.AddStage("CalculateDesiredRollRate");
+const size_t STAGE_AILERON_PID = instrumentation.AddStage("Aileron PID");
+const size_t STAGE_PITCH = instrumentation.AddStage("Pitch law");
+const size_t STAGE_YAW = instrumentation.AddStage("Yaw damper");
+const size_t STAGE_LAWS = instrumentation.AddStage("Control laws");
+const size_t STAGE_WRITE = instrumentation.AddStage("SetDataOnSimObject");
+
+/* Share of the frame period the control laws of all three axes may take */
+const double CONTROL_LAW_BUDGET = 0.05;
+
+/* The parameters of the control laws, which may be reloaded from a config file */
+struct FBWParameters {
+  RollProtectionEnvelope envelope;
+
+  /* aileron deflection per rad/s of roll rate error, clamped to the aileron range */
+  double aileron_p = 10;
+  double aileron_d = 0;
+  double aileron_i = 0;
+  double aileron_min = -1;
+  double aileron_max = 1;
+
+  PitchProtectionEnvelope pitch_envelope;
+
+  /* elevator deflection per g of load factor error, clamped to the elevator range */
+  double elevator_p = 0.3;
+  double elevator_i = 1;
+  double elevator_min = -1;
+  double elevator_max = 1;
+
+  double yaw_damper_gain = YAW_DAMPER_GAIN;
+  double yaw_damper_authority = YAW_DAMPER_AUTHORITY;
+};
+
+/* Reads an angle, or angular rate, given in degrees into radians */
+static void GetRadians(const ControllerConfig& config, const char* name, double& rad) {
+  double deg;
+  if (config.Get(name, deg)) {
+    rad = radians(deg);
+  }
+}
+
+bool ParseFBWParameters(const ControllerConfig& config, FBWParameters& params) {
+  RollProtectionEnvelope& envelope = params.envelope;
+  config.Get("roll_rate_per_deflection_rad_s", envelope.rate_per_deflection);
+  GetRadians(config, "restoring_roll_rate_deg_s", envelope.restoring_rate);
+  GetRadians(config, "nominal_bank_deg", envelope.nominal_bank);
+  GetRadians(config, "clamping_bank_deg", envelope.clamping_bank);
+  GetRadians(config, "max_bank_deg", envelope.max_bank);
+  config.Get("aileron_p", params.aileron_p);
+  config.Get("aileron_d", params.aileron_d);
+  config.Get("aileron_i", params.aileron_i);
+  config.Get("aileron_min", params.aileron_min);
+  config.Get("aileron_max", params.aileron_max);
+
+  PitchProtectionEnvelope& pitch_envelope = params.pitch_envelope;
+  config.Get("max_load_factor", pitch_envelope.max_load_factor);
+  config.Get("min_load_factor", pitch_envelope.min_load_factor);
+  GetRadians(config, "max_pitch_up_deg", pitch_envelope.max_pitch_up);
+  GetRadians(config, "max_pitch_down_deg", pitch_envelope.max_pitch_down);
+  GetRadians(config, "pitch_clamping_margin_deg", pitch_envelope.clamping_margin);
+  config.Get("restoring_load_factor", pitch_envelope.restoring_load_factor);
+  GetRadians(config, "pitch_compensation_bank_deg", pitch_envelope.compensation_bank);
+  config.Get("elevator_p", params.elevator_p);
+  config.Get("elevator_i", params.elevator_i);
+  config.Get("elevator_min", params.elevator_min);
+  config.Get("elevator_max", params.elevator_max);
+
+  config.Get("yaw_damper_gain", params.yaw_damper_gain);
+  config.Get("yaw_damper_authority", params.yaw_damper_authority);
+
+  /* the protection needs the bank angles in order, and the law divides by
+     max_bank - clamping_bank */
+  bool roll_ok = envelope.rate_per_deflection > 0 && envelope.restoring_rate >= 0 &&
+    0 <= envelope.nominal_bank && envelope.nominal_bank <= envelope.clamping_bank &&
+    envelope.clamping_bank < envelope.max_bank && envelope.max_bank <= radians(90) &&
+    params.aileron_p >= 0 && params.aileron_d >= 0 && params.aileron_i >= 0 &&
+    params.aileron_min < params.aileron_max;
+
+  /* 1 g must lie inside the load factor limits, and the law divides by the
+     clamping margin and the cosine of the compensated bank */
+  bool pitch_ok = pitch_envelope.min_load_factor < 1 && 1 < pitch_envelope.max_load_factor &&
+    pitch_envelope.max_pitch_up > 0 && pitch_envelope.max_pitch_down > 0 &&
+    pitch_envelope.clamping_margin > 0 && pitch_envelope.restoring_load_factor >= 0 &&
+    0 <= pitch_envelope.compensation_bank && pitch_envelope.compensation_bank < radians(90) &&
+    params.elevator_p >= 0 && params.elevator_i >= 0 && params.elevator_min < params.elevator_max;
+
+  bool yaw_ok = params.yaw_damper_gain >= 0 && params.yaw_damper_authority >= 0;
+  return roll_ok && pitch_ok && yaw_ok;
+}
+
+ReloadableConfig<FBWParameters> parameters(FBWParameters(), ParseFBWParameters);
 
 void setupEvents()
 {
   // Set up private events
   ASSERT_SC_SUCCESS(SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_XAXIS));
+  ASSERT_SC_SUCCESS(SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_YAXIS));
 
   // Add private events to notification group (don't mask for now)
   ASSERT_SC_SUCCESS(SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_0, EVENT_XAXIS));
+  ASSERT_SC_SUCCESS(SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_0, EVENT_YAXIS));
 
   // Set highest priority so we recieve event before ESP
   ASSERT_SC_SUCCESS(SimConnect_SetNotificationGroupPriority(hSimConnect, GROUP_0, SIMCONNECT_GROUP_PRIORITY_HIGHEST));
 
-  // Map joystick event to this
+  // Map joystick events to these
   ASSERT_SC_SUCCESS(SimConnect_MapInputEventToClientEvent(hSimConnect, INPUT_XAXIS, "joystick:0:XAxis", EVENT_XAXIS));
+  ASSERT_SC_SUCCESS(SimConnect_MapInputEventToClientEvent(hSimConnect, INPUT_YAXIS, "joystick:0:YAxis", EVENT_YAXIS));
 
   // Turn joystick events on
   ASSERT_SC_SUCCESS(SimConnect_SetInputGroupState(hSimConnect, INPUT_XAXIS, SIMCONNECT_STATE_ON));
+  ASSERT_SC_SUCCESS(SimConnect_SetInputGroupState(hSimConnect, INPUT_YAXIS, SIMCONNECT_STATE_ON));
 }
 
 void setupDatadef() {
-  ASSERT_SC_SUCCESS(SimConnect_AddToDataDefinition(hSimConnect, DEFINITION_AIRCRAFT_POSITION, "PLANE BANK DEGREES", "Radians"));
-  ASSERT_SC_SUCCESS(SimConnect_AddToDataDefinition(hSimConnect, DEFINITION_AIRCRAFT_POSITION, "ROTATION VELOCITY BODY X", "Radians per second"));
-
-  ASSERT_SC_SUCCESS(SimConnect_AddToDataDefinition(hSimConnect, DEFINITION_AIRCRAFT_ROLL_CONTROL, "AILERON POSITION", "Position"));
+  /* Fields are declared in SimConnectInterface.h */
+  ASSERT_SC_SUCCESS(SimData<structAircraftState>::Register(hSimConnect));
+  ASSERT_SC_SUCCESS(SimData<structAircraftControls>::Register(hSimConnect));
 }
 
 void setupInitialDataRequests() {
-  /* Get position information for every sim frame */
+  /* Get the state of all three axes for every sim frame */
   ASSERT_SC_SUCCESS(
-    SimConnect_RequestDataOnSimObject(hSimConnect, REQUEST_AIRCRAFT_POSITION,
-      DEFINITION_AIRCRAFT_POSITION, SIMCONNECT_OBJECT_ID_USER, SIMCONNECT_PERIOD_SIM_FRAME, 0)
+    SimData<structAircraftState>::Request(hSimConnect, SIMCONNECT_OBJECT_ID_USER, SIMCONNECT_PERIOD_SIM_FRAME)
   );
+  instrumentation.WatchRequest(SimData<structAircraftState>::RequestID(), "Aircraft state", 1 / SIM_UPDATE_RATE);
 }
 
-/*
-  Computes the desired roll rate, including applying protection
-*/
-
-double CalculateDesiredRollRate(double joystick_input) {
-  /* Relationship between requested roll rate and joystick input */
-  const double RAD_S_PER_UNIT_DEFLECTION = 0.15;
-  const double& MAX_REQUESTABLE_ROLL_RATE = RAD_S_PER_UNIT_DEFLECTION;
+/* Roll: side-stick commands a roll rate, returns the aileron deflection */
+double UpdateRollLaw(const FBWParameters& params, bool changed, double timestep) {
+  /* Relculate desired roll rate from joystick input and protections */
+  double desired_roll_rate;
+  {
+    ScopedTimer timer(instrumentation, STAGE_ROLL_RATE);
+    desired_roll_rate = params.envelope.DesiredRollRate(pilotInputs.joystickX, aircraft_status.bank_rad);
+  }
 
-  double desired_roll_rate_rad_s = RAD_S_PER_UNIT_DEFLECTION * joystick_input;
+  /* Use a P-only controller for roll rate, clamped to the aileron range */
+  static Chain<ClampedPID> aileron_command(
+    ClampedPID(params.aileron_p, params.aileron_d, params.aileron_i, params.aileron_min, params.aileron_max));
 
-  /*
-    Apply roll protection here: if bank angle greater than 33 degrees, and no
-    pressure on sidestick, request roll rate until bank angle is 33 degrees or
-    less. Always prevent bank angle exceeding 67 degrees.
+  /* Use this chain instead to add a first order response to the ailerons. The
+     selected time constant of 0.1s is typical for flight control surfaces. 
   */
+  // static Chain<ClampedPID, FirstOrderResponse> aileron_command(
+  //   ClampedPID(params.aileron_p, params.aileron_d, params.aileron_i, params.aileron_min, params.aileron_max),
+  //   FirstOrderResponse(0.1, 1));
+
+  /* Retune the running controller rather than replacing it, so that it keeps
+     its state, and the change in gains does not step the output (a change
+     in the clamping limits still can) */
+  if (changed) {
+    ClampedPID& pid = aileron_command.Get<0>();
+    pid.SetGainsBumpless(params.aileron_p, params.aileron_d, params.aileron_i);
+    pid.SetClampingLimits(params.aileron_min, params.aileron_max);
+  }
 
-  /* The roll rate to command when roll protection activates */
-  const double RESTORING_ROLL_RATE = radians(5); // per second
-
-  /* The bank angle at which clamping begins to prevent overbank */
-  const double BANK_CLAMPING_ANGLE = radians(60);
-
-  /* The maximum bank angle allowed */
-  const double MAX_BANK_ANGLE = radians(67);
-
-  /* The nominal bank angle: the usual bank angle for turns */
-  const double NOMINAL_BANK_ANGLE = radians(33);
-
-  /* true if aircraft is rolling in direction of bank */
-  bool isRollingBankDir = (sign(aircraft_status.bank_rad) == -sign(desired_roll_rate_rad_s));
+  ScopedTimer timer(instrumentation, STAGE_AILERON_PID);
+  return aileron_command.Update(desired_roll_rate - aircraft_status.rotation_vel_x_rad_s, timestep);
+}
 
-  /* maximum bank angle is 67 degrees. to enforce this, aggressively reduce
-     requested roll rate as 67 degrees is approached.
-  */
-  if (abs(aircraft_status.bank_rad) >= MAX_BANK_ANGLE) {
-    desired_roll_rate_rad_s = RESTORING_ROLL_RATE * sign(aircraft_status.bank_rad);
-  }
-  else if (abs(aircraft_status.bank_rad) > BANK_CLAMPING_ANGLE && isRollingBankDir && joystick_input != 0) {
-    /* linearly reduce maximum allowable roll rate as maximum bank angle is approached */
-    double max_roll_rate = MAX_REQUESTABLE_ROLL_RATE + 
-      (abs(aircraft_status.bank_rad) - BANK_CLAMPING_ANGLE) * 
-        (0 - MAX_REQUESTABLE_ROLL_RATE) / (MAX_BANK_ANGLE - BANK_CLAMPING_ANGLE);
-
-    /* clamp pre-computed desired_roll_rate to this value */
-    if (abs(desired_roll_rate_rad_s) > max_roll_rate) {
-      desired_roll_rate_rad_s = max_roll_rate * sign(desired_roll_rate_rad_s);
-    }
-  }
-  /* if no joystick input, restore aircraft to NOMINAL_BANK_ANGLE */
-  else if (abs(aircraft_status.bank_rad) > NOMINAL_BANK_ANGLE && joystick_input == 0) {
-    desired_roll_rate_rad_s = RESTORING_ROLL_RATE * sign(aircraft_status.bank_rad);
+/* Pitch: side-stick commands a load factor, returns the elevator deflection */
+double UpdatePitchLaw(const FBWParameters& params, bool changed, double timestep) {
+  ScopedTimer timer(instrumentation, STAGE_PITCH);
+  double desired_load_factor = params.pitch_envelope.DesiredLoadFactor(pilotInputs.joystickY,
+    aircraft_status.pitch_rad, aircraft_status.bank_rad);
+
+  /* PI controller for load factor, clamped to the elevator range: the
+     integral finds the elevator which holds the demanded load factor */
+  static Chain<ClampedPID> elevator_command(
+    ClampedPID(params.elevator_p, 0, params.elevator_i, params.elevator_min, params.elevator_max));
+  if (changed) {
+    ClampedPID& pid = elevator_command.Get<0>();
+    pid.SetGainsBumpless(params.elevator_p, 0, params.elevator_i);
+    pid.SetClampingLimits(params.elevator_min, params.elevator_max);
   }
+  return elevator_command.Update(desired_load_factor - aircraft_status.load_factor, timestep);
+}
 
-  return desired_roll_rate_rad_s;
+/* Yaw: damps the Dutch roll, returns the rudder deflection */
+double UpdateYawDamper(const FBWParameters& params, bool changed, double timestep) {
+  ScopedTimer timer(instrumentation, STAGE_YAW);
+  static YawDamper yaw_damper = MakeYawDamper(params.yaw_damper_gain, params.yaw_damper_authority);
+  if (changed) {
+    ClampedPID& pid = yaw_damper.Get<1>();
+    pid.SetGainsBumpless(params.yaw_damper_gain, 0, 0);
+    pid.SetClampingLimits(-params.yaw_damper_authority, params.yaw_damper_authority);
+  }
+  return yaw_damper.Update(0 - aircraft_status.rotation_vel_y_rad_s, timestep);
 }
 
-void UpdateControls() {
-  /* Relculate desired roll rate from joystick input and protections */
-  double desired_roll_rate = CalculateDesiredRollRate(pilotInputs.joystickX);
+void UpdateControls(double timestep) {
+  /* Take up any new parameters, only ever between frames */
+  const FBWParameters* params;
+  bool changed = parameters.Acquire(params);
 
-  /* Use a P-only controller for roll rate */
-  const double AILERON_DEFL_PER_RAD_S_ERROR = 10;
-  static PIDController roll_rate_controller(AILERON_DEFL_PER_RAD_S_ERROR, 0, 0);
-  auto output = roll_rate_controller.Update(
-    desired_roll_rate - aircraft_status.rotation_vel_x_rad_s, SIM_UPDATE_RATE);
+  structAircraftControls& controls = outputs.Frame();
+  {
+    ScopedTimer timer(instrumentation, STAGE_LAWS);
+    controls.aileronDeflect = UpdateRollLaw(*params, changed, timestep);
+    controls.elevatorDeflect = UpdatePitchLaw(*params, changed, timestep);
+    controls.rudderDeflect = UpdateYawDamper(*params, changed, timestep);
+  }
 
-  /* Manually clamp controller output */
-  if (output > 1) {
-    output = 1;
+  /* Send the outputs of all three axes to FSX, in one call */
+  {
+    ScopedTimer timer(instrumentation, STAGE_WRITE);
+    ASSERT_SC_SUCCESS(outputs.Flush(hSimConnect, SIMCONNECT_OBJECT_ID_USER));
   }
-  else if (output < -1) {
-    output = -1;
+  if (outputs.Sent()) {
+    recorder.RecordOutput(SimData<structAircraftControls>::DefineID(), SIMCONNECT_OBJECT_ID_USER,
+      outputs.SentData(), outputs.SentSize());
   }
-
-  /* Uncomment these lines to add a first order response to the ailerons. The
-     selected time constant of 0.1s is typical for flight control surfaces. 
-  */
-  // static FirstOrderResponseBlock aileronResponse(0.1, 1);
-  // output = aileronResponse.Update(output, 0.025);
-
-  /* Send output to FSX */
-  structAircraftRollControl rollControlSettings;
-  rollControlSettings.aileronDeflect = output;
-  ASSERT_SC_SUCCESS(
-    SimConnect_SetDataOnSimObject(hSimConnect, DEFINITION_AIRCRAFT_ROLL_CONTROL, 
-      SIMCONNECT_OBJECT_ID_USER, 0, 1, sizeof(rollControlSettings), &rollControlSettings));
 }
 
 void CALLBACK SC_Dispatch_Handler(SIMCONNECT_RECV* pData, DWORD cbData, void *pContext)
 {
+  recorder.RecordReceived(pData, cbData);
+
   switch (pData->dwID)
   {
   case SIMCONNECT_RECV_ID_SIMOBJECT_DATA:
   {
     SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = reinterpret_cast<SIMCONNECT_RECV_SIMOBJECT_DATA*>(pData);
 
-    // Position data:
-    if (pObjData->dwRequestID == REQUEST_AIRCRAFT_POSITION) {
-      // update aircraft status struct
-      aircraft_status = 
-        *reinterpret_cast<structAircraftPosition*>(&pObjData->dwData);
-      
-      UpdateControls();
+    // Aircraft state:
+    if (const structAircraftState* state = SimData<structAircraftState>::Get(pObjData, cbData)) {
+      {
+        ScopedTimer timer(instrumentation, STAGE_FRAME);
+        instrumentation.Received(pObjData->dwRequestID, state->sim_time_s);
+
+        // update aircraft status struct
+        aircraft_status = *state;
+
+        UpdateControls(frame_clock.Stamp(state->sim_time_s));
+      }
+      instrumentation.Tick();
     }
 
     break;
@@ -190,10 +343,16 @@ void CALLBACK SC_Dispatch_Handler(SIMCONNECT_RECV* pData, DWORD cbData, void *pC
     case EVENT_XAXIS:
     {
       /* raw data is unsigned, so need to convert to signed before double */
-      long int joystickIn = evt->dwData;
+      int32_t joystickIn = static_cast<int32_t>(evt->dwData);
       pilotInputs.joystickX = static_cast<double>(joystickIn) / 32768;
     }
     break;
+    case EVENT_YAXIS:
+    {
+      int32_t joystickIn = static_cast<int32_t>(evt->dwData);
+      pilotInputs.joystickY = static_cast<double>(joystickIn) / 32768;
+    }
+    break;
     default:
       break;
     }
@@ -212,10 +371,29 @@ void CALLBACK SC_Dispatch_Handler(SIMCONNECT_RECV* pData, DWORD cbData, void *pC
   }
 }
 
-void runFBW()
+bool runFBW()
 {
+  // Event signalled by SimConnect whenever messages are waiting
+  hDispatchEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+  if (!recorder.OpenFromEnvironment("FLIGHT_RECORDING")) {
+    printf("Error, could not create flight recording\n");
+  }
+  if (!instrumentation.StartFromEnvironment("INSTRUMENTATION")) {
+    printf("Error, could not create instrumentation dump\n");
+  }
+  instrumentation.SetBudget(STAGE_LAWS, CONTROL_LAW_BUDGET / SIM_UPDATE_RATE);
+  outputs.SetRefreshInterval(OUTPUT_REFRESH_FRAMES);
+  if (!parameters.StartFromEnvironment("CONTROLLER_CONFIG")) {
+    printf("Error, could not load controller config, using the defaults\n");
+  }
+
   // Establish connected to FSX
-  while (SimConnect_Open(&hSimConnect, "Airbus Roll Control Law", NULL, 0, 0, 0) != S_OK);
+  if (!OpenSimConnect(&hSimConnect, "Airbus Fly-By-Wire", hDispatchEvent)) {
+    printf("Error, could not connect to the simulator\n");
+    CloseHandle(hDispatchEvent);
+    return false;
+  }
 
   printf("Connected...\b");
 
@@ -228,17 +406,35 @@ void runFBW()
   // Setup regular requests
   setupInitialDataRequests();
 
-  // Main loop
+  // Main loop: sleep until SimConnect signals that messages are waiting,
+  // unless built to poll continuously for comparison
   while (0 == quit) {
+#ifndef SPIN_DISPATCH
+    if (WaitForSingleObject(hDispatchEvent, INFINITE) != WAIT_OBJECT_0) {
+      continue;
+    }
+#endif
     SimConnect_CallDispatch(hSimConnect, SC_Dispatch_Handler, NULL);
   }
 
   SimConnect_Close(hSimConnect);
+  CloseHandle(hDispatchEvent);
+  recorder.Close();
+  instrumentation.Stop();
+  parameters.Stop();
+
+  frame_clock.PrintStats(stdout);
+  instrumentation.Print(stdout);
+  outputs.PrintStats(stdout);
+
+  return true;
 }
 
 int main(int argc, _TCHAR* argv[])
 {
-  runFBW();
+  if (!runFBW()) {
+    return 1;
+  }
 
   return 0;
 }
\ No newline at end of file
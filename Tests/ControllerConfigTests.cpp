@@ -0,0 +1,233 @@
+/*
+  Checks the config file parser and the reload handshake of
+  common/controller_config.h, and the bumpless retuning of controllers with
+  the parameters loaded, see common/PIDController.h.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "common/PIDController.h"
+#include "common/controller_config.h"
+
+#include "test.h"
+
+TEST(ParsesValuesCommentsAndBlankLines) {
+  ControllerConfig config;
+  CHECK(config.Parse("# gains\n\naileron_p = 10\n  aileron_i=0.5   # trailing comment\r\nmax_bank_deg = -67e0"));
+  double value = 0;
+  CHECK(config.Get("aileron_p", value) && value == 10);
+  CHECK(config.Get("aileron_i", value) && value == 0.5);
+  CHECK(config.Get("max_bank_deg", value) && value == -67);
+  CHECK(config.Error().empty());
+}
+
+TEST(MissingParameterLeavesValue) {
+  ControllerConfig config;
+  CHECK(config.Parse("a = 1\n"));
+  double value = 42;
+  CHECK(!config.Get("b", value));
+  CHECK(value == 42);
+}
+
+TEST(LaterLineWins) {
+  ControllerConfig config;
+  CHECK(config.Parse("a = 1\na = 2\n"));
+  double value = 0;
+  CHECK(config.Get("a", value) && value == 2);
+}
+
+TEST(RejectsMalformedLines) {
+  const char* malformed[] = {
+    "a = 1\njust text\n",
+    "a = 1\n= 3\n",
+    "a = 1\nb =\n",
+    "a = 1\nb = 3 kts\n",
+    "a = 1\nb = 0x\n",
+  };
+  for (const char* text : malformed) {
+    ControllerConfig config;
+    CHECK(!config.Parse(text));
+    CHECK(config.Error() == "line 2 is not \"name = value\"");
+  }
+}
+
+TEST(ReportsUnusedParameters) {
+  ControllerConfig config;
+  CHECK(config.Parse("aileron_p = 1\naileron_pp = 2\n"));
+  double value;
+  config.Get("aileron_p", value);
+  std::vector<std::string> unused = config.Unused();
+  CHECK(unused.size() == 1 && unused[0] == "aileron_pp");
+}
+
+/* Parameters of the reload tests: the file is rejected if limit is not positive */
+struct TestParameters {
+  double gain = 1;
+  double limit = 2;
+};
+
+bool ParseTestParameters(const ControllerConfig& config, TestParameters& params) {
+  config.Get("gain", params.gain);
+  config.Get("limit", params.limit);
+  return params.limit > 0;
+}
+
+const char* CONFIG_PATH = "controller_config_tests.cfg";
+const double POLL_INTERVAL_S = 0.005;
+
+/* Replaces the file in one step, so the watcher never reads half of it */
+void WriteConfig(const char* text) {
+  std::string temporary = std::string(CONFIG_PATH) + ".new";
+  FILE* file = fopen(temporary.c_str(), "w");
+  fputs(text, file);
+  fclose(file);
+  rename(temporary.c_str(), CONFIG_PATH);
+}
+
+/* Waits for the watcher to publish the given version, returns false if it
+   does not within a second */
+template <typename Params>
+bool WaitForVersion(const ReloadableConfig<Params>& config, unsigned version) {
+  for (int i = 0; i < 1000 && config.Reloads() < version; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return config.Reloads() >= version;
+}
+
+/* Lets the watcher poll the file several times */
+void LetWatcherPoll() {
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+TEST(DefaultsWithoutFile) {
+  ReloadableConfig<TestParameters> config(TestParameters(), ParseTestParameters);
+  const TestParameters* params;
+  CHECK(config.Acquire(params));
+  CHECK(params->gain == 1 && params->limit == 2);
+  CHECK(!config.Acquire(params));
+}
+
+TEST(ReloadsChangedFile) {
+  WriteConfig("gain = 3\n");
+  ReloadableConfig<TestParameters> config(TestParameters(), ParseTestParameters);
+  CHECK(config.Start(CONFIG_PATH, POLL_INTERVAL_S));
+
+  const TestParameters* params;
+  CHECK(config.Acquire(params));
+  CHECK(params->gain == 3 && params->limit == 2);   /* limit left at its default */
+  CHECK(!config.Acquire(params));
+
+  /* an unchanged file is not reloaded */
+  LetWatcherPoll();
+  CHECK(config.Reloads() == 1);
+
+  WriteConfig("gain = 4\nlimit = 5\n");
+  CHECK(WaitForVersion(config, 2));
+  CHECK(config.Acquire(params));
+  CHECK(params->gain == 4 && params->limit == 5);
+
+  config.Stop();
+  remove(CONFIG_PATH);
+}
+
+TEST(KeepsParametersOfRejectedFile) {
+  WriteConfig("gain = 3\n");
+  ReloadableConfig<TestParameters> config(TestParameters(), ParseTestParameters);
+  CHECK(config.Start(CONFIG_PATH, POLL_INTERVAL_S));
+  const TestParameters* params;
+  config.Acquire(params);
+
+  WriteConfig("gain = 4\nnot a parameter\n");
+  LetWatcherPoll();
+  WriteConfig("gain = 4\nlimit = -1\n");
+  LetWatcherPoll();
+  CHECK(config.Reloads() == 1);
+  CHECK(!config.Acquire(params));
+  CHECK(params->gain == 3);
+
+  config.Stop();
+  remove(CONFIG_PATH);
+}
+
+/* The watcher does not overwrite the block the control path last acquired:
+   a version published but not yet acquired holds back the next one */
+TEST(DoesNotOverwriteAcquiredBlock) {
+  WriteConfig("gain = 1\n");
+  ReloadableConfig<TestParameters> config(TestParameters(), ParseTestParameters);
+  CHECK(config.Start(CONFIG_PATH, POLL_INTERVAL_S));
+  const TestParameters* first;
+  CHECK(config.Acquire(first));
+
+  WriteConfig("gain = 2\n");
+  CHECK(WaitForVersion(config, 2));
+  WriteConfig("gain = 3\n");
+  LetWatcherPoll();
+  CHECK(config.Reloads() == 2);
+  CHECK(first->gain == 1);
+
+  const TestParameters* second;
+  CHECK(config.Acquire(second));
+  CHECK(second->gain == 2);
+  CHECK(WaitForVersion(config, 3));
+  CHECK(second->gain == 2);
+
+  const TestParameters* third;
+  CHECK(config.Acquire(third));
+  CHECK(third->gain == 3);
+
+  config.Stop();
+  remove(CONFIG_PATH);
+}
+
+/* Runs a PID controller against a slowly falling error */
+ClampedPID RunController(double p, double d, double i) {
+  ClampedPID pid(p, d, i, -10, 10);
+  for (int k = 0; k < 30; k++) {
+    pid.Update(0.5 - 0.01 * k, 1.0 / 30);
+  }
+  return pid;
+}
+
+/* Retuning does not step the output: the retuned controller gives the
+   output of the original one, except for the new gains acting on how the
+   error has changed since the last update. Here the error is the same, and
+   no time passes for the integral, so the only change is in the error's
+   derivative, from -0.3/s to 0, seen by the change in derivative gain. */
+TEST(RetuningIsBumpless) {
+  ClampedPID pid = RunController(0.3, 0.1, 1);
+  double last_error = 0.5 - 0.01 * 29;
+  double expected = ClampedPID(pid).Update(last_error, 1e-12) + (0.05 - 0.1) * (0 - -0.3);
+
+  ClampedPID retuned = pid;
+  retuned.SetGainsBumpless(0.6, 0.05, 2);
+  CHECK_NEAR(retuned.Update(last_error, 1e-12), expected, 1e-9);
+
+  /* without an integral gain the integral term is kept as a trim */
+  ClampedPID no_integral = pid;
+  no_integral.SetGainsBumpless(0.6, 0.05, 0);
+  CHECK_NEAR(no_integral.Update(last_error, 1e-12), expected, 1e-9);
+
+  /* and folded back into the integral when the gain is set again */
+  no_integral.SetGainsBumpless(0.6, 0.05, 0.5);
+  CHECK_NEAR(no_integral.Update(last_error, 1e-12), expected, 1e-9);
+}
+
+/* A P-only controller has no integral to absorb a change in gain into, so
+   the change is faded in rather than stepped, and the output settles where
+   the new gain puts it */
+TEST(ProportionalRetuningFades) {
+  ClampedPID pid(10, 0, 0, -1, 1);
+  double before = pid.Update(0.01, 1.0 / 30);
+  pid.SetGainsBumpless(20, 0, 0);
+  CHECK_NEAR(pid.Update(0.01, 1.0 / 30), before, 1e-12);
+  double after = 0;
+  for (int k = 0; k < 600; k++) {
+    after = pid.Update(0.01, 1.0 / 30);
+  }
+  CHECK_NEAR(after, 0.2, 1e-9);
+}
+
+TEST_MAIN();
@@ -0,0 +1,168 @@
+/*
+  Checks StateSpace and StateSpaceMIMO against closed-form step responses,
+  and against FirstOrderResponse, see common/state_space.h.
+*/
+
+#include <cmath>
+
+#include "common/siso_blocks.h"
+#include "common/state_space.h"
+
+#include "test.h"
+
+const double TIMESTEP = 1.0 / 30;
+const int STEPS = 300;
+
+/* The largest error of the step response of block from closed_form(t) */
+template <typename Block, typename Response>
+double StepResponseError(Block block, Response closed_form) {
+  double max_error = 0;
+  for (int k = 1; k <= STEPS; k++) {
+    double y = block.Update(1.0, TIMESTEP);
+    max_error = std::fmax(max_error, std::abs(y - closed_form(k * TIMESTEP)));
+  }
+  return max_error;
+}
+
+/* 1 / (a s + b) */
+TEST(FirstOrderStepResponse) {
+  const double a = 0.5, b = 2;
+  const double num[] = { 0, 1 };
+  const double den[] = { a, b };
+  double error = StepResponseError(StateSpace<1>::FromTransferFunction(num, den),
+    [=](double t) { return (1 - std::exp(-b * t / a)) / b; });
+  CHECK(error < 2e-14);
+}
+
+/* wn^2 / (s^2 + 2 zeta wn s + wn^2), underdamped */
+TEST(SecondOrderStepResponse) {
+  const double wn = 20, zeta = 0.7;
+  const double num[] = { 0, 0, wn * wn };
+  const double den[] = { 1, 2 * zeta * wn, wn * wn };
+  const double wd = wn * std::sqrt(1 - zeta * zeta);
+  double error = StepResponseError(StateSpace<2>::FromTransferFunction(num, den),
+    [=](double t) {
+      return 1 - std::exp(-zeta * wn * t) * (std::cos(wd * t) + zeta / std::sqrt(1 - zeta * zeta) * std::sin(wd * t));
+    });
+  CHECK(error < 2e-14);
+}
+
+/* Lead (t1 s + 1) / (t2 s + 1): the numerator is of the same order as the
+   denominator, so the realisation has a direct feedthrough */
+TEST(LeadStepResponse) {
+  const double t1 = 0.5, t2 = 0.1;
+  const double num[] = { t1, 1 };
+  const double den[] = { t2, 1 };
+  double error = StepResponseError(StateSpace<1>::FromTransferFunction(num, den),
+    [=](double t) { return 1 - (1 - t1 / t2) * std::exp(-t / t2); });
+  CHECK(error < 2e-14);
+}
+
+/* The controllable canonical form of (n0 s^2 + n1 s + n2) / (d0 s^2 + d1 s + d2),
+   checked against its step response: the initial value is n0 / d0 and the
+   final value n2 / d2 */
+TEST(FromTransferFunctionGains) {
+  const double num[] = { 1, 3, 8 };
+  const double den[] = { 2, 6, 4 };
+  StateSpace<2> block = StateSpace<2>::FromTransferFunction(num, den);
+  CHECK_NEAR(block.Update(1.0, 1e-9), 0.5, 1e-8);
+  double y = 0;
+  for (int k = 0; k < 100; k++) {
+    y = block.Update(1.0, 1.0);
+  }
+  CHECK_NEAR(y, 2, 1e-12);
+}
+
+/* The number of ulps between actual and expected */
+double Ulps(double actual, double expected) {
+  double ulp = std::nextafter(std::abs(expected), INFINITY) - std::abs(expected);
+  return std::abs(actual - expected) / ulp;
+}
+
+/* A first order StateSpace is the same block as FirstOrderResponse with the
+   exact discretisation: its discrete coefficients, computed through the
+   matrix exponential rather than exp and expm1, agree to a few ulps at the
+   frame rate, and the outputs stay within rounding of each other */
+TEST(MatchesExactFirstOrderResponse) {
+  const double cases[][2] = { { 0.1, 1 }, { 0.5, 2 }, { 0.6, 1 }, { 2, 0.3 } };
+  for (const auto& c : cases) {
+    const double num[] = { 0, 1 };
+    const double den[] = { c[0], c[1] };
+    StateSpace<1> block = StateSpace<1>::FromTransferFunction(num, den);
+    FirstOrderResponse reference(c[0], c[1], 0, DISCRETISE_EXACT);
+
+    /* from rest, a unit input gives beta, then no input alpha * beta */
+    double y = block.Update(1.0, TIMESTEP);
+    double expected = reference.Update(1.0, TIMESTEP);
+    CHECK(Ulps(y, expected) <= 4);
+    y = block.Update(0.0, TIMESTEP);
+    expected = reference.Update(0.0, TIMESTEP);
+    CHECK(Ulps(y, expected) <= 4);
+
+    for (int k = 0; k < STEPS; k++) {
+      double u = std::sin(0.1 * k);
+      CHECK_NEAR(block.Update(u, TIMESTEP), reference.Update(u, TIMESTEP), 1e-14);
+    }
+  }
+}
+
+/* Two inputs and two outputs, coupled through the states and a direct
+   feedthrough:
+     dx1/dt = -x1 + x2 + u1      y1 = x1 + 0.5 u2
+     dx2/dt = -2 x2 + u2         y2 = 3 x2
+   whose step response from rest is x2 = u2/2 (1 - e^-2t) and
+   x1 = u1 (1 - e^-t) + u2/2 (1 - e^-t)^2 */
+TEST(MIMOStepResponse) {
+  const double A[2][2] = { { -1, 1 }, { 0, -2 } };
+  const double B[2][2] = { { 1, 0 }, { 0, 1 } };
+  const double C[2][2] = { { 1, 0 }, { 0, 3 } };
+  const double D[2][2] = { { 0, 0.5 }, { 0, 0 } };
+  StateSpaceMIMO<2, 2, 2> block(A, B, C, D);
+
+  const double u[] = { 1, -2 };
+  double max_error = 0;
+  for (int k = 1; k <= STEPS; k++) {
+    const double* y = block.Update(u, TIMESTEP);
+    double t = k * TIMESTEP;
+    double x1 = u[0] * (1 - std::exp(-t)) + u[1] / 2 * (1 - std::exp(-t)) * (1 - std::exp(-t));
+    double x2 = u[1] / 2 * (1 - std::exp(-2 * t));
+    max_error = std::fmax(max_error, std::abs(y[0] - (x1 + 0.5 * u[1])));
+    max_error = std::fmax(max_error, std::abs(y[1] - 3 * x2));
+  }
+  CHECK(max_error < 2e-14);
+}
+
+/* Timesteps that differ only by rounding reuse the discretisation, so a
+   block fed them gives exactly the same outputs as one fed the nominal
+   timestep */
+TEST(TimestepRoundingReusesDiscretisation) {
+  const double num[] = { 0, 0, 400 };
+  const double den[] = { 1, 28, 400 };
+  StateSpace<2> nominal = StateSpace<2>::FromTransferFunction(num, den);
+  StateSpace<2> jittered = StateSpace<2>::FromTransferFunction(num, den);
+  FirstOrderResponse nominal_lag(0.5, 2, 0, DISCRETISE_EXACT);
+  FirstOrderResponse jittered_lag(0.5, 2, 0, DISCRETISE_EXACT);
+
+  bool same = true;
+  for (int k = 0; k < STEPS; k++) {
+    double u = std::sin(0.1 * k);
+    double timestep = (k == 0) ? TIMESTEP : TIMESTEP * (1 + ((k % 2) ? 1e-12 : -1e-12));
+    same = same && nominal.Update(u, TIMESTEP) == jittered.Update(u, timestep);
+    same = same && nominal_lag.Update(u, TIMESTEP) == jittered_lag.Update(u, timestep);
+  }
+  CHECK(same);
+
+  /* a real change of timestep, however small, is not ignored */
+  CHECK(nominal.Update(1.0, TIMESTEP) != jittered.Update(1.0, TIMESTEP * (1 + 1e-6)));
+}
+
+/* No time elapsed: the output is held */
+TEST(ZeroTimestepHoldsOutput) {
+  const double num[] = { 0, 1 };
+  const double den[] = { 1, 1 };
+  StateSpace<1> block = StateSpace<1>::FromTransferFunction(num, den);
+  double y = block.Update(1.0, TIMESTEP);
+  CHECK(block.Update(5.0, 0) == y);
+}
+
+TEST_MAIN();
@@ -0,0 +1,87 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+/*
+  A minimal unit test harness, in the style of the benchmark harness, so the
+  tests need no external dependency:
+
+    TEST(SomethingWorks) {
+      CHECK(something == expected);
+      CHECK_NEAR(value, expected, 1e-12);
+    }
+
+    TEST_MAIN();
+
+  Every test is run; each failed check is printed with its file and line,
+  and the test carries on. The exit status is non-zero if any check failed,
+  so the executable can be run by ctest.
+*/
+
+struct TestCase {
+  const char* name;
+  void (*function)();
+};
+
+inline std::vector<TestCase>& RegisteredTests() {
+  static std::vector<TestCase> tests;
+  return tests;
+}
+
+inline int& FailedChecks() {
+  static int failed = 0;
+  return failed;
+}
+
+struct TestRegistration {
+  TestRegistration(const char* name, void (*function)()) {
+    RegisteredTests().push_back({ name, function });
+  }
+};
+
+#define TEST(name)                                                       \
+  void name();                                                           \
+  static TestRegistration name##_registration(#name, name);              \
+  void name()
+
+#define CHECK(condition)                                                 \
+  do {                                                                   \
+    if (!(condition)) {                                                  \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      FailedChecks()++;                                                  \
+    }                                                                    \
+  } while (0)
+
+/* Checks |actual - expected| <= tolerance; a NaN always fails */
+#define CHECK_NEAR(actual, expected, tolerance)                          \
+  do {                                                                   \
+    double actual_ = (actual), expected_ = (expected);                   \
+    if (!(std::abs(actual_ - expected_) <= (tolerance))) {               \
+      printf("%s:%d: CHECK_NEAR(%s, %s, %s) failed: %.17g vs %.17g\n",   \
+        __FILE__, __LINE__, #actual, #expected, #tolerance, actual_, expected_); \
+      FailedChecks()++;                                                  \
+    }                                                                    \
+  } while (0)
+
+inline int RunTests() {
+  int failed_tests = 0;
+  for (const TestCase& test : RegisteredTests()) {
+    int failed_before = FailedChecks();
+    test.function();
+    bool passed = FailedChecks() == failed_before;
+    printf("%s %s\n", passed ? "[  OK  ]" : "[FAILED]", test.name);
+    failed_tests += passed ? 0 : 1;
+  }
+  printf("%zu tests, %d failed\n", RegisteredTests().size(), failed_tests);
+  return (failed_tests == 0) ? 0 : 1;
+}
+
+#define TEST_MAIN()                                                      \
+  int main() {                                                           \
+    return RunTests();                                                   \
+  }
+
+#endif
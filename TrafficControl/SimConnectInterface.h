@@ -0,0 +1,51 @@
+#ifndef SIMCONNECTINTERFACE_H
+#define SIMCONNECTINTERFACE_H
+
+/* This file contains all required enums, constants and structures required to
+   exchange data with FS through the SimConnect interface.
+*/
+
+#include "common/sim_data.h"
+
+/* Nominal FSX simulation physics frames per second: the actual rate varies,
+   so the time between frames is measured (see common/frame_clock.h) */
+const double SIM_UPDATE_RATE = 30;
+
+/* Radius in which aircraft are controlled, the largest SimConnect allows */
+const DWORD TRAFFIC_RADIUS_M = 200000;
+
+/* Request IDs not allocated by SimData: the search for aircraft, and the
+   per-frame data of each aircraft found, from FIRST_AIRCRAFT_REQUEST on */
+enum REQUEST_ID {
+  REQUEST_FIND_AIRCRAFT = 0x10000,
+  FIRST_AIRCRAFT_REQUEST,
+};
+
+/* Start of Structure Definitions: data definition IDs are allocated by
+   SimData, see common/sim_data.h */
+
+/* The state of one aircraft, received once every sim frame for each */
+struct structAircraftState {
+  double sim_time_s; // simulation time in seconds, to group the aircraft's data by frame
+  float bank_rad; // bank angle in radians, positive left
+  float rotation_vel_x_rad_s; // roll rate in radians per second, positive rolling right
+  float heading; // true aircraft heading in radians
+  float ap_heading_deg; // heading selected on the autopilot panel in degrees
+};
+
+SIM_DATA_DEFINITION(structAircraftState,
+  SIM_DATA_FIELD(sim_time_s, "SIMULATION TIME", "Seconds"),
+  SIM_DATA_FIELD(bank_rad, "PLANE BANK DEGREES", "Radians"),
+  SIM_DATA_FIELD(rotation_vel_x_rad_s, "ROTATION VELOCITY BODY X", "Radians per second"),
+  SIM_DATA_FIELD(heading, "PLANE HEADING DEGREES TRUE", "Radians"),
+  SIM_DATA_FIELD(ap_heading_deg, "AUTOPILOT HEADING LOCK DIR", "Degrees"));
+
+/* The control outputs of one aircraft */
+struct structControlOutputs {
+  double aileronDeflect = 0;
+};
+
+SIM_DATA_DEFINITION(structControlOutputs,
+  SIM_DATA_FIELD(aileronDeflect, "AILERON POSITION", "Position"));
+
+#endif
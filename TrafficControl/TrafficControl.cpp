@@ -0,0 +1,338 @@
+/*
+  Flies every aircraft in range, the AI traffic as well as the user
+  aircraft, onto the heading selected on its autopilot panel from one
+  client, through the loops of FlightControlHost: a heading autopilot, a
+  bank hold and the roll control law, with its bank angle protection.
+
+  * Every aircraft is found with SimConnect_RequestDataOnSimObjectType and
+    added to a pool (see common/sim_object_pool.h), which gives it an index,
+    and its state is requested every frame
+  * The controllers of all the aircraft are held in PIDBanks, and their
+    state in arrays, at the aircraft's index: each data message is routed
+    to that index by its dwObjectID
+  * Once every aircraft has reported for a frame, the loops are updated for
+    all of them in one batch, and each aircraft's aileron is sent if it
+    changed (SimConnect sets the data of one object per call)
+
+  An aircraft's data belongs to the frame of its SIMULATION TIME. If data
+  for the next frame arrives before every aircraft has reported for the
+  current one, the current frame is updated without waiting any longer, the
+  aircraft that did not report being flown on their last known state.
+*/
+
+#ifdef _WIN32
+#include <windows.h>
+#include <tchar.h>
+#include <stdio.h>
+#include <strsafe.h>
+
+#include "external/SimConnect.h"
+#else
+#include <stdio.h>
+
+#include "localsim/SimConnect.h"
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "common/PIDBank.h"
+#include "common/connection.h"
+#include "common/flight_recording.h"
+#include "common/frame_clock.h"
+#include "common/output_stage.h"
+#include "common/sim_object_pool.h"
+#include "common/util.h"
+#include "fbw/roll_control_law.h"
+
+#include "SimConnectInterface.h"
+
+int     quit = 0;
+HANDLE  hSimConnect = NULL;
+HANDLE  hDispatchEvent = NULL;
+
+/* Records the flight if FLIGHT_RECORDING names a file, see flight_recording.h */
+FlightRecorder recorder;
+
+/* The aircraft controlled, each with an index into the arrays below */
+SimObjectPool aircraft;
+
+/* Last known state of each aircraft */
+static struct TrafficState {
+  std::vector<double> bank_rad;           /* positive left */
+  std::vector<double> roll_rate_rad_s;    /* positive rolling right */
+  std::vector<double> heading_deg;
+  std::vector<double> ap_heading_deg;
+} traffic;
+
+/* Controllers of each aircraft, with the gains of FlightControlHost:
+   * heading autopilot: bank angle per heading error, clamped at 20 degrees
+   * bank hold: side-stick deflection that requests a roll rate proportional
+     to the bank error
+   * roll control law: aileron per roll rate error, for a 737-800 in cruise */
+PIDBank headingControllers;
+PIDBank bankControllers;
+PIDBank aileronControllers;
+RollProtectionEnvelope rollEnvelope;
+
+/* Inputs and outputs of the controllers of each aircraft, for one frame */
+static struct TrafficLoops {
+  std::vector<double> heading_error_deg;
+  std::vector<double> bank_rad;           /* requested bank, positive right */
+  std::vector<double> bank_error_rad;
+  std::vector<double> stick;
+  std::vector<double> roll_rate_rad_s;    /* requested roll rate */
+  std::vector<double> roll_rate_error_rad_s;
+} loops;
+
+/* Aileron outputs of each aircraft, sent when they change */
+std::vector<OutputStage<structControlOutputs>> outputs;
+
+/* The frame being collected: its simulation time, the number of aircraft
+   that have reported for it, and the frame each aircraft last reported for */
+static struct FrameCollection {
+  double sim_time_s = 0;
+  size_t reported = 0;
+  uint64_t frame = 1;
+  std::vector<uint64_t> last_frame;
+} collection;
+
+/* Measures the time between frames */
+FrameClock frame_clock(1 / SIM_UPDATE_RATE);
+
+static struct TrafficStats {
+  uint64_t frames = 0;
+  uint64_t incomplete_frames = 0;   /* updated before every aircraft had reported */
+  uint64_t update_ns = 0;           /* time spent updating the loops */
+  uint64_t aircraft_updates = 0;
+} stats;
+
+/* Adds an aircraft found by the search, and requests its state every frame */
+void AddAircraft(SIMCONNECT_OBJECT_ID object) {
+  size_t count = aircraft.Size();
+  size_t index = aircraft.Add(object);
+  if (index < count) {
+    return;
+  }
+
+  traffic.bank_rad.push_back(0);
+  traffic.roll_rate_rad_s.push_back(0);
+  traffic.heading_deg.push_back(0);
+  traffic.ap_heading_deg.push_back(0);
+
+  headingControllers.Add(radians(3), 0, 0, -radians(20), radians(20));
+  bankControllers.Add(0.5 / RAD_S_PER_UNIT_DEFLECTION, 0, 0, -1, 1);
+  aileronControllers.Add(10, 0, 0, -1, 1);
+
+  loops.heading_error_deg.resize(index + 1);
+  loops.bank_rad.resize(index + 1);
+  loops.bank_error_rad.resize(index + 1);
+  loops.stick.resize(index + 1);
+  loops.roll_rate_rad_s.resize(index + 1);
+  loops.roll_rate_error_rad_s.resize(index + 1);
+
+  outputs.emplace_back();
+  collection.last_frame.push_back(0);
+
+  ASSERT_SC_SUCCESS(SimConnect_RequestDataOnSimObject(hSimConnect,
+    static_cast<SIMCONNECT_DATA_REQUEST_ID>(FIRST_AIRCRAFT_REQUEST + index),
+    SimData<structAircraftState>::DefineID(), object, SIMCONNECT_PERIOD_SIM_FRAME));
+}
+
+/* Updates the loops of every aircraft, in one batch per loop */
+void UpdateTraffic(double dt) {
+  size_t n = aircraft.Size();
+
+  /* Heading autopilot: bank angle to fly the selected heading, taking the
+     shorter way round */
+  for (size_t k = 0; k < n; k++) {
+    loops.heading_error_deg[k] = std::fmod(traffic.ap_heading_deg[k] - traffic.heading_deg[k] + 540, 360) - 180;
+  }
+  headingControllers.Update(loops.heading_error_deg.data(), dt, loops.bank_rad.data());
+
+  /* Bank hold: side-stick deflection to roll towards the requested bank */
+  for (size_t k = 0; k < n; k++) {
+    loops.bank_error_rad[k] = loops.bank_rad[k] - -traffic.bank_rad[k];
+  }
+  bankControllers.Update(loops.bank_error_rad.data(), dt, loops.stick.data());
+
+  /* Roll control law: roll rate requested by the stick within the bank
+     angle protection, flown by the ailerons */
+  rollEnvelope.DesiredRollRates(n, loops.stick.data(), traffic.bank_rad.data(), loops.roll_rate_rad_s.data());
+  for (size_t k = 0; k < n; k++) {
+    loops.roll_rate_error_rad_s[k] = loops.roll_rate_rad_s[k] - traffic.roll_rate_rad_s[k];
+  }
+  aileronControllers.Update(loops.roll_rate_error_rad_s.data(), dt);
+}
+
+/* Runs the frame collected so far and sends the outputs */
+void RunFrame() {
+  double dt = frame_clock.Stamp(collection.sim_time_s);
+
+  uint64_t start_ns = MonotonicTimeNs();
+  UpdateTraffic(dt);
+  stats.update_ns += MonotonicTimeNs() - start_ns;
+  stats.aircraft_updates += aircraft.Size();
+
+  /* Send each aircraft's aileron to FSX if it changed */
+  for (size_t k = 0; k < aircraft.Size(); k++) {
+    SIMCONNECT_OBJECT_ID object = aircraft.ObjectID(k);
+    outputs[k].Frame().aileronDeflect = aileronControllers.Output(k);
+    ASSERT_SC_SUCCESS(outputs[k].Flush(hSimConnect, object));
+    if (outputs[k].Sent()) {
+      recorder.RecordOutput(SimData<structControlOutputs>::DefineID(), object,
+        outputs[k].SentData(), outputs[k].SentSize());
+    }
+  }
+
+  stats.frames++;
+  if (collection.reported < aircraft.Size()) {
+    stats.incomplete_frames++;
+  }
+  collection.frame++;
+  collection.reported = 0;
+}
+
+/* Routes an aircraft's state to its index, and runs the frame once every
+   aircraft has reported for it */
+void ReceiveAircraftState(SIMCONNECT_OBJECT_ID object, const structAircraftState& state) {
+  size_t index;
+  if (!aircraft.Find(object, index)) {
+    return;
+  }
+
+  /* data for the next frame: run the current one without waiting any longer */
+  if (collection.reported > 0 && state.sim_time_s != collection.sim_time_s) {
+    RunFrame();
+  }
+  collection.sim_time_s = state.sim_time_s;
+
+  traffic.bank_rad[index] = state.bank_rad;
+  traffic.roll_rate_rad_s[index] = state.rotation_vel_x_rad_s;
+  traffic.heading_deg[index] = degrees(state.heading);
+  traffic.ap_heading_deg[index] = state.ap_heading_deg;
+
+  if (collection.last_frame[index] != collection.frame) {
+    collection.last_frame[index] = collection.frame;
+    collection.reported++;
+  }
+  if (collection.reported == aircraft.Size()) {
+    RunFrame();
+  }
+}
+
+void setupDatadef() {
+  /* Fields are declared in SimConnectInterface.h */
+  ASSERT_SC_SUCCESS(SimData<structAircraftState>::Register(hSimConnect));
+  ASSERT_SC_SUCCESS(SimData<structControlOutputs>::Register(hSimConnect));
+}
+
+void setupInitialDataRequests() {
+  /* Find every aircraft in range, each is then requested individually */
+  ASSERT_SC_SUCCESS(SimConnect_RequestDataOnSimObjectType(hSimConnect, REQUEST_FIND_AIRCRAFT,
+    SimData<structAircraftState>::DefineID(), TRAFFIC_RADIUS_M, SIMCONNECT_SIMOBJECT_TYPE_AIRCRAFT));
+}
+
+void CALLBACK SC_Dispatch_Handler(SIMCONNECT_RECV* pData, DWORD cbData, void *pContext)
+{
+  recorder.RecordReceived(pData, cbData);
+
+  switch (pData->dwID)
+  {
+  case SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE:
+  {
+    SIMCONNECT_RECV_SIMOBJECT_DATA_BYTYPE *pObjData = reinterpret_cast<SIMCONNECT_RECV_SIMOBJECT_DATA_BYTYPE*>(pData);
+
+    // An aircraft found by the search
+    if (pObjData->dwRequestID == REQUEST_FIND_AIRCRAFT) {
+      AddAircraft(pObjData->dwObjectID);
+      if (pObjData->dwentrynumber == pObjData->dwoutof) {
+        printf("Controlling %zu aircraft\n", aircraft.Size());
+      }
+    }
+    break;
+  }
+  case SIMCONNECT_RECV_ID_SIMOBJECT_DATA:
+  {
+    SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = reinterpret_cast<SIMCONNECT_RECV_SIMOBJECT_DATA*>(pData);
+
+    // State of one aircraft
+    if (const structAircraftState* state = SimData<structAircraftState>::Get(pObjData, cbData)) {
+      ReceiveAircraftState(pObjData->dwObjectID, *state);
+    }
+    break;
+  }
+
+  case SIMCONNECT_RECV_ID_QUIT:
+  {
+    quit = 1;
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+bool runTrafficControl()
+{
+  // Event signalled by SimConnect whenever messages are waiting
+  hDispatchEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+  if (!recorder.OpenFromEnvironment("FLIGHT_RECORDING")) {
+    printf("Error, could not create flight recording\n");
+  }
+
+  // Establish connected to FSX
+  if (!OpenSimConnect(&hSimConnect, "Traffic Control", hDispatchEvent)) {
+    printf("Error, could not connect to the simulator\n");
+    CloseHandle(hDispatchEvent);
+    return false;
+  }
+
+  printf("Connected...\n");
+
+  // Setup data definitons
+  setupDatadef();
+
+  // Setup regular requests
+  setupInitialDataRequests();
+
+  // Main loop: sleep until SimConnect signals that messages are waiting
+  while (0 == quit) {
+    if (WaitForSingleObject(hDispatchEvent, INFINITE) != WAIT_OBJECT_0) {
+      continue;
+    }
+    SimConnect_CallDispatch(hSimConnect, SC_Dispatch_Handler, NULL);
+  }
+
+  SimConnect_Close(hSimConnect);
+  CloseHandle(hDispatchEvent);
+  recorder.Close();
+
+  // Show how long the batched updates took, and what was sent
+  uint64_t calls = 0, bytes = 0;
+  for (const auto& output : outputs) {
+    calls += output.GetStats().calls;
+    bytes += output.GetStats().bytes;
+  }
+  double aircraft_frames = static_cast<double>(stats.aircraft_updates > 0 ? stats.aircraft_updates : 1);
+  frame_clock.PrintStats(stdout);
+  printf("Traffic: %zu aircraft, %llu frames (%llu incomplete), %.1f ns per aircraft per frame "
+    "to update the loops, %.2f SetDataOnSimObject calls and %.1f bytes per aircraft per frame\n",
+    aircraft.Size(), static_cast<unsigned long long>(stats.frames),
+    static_cast<unsigned long long>(stats.incomplete_frames), stats.update_ns / aircraft_frames,
+    calls / aircraft_frames, bytes / aircraft_frames);
+
+  return true;
+}
+
+int main(int argc, _TCHAR* argv[])
+{
+  if (!runTrafficControl()) {
+    return 1;
+  }
+
+  return 0;
+}
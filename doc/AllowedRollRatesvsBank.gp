@@ -0,0 +1,35 @@
+# Plots the roll rates allowed by the bank angle protection of the roll FBW
+# example, as shown in AllowedRollRatesvsBank.png, from the envelope the
+# control law actually flies (RollProtectionEnvelope in inc/fbw/roll_control_law.h):
+#
+#   ./build/roll_envelope_sweep --envelope envelope.csv
+#   gnuplot -e "table='envelope.csv'" doc/AllowedRollRatesvsBank.gp
+#
+# Roll rates are plotted for a left bank, positive when they increase it.
+
+if (!exists("table")) table = 'envelope.csv'
+
+set datafile separator ','
+set terminal pngcairo size 800,800
+set output 'doc/AllowedRollRatesvsBank.png'
+
+set xlabel 'Bank angle (degrees)'
+set ylabel 'Allowed roll rates (degrees/second)'
+set xrange [0:80]
+set yrange [-6:10]
+set grid
+set key bottom left
+
+# protection thresholds
+set arrow from 33, graph 0 to 33, graph 1 nohead lw 2
+set arrow from 60, graph 0 to 60, graph 1 nohead dashtype 2
+set arrow from 67, graph 0 to 67, graph 1 nohead dashtype 2
+set label 'Unprotected region' at 5, 4
+set label 'Beyond 33 deg' at 38, 4
+set label 'Clamping region' at 60.5, 9
+
+# full stick into the bank, and hands off
+plot table every ::1 using 1:($1 >= 0 ? -$2 : NaN) with filledcurves y1=0 \
+       fillcolor rgb '#E8B0B0' title 'Maximum roll rate', \
+     table every ::1 using 1:($1 >= 0 ? -$2 : NaN) with lines lw 2 dashtype 2 lc rgb '#D06060' notitle, \
+     table every ::1 using 1:($1 >= 0 ? -$4 : NaN) with lines lw 2 lc rgb '#6060D0' title 'Hands off'
@@ -0,0 +1,159 @@
+#ifndef PIDBANK_H
+#define PIDBANK_H
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+/*
+  Provides a bank of clamped PID controllers which are updated together, for
+  use when simulating many loops at once (e.g. fleets of aircraft or gain
+  sweeps).
+
+  Gains, clamping limits and state are stored as structure-of-arrays, and the
+  update loop has no calls or data dependent control flow, so the compiler can
+  vectorise it. For every controller the arithmetic is performed in the same
+  order as ClampedPIDController, so given the same inputs the outputs are
+  bit-identical. The bank implements the controller's default configuration
+  only: the derivative is unfiltered and the setpoint is not weighted.
+*/
+
+class PIDBank
+{
+public:
+  PIDBank() {}
+
+  /* Creates a bank of count controllers with the given gains and limits */
+  PIDBank(size_t count, double p_coeff, double d_coeff, double i_coeff,
+    double lowClamp = -std::numeric_limits<double>::infinity(),
+    double highClamp = std::numeric_limits<double>::infinity()) {
+    for (size_t i = 0; i < count; i++) {
+      Add(p_coeff, d_coeff, i_coeff, lowClamp, highClamp);
+    }
+  }
+
+  /* Adds a controller and returns its index */
+  size_t Add(double p_coeff, double d_coeff, double i_coeff,
+    double lowClamp = -std::numeric_limits<double>::infinity(),
+    double highClamp = std::numeric_limits<double>::infinity()) {
+    p_coeffs.push_back(p_coeff);
+    d_coeffs.push_back(d_coeff);
+    i_coeffs.push_back(i_coeff);
+    clampLow.push_back(lowClamp);
+    clampHigh.push_back(highClamp);
+    last_errors.push_back(0);
+    error_integrals.push_back(0);
+    outputs.push_back(0);
+    return p_coeffs.size() - 1;
+  }
+
+  /* Returns the number of controllers */
+  size_t Size() const {
+    return p_coeffs.size();
+  }
+
+  void SetPCoefficient(size_t index, double val) {
+    p_coeffs[index] = val;
+  }
+  void SetDCoefficient(size_t index, double val) {
+    d_coeffs[index] = val;
+  }
+  void SetICoefficient(size_t index, double val) {
+    i_coeffs[index] = val;
+  }
+  void SetClampingLimits(size_t index, double lower, double higher) {
+    clampLow[index] = lower;
+    clampHigh[index] = higher;
+  }
+
+  double GetPCoefficient(size_t index) const {
+    return p_coeffs[index];
+  }
+  double GetDCoefficient(size_t index) const {
+    return d_coeffs[index];
+  }
+  double GetICoefficient(size_t index) const {
+    return i_coeffs[index];
+  }
+  double GetClampLowLimit(size_t index) const {
+    return clampLow[index];
+  }
+  double GetClampHighLimit(size_t index) const {
+    return clampHigh[index];
+  }
+
+  /* Clears the integral and derivative state of a controller */
+  void Reset(size_t index) {
+    last_errors[index] = 0;
+    error_integrals[index] = 0;
+    outputs[index] = 0;
+  }
+
+  /*
+    Updates every controller, errors must hold Size() values. Outputs are
+    available from Outputs() afterwards.
+  */
+  void Update(const double* errors, double timestep) {
+    Update(errors, timestep, outputs.data());
+  }
+
+  /* Updates every controller, writing the outputs to out as well. If no time
+     has elapsed the outputs are held, as for PIDController. */
+  void Update(const double* errors, double timestep, double* out) {
+    if (timestep > 0) {
+      UpdateKernel(Size(), errors, timestep, p_coeffs.data(), d_coeffs.data(), i_coeffs.data(),
+        clampLow.data(), clampHigh.data(), last_errors.data(), error_integrals.data(), outputs.data());
+    }
+
+    if (out != outputs.data()) {
+      for (size_t k = 0; k < Size(); k++) {
+        out[k] = outputs[k];
+      }
+    }
+  }
+
+  /* Returns the outputs computed by the last update */
+  const double* Outputs() const {
+    return outputs.data();
+  }
+  double Output(size_t index) const {
+    return outputs[index];
+  }
+
+private:
+  /* The update loop, kept free of member accesses so that the compiler can
+     prove the arrays do not alias and vectorise it */
+  static void UpdateKernel(size_t n, const double* errors, double timestep,
+    const double* __restrict kp, const double* __restrict kd, const double* __restrict ki,
+    const double* __restrict low, const double* __restrict high,
+    double* __restrict last, double* __restrict integral, double* __restrict res) {
+    for (size_t k = 0; k < n; k++) {
+      double new_error = errors[k];
+
+      /* same operations, in the same order, as PIDController */
+      integral[k] += new_error * timestep;
+      double error_diff = (new_error - last[k]) / timestep;
+
+      double p = kp[k] * new_error;
+      double i = ki[k] * integral[k];
+      double d = kd[k] * error_diff;
+
+      last[k] = new_error;
+
+      /* same clamping as ClampedPIDController, written as two independent
+         selects so that it compiles to blends rather than branches */
+      double y = p + i + d;
+      double y_low = (y < low[k]) ? low[k] : y;
+      res[k] = (y > high[k]) ? high[k] : y_low;
+    }
+  }
+
+  std::vector<double> p_coeffs, d_coeffs, i_coeffs;
+  std::vector<double> clampLow, clampHigh;
+
+  std::vector<double> last_errors;
+  std::vector<double> error_integrals;
+  std::vector<double> outputs;
+};
+
+#endif
@@ -1,18 +1,59 @@
 #ifndef PIDCONTROLLER_H
 #define PIDCONTROLLER_H
 
-#include "common\siso_blocks.h"
+#include <limits>
+
+#include "common/siso_blocks.h"
 
 /* 
   Provides a simple and output clamped PID controller for use in simulations.
 */
 
-/* Generic PID controller */
-class PIDController : public SISOBlock
+/*
+  Statically dispatched PID controller, with optional clamping of the output.
+  PIDController and ClampedPIDController are implemented with this.
+
+  By default the derivative is the raw difference of the error between
+  updates, which amplifies measurement noise more the shorter the timestep.
+  Two options reduce this, and leave the results unchanged unless set:
+  * SetDerivativeFilter(n) low-pass filters the derivative term, which
+    becomes d_coeff * n s / (s + n): it acts as a derivative below n rad/s
+    and as a fixed gain of d_coeff * n above
+  * SetSetpointWeights(b, c) applies the proportional term to b * setpoint -
+    measurement and the derivative term to c * setpoint - measurement, when
+    updated with Update(setpoint, measurement, timestep). c = 0 gives
+    derivative on measurement, so steps in the setpoint do not kick the
+    output; b < 1 softens the proportional response to them. The integral
+    always acts on the full error.
+*/
+class PID : public StaticSISOBlock<PID>
 {
+  friend class StaticSISOBlock<PID>;
 public:
-  PIDController(double p_coeff, double d_coeff, double i_coeff)
-    : p_coeff(p_coeff), d_coeff(d_coeff), i_coeff(i_coeff), last_error(0), error_integral(0) {}
+  PID(double p_coeff, double d_coeff, double i_coeff,
+    double lowClamp = -std::numeric_limits<double>::infinity(),
+    double highClamp = std::numeric_limits<double>::infinity())
+    : p_coeff(p_coeff), d_coeff(d_coeff), i_coeff(i_coeff), clampLow(lowClamp), clampHigh(highClamp),
+      filter_time_constant(0), setpoint_weight_p(1), setpoint_weight_d(1),
+      last_error(0), error_integral(0), filtered_error_diff(0),
+      last_p_error(0), last_error_diff(0), output_offset(0), fading_offset(0) {}
+
+  /* Time constant over which SetGainsBumpless fades out a change in
+     proportional or derivative gain, when there is no integral gain */
+  static constexpr double BUMPLESS_FADE_S = 1;
+
+  using StaticSISOBlock<PID>::Update;
+
+  /* Updates from the setpoint and measurement separately, applying the
+     setpoint weights. Update(error, timestep) is the same as
+     Update(error, 0, timestep) with both weights 1. */
+  double Update(double setpoint, double measurement, double timestep) {
+    if (!(timestep > 0)) {
+      return Output();
+    }
+    return SetOutput(Compute(setpoint_weight_p * setpoint - measurement, setpoint - measurement,
+      setpoint_weight_d * setpoint - measurement, timestep));
+  }
 
   void SetPCoefficient(double val) {
     p_coeff = val;
@@ -24,6 +65,44 @@ public:
     i_coeff = val;
   }
 
+  /*
+    Sets the gains without a step in the output, for retuning a running
+    controller: the output the new gains would have given on the last update
+    is made equal to the one the old gains gave, by absorbing the difference
+    into the integral, so only the error from now on sees the new gains.
+
+    With an integral gain of 0 there is no integral to absorb it into. The
+    integral term the controller had, e.g. the trim it was holding, is then
+    held as a fixed offset, and the difference from the proportional and
+    derivative gains is faded out over BUMPLESS_FADE_S, as nothing would
+    correct a bias left in its place. Both are folded back into the integral
+    when the integral gain is set again.
+  */
+  void SetGainsBumpless(double p, double d, double i) {
+    if (p == p_coeff && d == d_coeff && i == i_coeff) {
+      return;
+    }
+    double difference = (p_coeff - p) * last_p_error + (d_coeff - d) * last_error_diff;
+    if (i != 0) {
+      error_integral = (difference + i_coeff * error_integral + output_offset + fading_offset) / i;
+      output_offset = 0;
+      fading_offset = 0;
+    }
+    else {
+      output_offset += i_coeff * error_integral;
+      error_integral = 0;
+      fading_offset += difference;
+    }
+    p_coeff = p;
+    d_coeff = d;
+    i_coeff = i;
+  }
+
+  /* Sets the integral gain without a step in the output, see SetGainsBumpless */
+  void SetICoefficientBumpless(double val) {
+    SetGainsBumpless(p_coeff, d_coeff, val);
+  }
+
   double GetPCoefficient() const {
     return p_coeff;
   }
@@ -34,26 +113,183 @@ public:
     return i_coeff;
   }
 
+  /* Set the clamping limits */
+  void SetClampingLimits(double lower, double higher) {
+    clampLow = lower;
+    clampHigh = higher;
+  }
+
+  /* Return lower clamping limit */
+  double GetClampLowLimit() const {
+    return clampLow;
+  }
+
+  /* Return higher clamping limit */
+  double GetClampHighLimit() const {
+    return clampHigh;
+  }
+
+  /* Filters the derivative term with a first order low-pass filter of
+     bandwidth n rad/s, or turns the filter off if n is 0 or infinite */
+  void SetDerivativeFilter(double n) {
+    filter_time_constant = (n > 0) ? 1 / n : 0;
+  }
+
+  /* Return the derivative filter bandwidth, 0 if unfiltered */
+  double GetDerivativeFilter() const {
+    return (filter_time_constant > 0) ? 1 / filter_time_constant : 0;
+  }
+
+  /* Set the weights of the setpoint in the proportional (b) and derivative
+     (c) terms, used by Update(setpoint, measurement, timestep) */
+  void SetSetpointWeights(double b, double c) {
+    setpoint_weight_p = b;
+    setpoint_weight_d = c;
+  }
+
+  double GetSetpointWeightP() const {
+    return setpoint_weight_p;
+  }
+  double GetSetpointWeightD() const {
+    return setpoint_weight_d;
+  }
+
 protected:
   /* Internal PID calculation */
-  virtual double InternalUpdate(double new_error, double timestep) override {
-    error_integral += new_error * timestep;
-    double error_diff = (new_error - last_error) / timestep;
+  double InternalUpdate(double new_error, double timestep) {
+    return Compute(new_error, new_error, new_error, timestep);
+  }
 
-    double p = p_coeff * new_error;
+private:
+  /* The PID calculation, from the errors seen by each term */
+  double Compute(double p_error, double i_error, double d_error, double timestep) {
+    error_integral += i_error * timestep;
+    double error_diff;
+    if (filter_time_constant > 0) {
+      /* backward difference of d/dt / (tf s + 1), stable for any timestep */
+      filtered_error_diff = (filter_time_constant * filtered_error_diff + (d_error - last_error)) /
+        (filter_time_constant + timestep);
+      error_diff = filtered_error_diff;
+    }
+    else {
+      error_diff = (d_error - last_error) / timestep;
+    }
+
+    double p = p_coeff * p_error;
     double i = i_coeff * error_integral;
     double d = d_coeff * error_diff;
 
-    last_error = new_error;
+    last_error = d_error;
+    last_p_error = p_error;
+    last_error_diff = error_diff;
 
-    return p + i + d;
+    double res = p + i + d;
+    if (output_offset != 0 || fading_offset != 0) {
+      res += output_offset + fading_offset;
+      fading_offset *= BUMPLESS_FADE_S / (BUMPLESS_FADE_S + timestep);
+    }
+    if (res > clampHigh) {
+      res = clampHigh;
+    }
+    else if (res < clampLow) {
+      res = clampLow;
+    }
+    return res;
   }
 
-private:
-  double p_coeff, d_coeff, i_coeff; 
+  double p_coeff, d_coeff, i_coeff;
+  double clampLow, clampHigh;
+
+  double filter_time_constant;
+  double setpoint_weight_p, setpoint_weight_d;
 
-  double last_error;
+  double last_error;        /* last error seen by the derivative term */
   double error_integral;
+  double filtered_error_diff;
+
+  /* the errors seen by the proportional and derivative terms on the last
+     update, and the offsets added by SetGainsBumpless with no integral gain */
+  double last_p_error;
+  double last_error_diff;
+  double output_offset;
+  double fading_offset;
+};
+
+/* Statically dispatched PID controller, with clamping */
+class ClampedPID : public PID
+{
+public:
+  ClampedPID(double p_coeff, double d_coeff, double i_coeff, double lowClamp, double highClamp)
+    : PID(p_coeff, d_coeff, i_coeff, lowClamp, highClamp) {};
+};
+
+/* Generic PID controller */
+class PIDController : public SISOBlock
+{
+public:
+  PIDController(double p_coeff, double d_coeff, double i_coeff)
+    : pid(p_coeff, d_coeff, i_coeff) {}
+
+  using SISOBlock::Update;
+
+  /* Updates from the setpoint and measurement separately, see PID */
+  double Update(double setpoint, double measurement, double timestep) {
+    if (!(timestep > 0)) {
+      return Output();
+    }
+    return SetOutput(pid.Update(setpoint, measurement, timestep));
+  }
+
+  void SetPCoefficient(double val) {
+    pid.SetPCoefficient(val);
+  }
+  void SetDCoefficient(double val) {
+    pid.SetDCoefficient(val);
+  }
+  void SetICoefficient(double val) {
+    pid.SetICoefficient(val);
+  }
+  void SetGainsBumpless(double p, double d, double i) {
+    pid.SetGainsBumpless(p, d, i);
+  }
+  void SetICoefficientBumpless(double val) {
+    pid.SetICoefficientBumpless(val);
+  }
+
+  double GetPCoefficient() const {
+    return pid.GetPCoefficient();
+  }
+  double GetDCoefficient() const {
+    return pid.GetDCoefficient();
+  }
+  double GetICoefficient() const {
+    return pid.GetICoefficient();
+  }
+
+  /* Derivative filter and setpoint weights, see PID */
+  void SetDerivativeFilter(double n) {
+    pid.SetDerivativeFilter(n);
+  }
+  double GetDerivativeFilter() const {
+    return pid.GetDerivativeFilter();
+  }
+  void SetSetpointWeights(double b, double c) {
+    pid.SetSetpointWeights(b, c);
+  }
+  double GetSetpointWeightP() const {
+    return pid.GetSetpointWeightP();
+  }
+  double GetSetpointWeightD() const {
+    return pid.GetSetpointWeightD();
+  }
+
+protected:
+  /* Internal PID calculation */
+  virtual double InternalUpdate(double new_error, double timestep) override {
+    return pid.Update(new_error, timestep);
+  }
+
+  PID pid;
 };
 
 /* PID controller, with clamping */
@@ -61,39 +297,24 @@ class ClampedPIDController : public PIDController
 {
 public:
   ClampedPIDController(double p_coeff, double d_coeff, double i_coeff, double lowClamp, double highClamp)
-    : PIDController(p_coeff, d_coeff, i_coeff), clampLow(lowClamp), clampHigh(highClamp) {};
+    : PIDController(p_coeff, d_coeff, i_coeff) {
+    pid.SetClampingLimits(lowClamp, highClamp);
+  }
 
   /* Set the clamping limits */
   void SetClampingLimits(double lower, double higher) {
-    clampLow = lower;
-    clampHigh = higher;
+    pid.SetClampingLimits(lower, higher);
   }
 
   /* Return lower clamping limit */
   double GetClampLowLimit() const {
-    return clampLow;
+    return pid.GetClampLowLimit();
   }
 
   /* Return higher clamping limit */
   double GetClampHighLimit() const {
-    return clampHigh;
+    return pid.GetClampHighLimit();
   }
-
-protected:
-  /* Update and clamp output */
-  virtual double InternalUpdate(double new_error, double timestep) override {
-    double res = PIDController::InternalUpdate(new_error, timestep);
-    if (res > clampHigh) {
-      res = clampHigh;
-    }
-    else if (res < clampLow) {
-      res = clampLow;
-    }
-    return res;
-  }
-
-private:
-  double clampLow, clampHigh;
 };
 
 #endif
@@ -0,0 +1,221 @@
+#ifndef AIRCRAFT_MODEL_H
+#define AIRCRAFT_MODEL_H
+
+#include "common/siso_blocks.h"
+#include "common/state_space.h"
+#include "common/util.h"
+
+/*
+  A simple aircraft model, used to run the controllers offline without a
+  simulator attached.
+
+  The roll mode is modelled as a first order response of the roll rate to the
+  aileron deflection, the bank angle is the integral of the roll rate and the
+  heading changes according to a coordinated turn at constant airspeed.
+
+  The pitch and yaw axes are modelled separately, so that they do not change
+  the lateral motion flown by the examples which only use the ailerons:
+  * the pitch rate is a first order response to the elevator (the short
+    period mode), and the pitch angle its integral. The load factor is that
+    of holding the pitch angle in the current bank, plus the pull-up from the
+    pitch rate: cos(pitch) / cos(bank) + V q / g. The airspeed and altitude
+    stay constant.
+  * the Dutch roll is a lightly damped oscillation of the yaw rate, kicked
+    by the rudder and by adverse yaw from the ailerons, on top of the yaw
+    rate of the turn. It does not change the heading.
+
+  Sign conventions follow the SimVars used by the examples:
+  * bank angle is positive when banked left ("PLANE BANK DEGREES")
+  * roll rate is positive when rolling right
+  * positive aileron deflection rolls the aircraft right
+  * pitch angle is positive nose down ("PLANE PITCH DEGREES")
+  * pitch rate is positive nose up
+  * yaw rate is positive nose right ("ROTATION VELOCITY BODY Y")
+  * positive elevator deflection pitches the nose up, and positive rudder
+    deflection yaws it right
+
+  In SimConnect's body frame X is the lateral axis, Y the vertical axis
+  and Z the longitudinal axis, so the roll rate is "ROTATION VELOCITY BODY
+  Z" and the yaw rate "ROTATION VELOCITY BODY Y". The roll examples have
+  always read the roll rate from "ROTATION VELOCITY BODY X", so the local
+  simulator serves the roll rate there too; that is a convention of the
+  local simulator only, not the SimVar's meaning in FSX.
+*/
+
+/* Aircraft specific parameters: defaults approximate a 737-800 in cruise */
+struct AircraftParameters {
+  double roll_time_constant_s = 0.5;    /* roll mode time constant */
+  double roll_rate_per_aileron = 0.5;   /* steady roll rate per unit aileron (rad/s) */
+  double true_airspeed_m_s = 230;       /* constant true airspeed */
+  double indicated_airspeed_kts = 280;  /* constant indicated airspeed */
+  double altitude_ft = 35000;           /* constant altitude */
+
+  double pitch_time_constant_s = 0.6;   /* short period time constant */
+  double pitch_rate_per_elevator = 0.08;  /* steady pitch rate per unit elevator (rad/s) */
+
+  double dutch_roll_frequency_rad_s = 1.3;
+  double dutch_roll_damping = 0.05;
+  double yaw_acceleration_per_rudder = 0.6;  /* initial yaw acceleration per unit rudder (rad/s^2) */
+  double adverse_yaw_per_aileron = -0.15;    /* rudder equivalent of the yaw from the ailerons */
+
+  /* Discretisation of the roll mode and of the short period mode. Euler
+     matches the examples' behaviour against the local simulator; the exact
+     method stays accurate at much longer timesteps, for offline simulation. */
+  Discretisation roll_discretisation = DISCRETISE_EULER;
+  Discretisation pitch_discretisation = DISCRETISE_EULER;
+};
+
+/* Initial conditions */
+struct AircraftState {
+  double bank_rad = 0;         /* positive left */
+  double roll_rate_rad_s = 0;  /* positive rolling right */
+  double heading_rad = 0;      /* true heading in the range [0, 2pi) */
+  double pitch_rad = 0;        /* positive nose down */
+  double pitch_rate_rad_s = 0; /* positive nose up */
+};
+
+/* Simulates the roll, heading, pitch and yaw of an aircraft */
+class AircraftModel
+{
+public:
+  typedef AircraftParameters Parameters;
+  typedef AircraftState State;
+
+  AircraftModel(const Parameters& params = Parameters(), const State& initial = State())
+    : params(params),
+      rollResponse(params.roll_time_constant_s, 1, initial.roll_rate_rad_s, params.roll_discretisation),
+      rightBank(-initial.bank_rad), heading(initial.heading_rad), aileron(0),
+      pitchResponse(params.pitch_time_constant_s, 1, initial.pitch_rate_rad_s, params.pitch_discretisation),
+      noseUpPitch(-initial.pitch_rad), dutchRoll(DutchRoll(params)), elevator(0), rudder(0),
+      turn_rate(TurnRate(-initial.bank_rad)) {}
+
+  /* Sets the aileron deflection, clamped to [-1, 1] */
+  void SetAileron(double position) {
+    aileron = (position > 1) ? 1 : (position < -1) ? -1 : position;
+  }
+
+  /* Sets the elevator deflection, clamped to [-1, 1] */
+  void SetElevator(double position) {
+    elevator = (position > 1) ? 1 : (position < -1) ? -1 : position;
+  }
+
+  /* Sets the rudder deflection, clamped to [-1, 1] */
+  void SetRudder(double position) {
+    rudder = (position > 1) ? 1 : (position < -1) ? -1 : position;
+  }
+
+  /* Advances the model by timestep seconds */
+  void Step(double timestep) {
+    double last_roll_rate = rollResponse.Output();
+    double steady_roll_rate = params.roll_rate_per_aileron * aileron;
+    double roll_rate = rollResponse.Update(steady_roll_rate, timestep);
+    double bank = rightBank.Update(MeanRate(params.roll_discretisation, params.roll_time_constant_s,
+      last_roll_rate, steady_roll_rate, roll_rate, timestep), timestep);
+
+    double heading_rate = TurnRate(bank);
+    heading = std::fmod(heading + heading_rate * timestep, 2 * PI);
+    if (heading < 0) {
+      heading += 2 * PI;
+    }
+    turn_rate = heading_rate;
+
+    /* pitch and yaw, which do not feed back into the lateral motion */
+    double last_pitch_rate = pitchResponse.Output();
+    double steady_pitch_rate = params.pitch_rate_per_elevator * elevator;
+    double pitch_rate = pitchResponse.Update(steady_pitch_rate, timestep);
+    noseUpPitch.Update(MeanRate(params.pitch_discretisation, params.pitch_time_constant_s,
+      last_pitch_rate, steady_pitch_rate, pitch_rate, timestep), timestep);
+    dutchRoll.Update(rudder + params.adverse_yaw_per_aileron * aileron, timestep);
+  }
+
+  double BankRad() const {
+    return -rightBank.Output();
+  }
+  double RollRateRad_s() const {
+    return rollResponse.Output();
+  }
+  double HeadingRad() const {
+    return heading;
+  }
+  double Aileron() const {
+    return aileron;
+  }
+  double PitchRad() const {
+    return -noseUpPitch.Output();
+  }
+  double PitchRateRad_s() const {
+    return pitchResponse.Output();
+  }
+  double YawRateRad_s() const {
+    return turn_rate + dutchRoll.Output();
+  }
+  double LoadFactor() const {
+    return std::cos(noseUpPitch.Output()) / std::cos(BankRad()) +
+      params.true_airspeed_m_s * pitchResponse.Output() / G;
+  }
+  double Elevator() const {
+    return elevator;
+  }
+  double Rudder() const {
+    return rudder;
+  }
+  const Parameters& GetParameters() const {
+    return params;
+  }
+
+private:
+  static constexpr double PI = 3.14159265358979323846;
+  static constexpr double G = 9.80665;
+
+  /* coordinated turn: heading rate = g tan(bank) / V, with the bank positive right */
+  double TurnRate(double right_bank) const {
+    return G * std::tan(right_bank) / params.true_airspeed_m_s;
+  }
+
+  /* mean over a step of a rate following a first order response, for
+     integrating it into an angle: with Euler the new rate, as it always has
+     been, otherwise as accurately as the response itself */
+  static double MeanRate(Discretisation method, double tau, double last_rate, double steady_rate,
+    double rate, double timestep) {
+    switch (method) {
+    case DISCRETISE_EULER:
+      return rate;
+    case DISCRETISE_EXACT:
+      return steady_rate + (last_rate - steady_rate) * tau * -std::expm1(-timestep / tau) / timestep;
+    default:
+      return 0.5 * (last_rate + rate);
+    }
+  }
+
+  /* yaw rate of the Dutch roll per unit rudder: N s / (s^2 + 2 zeta w s + w^2),
+     so the rudder accelerates the yaw but holds no steady yaw rate */
+  static StateSpace<2> DutchRoll(const Parameters& params) {
+    double w = params.dutch_roll_frequency_rad_s;
+    const double num[] = { 0, params.yaw_acceleration_per_rudder, 0 };
+    const double den[] = { 1, 2 * params.dutch_roll_damping * w, w * w };
+    return StateSpace<2>::FromTransferFunction(num, den);
+  }
+
+  Parameters params;
+
+  /* roll rate response to the aileron, tau dp/dt + p = K aileron */
+  FirstOrderResponseBlock rollResponse;
+  /* bank angle, positive right (the opposite sense to the SimVar) */
+  IntegratorBlock rightBank;
+
+  double heading;
+  double aileron;
+
+  /* pitch rate response to the elevator, and the pitch angle positive nose
+     up (the opposite sense to the SimVar) */
+  FirstOrderResponseBlock pitchResponse;
+  IntegratorBlock noseUpPitch;
+  /* yaw rate of the Dutch roll */
+  StateSpace<2> dutchRoll;
+
+  double elevator;
+  double rudder;
+  double turn_rate;   /* yaw rate of the coordinated turn */
+};
+
+#endif
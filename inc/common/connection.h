@@ -0,0 +1,45 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+/*
+  Opens the connection to the simulator, waiting for it to start if it is
+  not running yet:
+
+    OpenSimConnect(&hSimConnect, "Airbus Roll Control Law", hDispatchEvent);
+
+  SimConnect_Open fails straight away while the simulator is not running,
+  so rather than being retried in a busy loop, which keeps a CPU busy for as
+  long as the simulator takes to start, it is retried after a delay which
+  doubles from 50 ms up to max_delay_ms.
+
+  Returns false without retrying if SimConnect_Open fails with E_INVALIDARG,
+  which waiting will not fix (e.g. the local simulator given a recording to
+  replay that it cannot read).
+
+  SimConnect.h must be included first.
+*/
+inline bool OpenSimConnect(HANDLE* phSimConnect, LPCSTR name, HANDLE hEventHandle, unsigned max_delay_ms = 2000) {
+  unsigned delay_ms = 50;
+  bool waiting = false;
+  for (;;) {
+    HRESULT result = SimConnect_Open(phSimConnect, name, NULL, 0, hEventHandle, 0);
+    if (result == S_OK) {
+      return true;
+    }
+    if (result == E_INVALIDARG) {
+      return false;
+    }
+    if (!waiting) {
+      printf("Waiting for the simulator...\n");
+      waiting = true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+    delay_ms = (delay_ms * 2 < max_delay_ms) ? delay_ms * 2 : max_delay_ms;
+  }
+}
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef CONTROL_PIPELINE_H
+#define CONTROL_PIPELINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "common/latency_histogram.h"
+#include "common/spsc_ring.h"
+#include "common/util.h"
+
+/*
+  Runs the control loops on a thread of their own, fed from the thread that
+  talks to SimConnect, so that the loops never wait on SimConnect, the
+  console or a recording file:
+
+  * the I/O thread calls SimConnect_CallDispatch, decodes each frame into an
+    Input record and posts it to the control thread through a lock-free ring
+  * the control thread, which may be pinned to a CPU and given real-time
+    priority, runs the loops on the newest Input waiting and posts an Output
+    record back through a second ring, signalling the I/O thread's event
+  * the I/O thread collects the outputs and sends them to the simulator
+
+    ControlPipeline<ControlInputs, structControlOutputs> pipeline(RunControlLoops);
+    pipeline.Start(hDispatchEvent, ControlThreadOptions::FromEnvironment());
+    ...
+    pipeline.Post(inputs);                   // I/O thread, as a frame is received
+    ...
+    while (pipeline.Collect(outputs)) { ... }   // I/O thread, when the event is signalled
+    ...
+    pipeline.Stop();                          // runs the newest frame still queued
+
+  Neither thread ever blocks on the other. If frames arrive faster than the
+  loops run, the control thread skips the stale ones and runs only the
+  newest, and a full ring drops the frame posted; both are counted. An empty
+  ring is waited on with an event, or polled when spinning. The time from
+  each frame being posted to its output being
+  collected is recorded, along with its jitter (the change in that latency
+  from one frame to the next) and the time the loops took, and printed by
+  PrintStats.
+
+  Input and Output are copied through the rings, so they should be small,
+  trivially copyable records. All the members except the constructor and
+  Control callback are called from the I/O thread. windows.h, or the local
+  simulator's SimConnect.h, must be included first for the events.
+*/
+
+/* How the control thread is scheduled. A spinning thread with real-time
+   priority never gives up its CPU to the I/O thread, so it should be pinned
+   to a CPU nothing else runs on. */
+struct ControlThreadOptions {
+  int cpu = -1;                   /* pin the thread to this CPU, -1 to leave it to the OS */
+  bool realtime_priority = false; /* SCHED_FIFO, or THREAD_PRIORITY_TIME_CRITICAL on Windows */
+  bool spin = false;              /* poll for frames rather than sleep until one is posted */
+
+  /* Reads the options from the environment variables CONTROL_THREAD_CPU,
+     CONTROL_THREAD_REALTIME and CONTROL_THREAD_SPIN (either set to enable) */
+  static ControlThreadOptions FromEnvironment() {
+    ControlThreadOptions options;
+    std::string cpu = Environment("CONTROL_THREAD_CPU");
+    if (!cpu.empty()) {
+      options.cpu = std::atoi(cpu.c_str());
+    }
+    options.realtime_priority = !Environment("CONTROL_THREAD_REALTIME").empty();
+    options.spin = !Environment("CONTROL_THREAD_SPIN").empty();
+    return options;
+  }
+
+private:
+  static std::string Environment(const char* variable) {
+    std::string res;
+#ifdef _WIN32
+    char* value = nullptr;
+    size_t length = 0;
+    if (_dupenv_s(&value, &length, variable) == 0 && value) {
+      res = value;
+      free(value);
+    }
+#else
+    const char* value = getenv(variable);
+    if (value) {
+      res = value;
+    }
+#endif
+    return res;
+  }
+};
+
+template <typename Input, typename Output, size_t Capacity = 16>
+class ControlPipeline
+{
+public:
+  /* Runs the loops on one frame's inputs, on the control thread */
+  typedef void (*Control)(const Input& input, Output& output);
+
+  explicit ControlPipeline(Control control)
+    : control(control) {}
+
+  ControlPipeline(const ControlPipeline&) = delete;
+  ControlPipeline& operator=(const ControlPipeline&) = delete;
+
+  ~ControlPipeline() {
+    Stop();
+  }
+
+  /* Starts the control thread, which signals ready whenever it posts an
+     output (e.g. the event passed to SimConnect_Open, so that the I/O thread
+     waits on one event for both) */
+  void Start(HANDLE ready, const ControlThreadOptions& thread_options) {
+    if (control_thread.joinable()) {
+      return;
+    }
+    ready_event = ready;
+    options = thread_options;
+    input_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    stopping.store(false);
+    control_thread = std::thread(&ControlPipeline::Run, this);
+  }
+
+  /* Runs the newest frame already posted and stops the control thread; its
+     output can still be collected */
+  void Stop() {
+    if (!control_thread.joinable()) {
+      return;
+    }
+    stopping.store(true);
+    SetEvent(input_event);
+    control_thread.join();
+    CloseHandle(input_event);
+  }
+
+  /* Posts a frame's inputs to the control thread, returns false if it was
+     dropped because the control thread has fallen a whole ring behind */
+  bool Post(const Input& input) {
+    InputSlot slot;
+    slot.input = input;
+    slot.posted_ns = MonotonicTimeNs();
+    if (!inputs.TryPush(slot)) {
+      dropped++;
+      return false;
+    }
+    posted++;
+    if (!options.spin) {
+      SetEvent(input_event);
+    }
+    return true;
+  }
+
+  /* Takes the oldest output waiting, returns false if there is none */
+  bool Collect(Output& output) {
+    OutputSlot slot;
+    if (!outputs.TryPop(slot)) {
+      return false;
+    }
+    output = slot.output;
+    collected++;
+
+    uint64_t latency_ns = MonotonicTimeNs() - slot.posted_ns;
+    latency.Record(latency_ns);
+    if (collected > 1) {
+      jitter.Record(latency_ns > last_latency_ns ? latency_ns - last_latency_ns : last_latency_ns - latency_ns);
+    }
+    last_latency_ns = latency_ns;
+    control_time.Record(slot.control_ns);
+    return true;
+  }
+
+  /* Frames posted that have been neither run and collected nor skipped
+     (an estimate while the control thread is running, as it may be
+     skipping frames) */
+  size_t InFlight() const {
+    uint64_t done = collected + skipped.load();
+    return (posted > done) ? static_cast<size_t>(posted - done) : 0;
+  }
+
+  /* Prints how the control thread ran, once it has stopped */
+  void PrintStats(FILE* out) const {
+    fprintf(out, "Control thread: %s, %s priority, %s; %llu frames, %llu skipped as stale, %llu dropped\n",
+      (options.cpu < 0) ? "not pinned" : (pinned ? "pinned" : "could not be pinned"),
+      !options.realtime_priority ? "normal" : (raised ? "real-time" : "could not raise"),
+      options.spin ? "spinning" : "waiting on an event",
+      static_cast<unsigned long long>(collected), static_cast<unsigned long long>(skipped.load()),
+      static_cast<unsigned long long>(dropped));
+    latency.Print(out, "Frame to output latency");
+    jitter.Print(out, "Frame to output jitter");
+    control_time.Print(out, "Control loops");
+  }
+
+private:
+  struct InputSlot {
+    Input input;
+    uint64_t posted_ns;
+  };
+
+  struct OutputSlot {
+    Output output;
+    uint64_t posted_ns;    /* when the frame's inputs were posted */
+    uint64_t control_ns;   /* time taken by the loops */
+  };
+
+  void Run() {
+    if (options.cpu >= 0) {
+      pinned = PinCurrentThread(options.cpu);
+    }
+    if (options.realtime_priority) {
+      raised = RaiseCurrentThreadPriority();
+    }
+
+    InputSlot in;
+    OutputSlot out;
+    for (;;) {
+      bool stop = stopping.load();
+      while (inputs.TryPop(in)) {
+        /* run the newest frame, skipping any that arrived while the loops
+           ran the last one */
+        while (inputs.TryPop(in)) {
+          skipped++;
+        }
+        uint64_t start_ns = MonotonicTimeNs();
+        control(in.input, out.output);
+        out.control_ns = MonotonicTimeNs() - start_ns;
+        out.posted_ns = in.posted_ns;
+
+        /* the I/O thread collects the outputs whenever it is signalled, so
+           this only waits if it falls a whole ring behind */
+        while (!outputs.TryPush(out)) {
+          std::this_thread::yield();
+        }
+        SetEvent(ready_event);
+      }
+      /* frames posted before stopping was set have all been run */
+      if (stop) {
+        break;
+      }
+      if (options.spin) {
+        std::this_thread::yield();
+      }
+      else {
+        WaitForSingleObject(input_event, INFINITE);
+      }
+    }
+  }
+
+  static bool PinCurrentThread(int cpu) {
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+  }
+
+  /* Usually needs elevated privileges, e.g. CAP_SYS_NICE on Linux */
+  static bool RaiseCurrentThreadPriority() {
+#ifdef _WIN32
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+    sched_param param;
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#endif
+  }
+
+  Control control;
+  ControlThreadOptions options;
+
+  HANDLE ready_event = NULL;
+  HANDLE input_event = NULL;
+  std::atomic<bool> stopping{ false };
+  std::thread control_thread;
+
+  /* written by the control thread, read once it has stopped */
+  bool pinned = false;
+  bool raised = false;
+
+  /* written by the control thread */
+  std::atomic<uint64_t> skipped{ 0 };
+
+  SPSCRing<InputSlot, Capacity> inputs;
+  SPSCRing<OutputSlot, Capacity> outputs;
+
+  /* I/O thread only */
+  uint64_t posted = 0;
+  uint64_t collected = 0;
+  uint64_t dropped = 0;
+  uint64_t last_latency_ns = 0;
+  LatencyHistogram latency;
+  LatencyHistogram jitter;
+  LatencyHistogram control_time;
+};
+
+#endif
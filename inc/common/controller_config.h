@@ -0,0 +1,327 @@
+#ifndef CONTROLLER_CONFIG_H
+#define CONTROLLER_CONFIG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  Controller parameters (gains, clamping limits, protection angles) read
+  from a config file, and reloaded while the client runs whenever the file
+  changes, so that a controller can be tuned without recompiling and
+  reconnecting.
+
+  The file holds one parameter per line as "name = value", with # starting
+  a comment, e.g.
+
+    # aileron roll rate controller
+    aileron_p = 10
+    max_bank_deg = 67
+
+  The parameters are held in a block of the client's own, parsed from the
+  file by a function it provides, which starts from the defaults so that
+  the file need only hold the parameters it changes:
+
+    struct RollParameters { double aileron_p = 10; ... };
+
+    bool ParseRollParameters(const ControllerConfig& config, RollParameters& params) {
+      config.Get("aileron_p", params.aileron_p);
+      ...
+      return params.aileron_p >= 0;   // false rejects the file
+    }
+
+    ReloadableConfig<RollParameters> parameters(RollParameters(), ParseRollParameters);
+    parameters.StartFromEnvironment("CONTROLLER_CONFIG");
+    ...
+    const RollParameters* params;
+    if (parameters.Acquire(params)) { ... }   // once a frame, true when they have changed
+    ...
+    parameters.Stop();
+
+  A background thread polls the file and parses each new version into a
+  second block, while the control path goes on reading the first, then
+  publishes it with an atomic store, so Acquire is a pair of atomic
+  operations and never waits for the file or a lock. As in read-copy-update,
+  a block is only reused once the control path has moved on from it: the
+  thread waits for the next Acquire before parsing again. Acquire is called
+  at the start of a frame, so the parameters only change between frames,
+  and a frame never sees some parameters from one version and some from
+  another.
+*/
+
+/* The parameters read from a config file */
+class ControllerConfig
+{
+public:
+  /* Parses the text of a config file, returns false if a line is neither
+     blank, a comment nor "name = value", leaving the line in error */
+  bool Parse(const std::string& text) {
+    values.clear();
+    used.clear();
+    error.clear();
+    size_t start = 0;
+    int line_number = 1;
+    while (start < text.size()) {
+      size_t end = text.find('\n', start);
+      if (end == std::string::npos) {
+        end = text.size();
+      }
+      std::string line = text.substr(start, end - start);
+      size_t comment = line.find('#');
+      if (comment != std::string::npos) {
+        line.erase(comment);
+      }
+      line = Trim(line);
+      if (!line.empty()) {
+        size_t equals = line.find('=');
+        std::string name = Trim(line.substr(0, (equals == std::string::npos) ? 0 : equals));
+        std::string value = (equals == std::string::npos) ? "" : Trim(line.substr(equals + 1));
+        char* value_end = nullptr;
+        double number = std::strtod(value.c_str(), &value_end);
+        if (name.empty() || value.empty() || *value_end != '\0') {
+          char message[64];
+          snprintf(message, sizeof(message), "line %d is not \"name = value\"", line_number);
+          error = message;
+          return false;
+        }
+        values[name] = number;
+      }
+      start = end + 1;
+      line_number++;
+    }
+    return true;
+  }
+
+  /* Sets value to the parameter's, returns false and leaves it unchanged if
+     the file does not set it */
+  bool Get(const char* name, double& value) const {
+    auto it = values.find(name);
+    if (it == values.end()) {
+      return false;
+    }
+    used.insert(it->first);
+    value = it->second;
+    return true;
+  }
+
+  /* The parameters set by the file which have not been read, e.g. misspelt */
+  std::vector<std::string> Unused() const {
+    std::vector<std::string> res;
+    for (const auto& value : values) {
+      if (used.count(value.first) == 0) {
+        res.push_back(value.first);
+      }
+    }
+    return res;
+  }
+
+  const std::string& Error() const {
+    return error;
+  }
+
+private:
+  static std::string Trim(const std::string& s) {
+    const char* SPACE = " \t\r";
+    size_t first = s.find_first_not_of(SPACE);
+    if (first == std::string::npos) {
+      return std::string();
+    }
+    return s.substr(first, s.find_last_not_of(SPACE) - first + 1);
+  }
+
+  std::map<std::string, double> values;
+  mutable std::set<std::string> used;
+  std::string error;
+};
+
+template <typename Params>
+class ReloadableConfig
+{
+public:
+  /* Parses the config into params, which hold the defaults, returns false
+     if the values are not acceptable */
+  typedef bool (*Parser)(const ControllerConfig& config, Params& params);
+
+  ReloadableConfig(const Params& defaults, Parser parse)
+    : parse(parse), defaults(defaults) {
+    blocks[0] = defaults;
+    blocks[1] = defaults;
+  }
+
+  ReloadableConfig(const ReloadableConfig&) = delete;
+  ReloadableConfig& operator=(const ReloadableConfig&) = delete;
+
+  ~ReloadableConfig() {
+    Stop();
+  }
+
+  /* Loads the file named by the environment variable, and watches it for
+     changes every poll_interval_s. Returns false only if the file is named
+     but could not be read or parsed, in which case it is still watched and
+     the defaults are used until it can be. */
+  bool StartFromEnvironment(const char* variable, double poll_interval_s = 0.5) {
+    std::string value;
+#ifdef _WIN32
+    char* env = nullptr;
+    size_t length = 0;
+    if (_dupenv_s(&env, &length, variable) == 0 && env) {
+      value = env;
+      free(env);
+    }
+#else
+    const char* env = getenv(variable);
+    if (env) {
+      value = env;
+    }
+#endif
+    if (value.empty()) {
+      return true;
+    }
+    return Start(value, poll_interval_s);
+  }
+
+  /* Loads the file at path, and watches it for changes */
+  bool Start(const std::string& config_path, double poll_interval_s = 0.5) {
+    if (watcher.joinable()) {
+      return true;
+    }
+    path = config_path;
+    poll_interval = std::chrono::milliseconds(static_cast<long long>(poll_interval_s * 1000));
+    bool loaded = Reload();
+    stopping.store(false);
+    watcher = std::thread(&ReloadableConfig::Watch, this);
+    return loaded;
+  }
+
+  void Stop() {
+    if (!watcher.joinable()) {
+      return;
+    }
+    stopping.store(true);
+    watcher.join();
+  }
+
+  /*
+    Points params at the latest parameters, returns true if they have changed
+    since the last call (and on the first). Called from the control path,
+    once a frame: params stays valid until the next call.
+  */
+  bool Acquire(const Params*& params) {
+    unsigned version = published.load(std::memory_order_acquire);
+    params = &blocks[version & 1];
+    if (version == acquired.load(std::memory_order_relaxed) && acquired_once) {
+      return false;
+    }
+    acquired_once = true;
+    acquired.store(version, std::memory_order_release);
+    return true;
+  }
+
+  /* Versions of the file loaded so far */
+  unsigned Reloads() const {
+    return published.load(std::memory_order_acquire);
+  }
+
+private:
+  void Watch() {
+    while (!stopping.load()) {
+      std::this_thread::sleep_for(poll_interval);
+      Reload();
+    }
+  }
+
+  /* Reads the file, and publishes its parameters if it has changed since the
+     last version loaded. Returns false if it could not be read or parsed. */
+  bool Reload() {
+    std::string text;
+    if (!ReadFile(text)) {
+      if (!read_failed) {
+        printf("Controller config: could not read %s\n", path.c_str());
+      }
+      read_failed = true;
+      return false;
+    }
+    read_failed = false;
+    if (text == last_text) {
+      return true;
+    }
+    last_text = text;
+
+    ControllerConfig config;
+    if (!config.Parse(text)) {
+      printf("Controller config: %s: %s, keeping the current parameters\n", path.c_str(), config.Error().c_str());
+      return false;
+    }
+
+    /* the control path may still be reading the block published before the
+       current one until its next Acquire, so wait for it to move on before
+       overwriting that block */
+    unsigned version = published.load(std::memory_order_relaxed);
+    while (acquired.load(std::memory_order_acquire) != version && !stopping.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (acquired.load(std::memory_order_acquire) != version) {
+      return false;
+    }
+
+    Params parsed = defaults;
+    if (!parse(config, parsed)) {
+      printf("Controller config: %s has values out of range, keeping the current parameters\n", path.c_str());
+      return false;
+    }
+    for (const std::string& name : config.Unused()) {
+      printf("Controller config: %s: unknown parameter %s ignored\n", path.c_str(), name.c_str());
+    }
+    blocks[(version + 1) & 1] = parsed;
+    published.store(version + 1, std::memory_order_release);
+    printf("Controller config: loaded %s (version %u)\n", path.c_str(), version + 1);
+    return true;
+  }
+
+  bool ReadFile(std::string& text) const {
+    FILE* file = nullptr;
+#ifdef _WIN32
+    if (fopen_s(&file, path.c_str(), "r") != 0) {
+      file = nullptr;
+    }
+#else
+    file = fopen(path.c_str(), "r");
+#endif
+    if (!file) {
+      return false;
+    }
+    char buffer[512];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      text.append(buffer, read);
+    }
+    fclose(file);
+    return true;
+  }
+
+  Parser parse;
+  Params defaults;
+  Params blocks[2];
+
+  /* the version published by the watcher, in blocks[version & 1], and the
+     last version acquired by the control path */
+  std::atomic<unsigned> published{ 0 };
+  std::atomic<unsigned> acquired{ 0 };
+  bool acquired_once = false;   /* control path only */
+
+  /* watcher thread only, and Start before it runs */
+  std::string path;
+  std::string last_text;
+  bool read_failed = false;
+  std::chrono::milliseconds poll_interval{ 500 };
+  std::atomic<bool> stopping{ false };
+  std::thread watcher;
+};
+
+#endif
@@ -0,0 +1,453 @@
+#ifndef FLIGHT_RECORDING_H
+#define FLIGHT_RECORDING_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "common/util.h"
+
+/*
+  Recording of the messages a SimConnect client receives and the data it
+  sends, so that a flight can be replayed into the controllers without the
+  simulator (see LOCALSIM_REPLAY in inc/localsim/LocalSimConnect.h).
+
+  A recording is an append-only file made of blocks of up to RECORDS_PER_BLOCK
+  records. Each block stores its records column by column: timestamps, kinds,
+  IDs, object IDs, sizes and payload offsets, followed by the payloads
+  themselves. A block is only written once complete (or when the recorder is
+  closed), so a recording cut short by a crash loses at most the last block.
+
+  FlightRecording maps a recording into memory and gives access to the
+  payloads in place, without copying. Payloads are 8-byte aligned, so a
+  received message can be passed straight to a dispatch handler.
+
+  All values are stored in the byte order of the recording machine.
+*/
+
+/* Kinds of record */
+enum FlightRecordKind : uint8_t {
+  FLIGHT_RECORD_RECEIVED = 0,   /* a message passed to the dispatch handler, id is its dwID */
+  FLIGHT_RECORD_OUTPUT = 1,     /* data set with SimConnect_SetDataOnSimObject, id is the define ID */
+};
+
+/* A single record, as read from a recording */
+struct FlightRecord {
+  FlightRecordKind kind;
+  uint32_t id;
+  uint32_t object_id;
+  uint32_t size;
+  uint64_t timestamp_ns;    /* time since the recording started */
+  void* data;
+};
+
+namespace flight_recording {
+
+const char FILE_MAGIC[8] = { 'S', 'C', 'F', 'L', 'I', 'G', 'H', 'T' };
+const uint32_t FILE_VERSION = 1;
+const uint32_t BLOCK_MAGIC = 0x4B4C4246;  /* "FBLK" */
+
+const uint32_t RECORDS_PER_BLOCK = 1024;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+/* Followed by the columns, each padded to a multiple of 8 bytes */
+struct BlockHeader {
+  uint32_t magic;
+  uint32_t count;           /* records in the block */
+  uint32_t payload_bytes;   /* size of the payload area, a multiple of 8 */
+  uint32_t reserved;
+};
+
+inline size_t Pad8(size_t bytes) {
+  return (bytes + 7) & ~static_cast<size_t>(7);
+}
+
+/* Size of the columns of a block of count records */
+inline size_t ColumnBytes(size_t count) {
+  return Pad8(count * sizeof(uint64_t)) + Pad8(count * sizeof(uint8_t)) +
+    4 * Pad8(count * sizeof(uint32_t));
+}
+
+} // namespace flight_recording
+
+/* Writes a recording */
+class FlightRecorder
+{
+public:
+  FlightRecorder()
+    : file(nullptr) {}
+
+  ~FlightRecorder() {
+    Close();
+  }
+
+  FlightRecorder(const FlightRecorder&) = delete;
+  FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+  /* Starts a new recording, returns false if the file could not be created */
+  bool Open(const char* path) {
+    Close();
+#ifdef _WIN32
+    if (fopen_s(&file, path, "wb") != 0) {
+      file = nullptr;
+    }
+#else
+    file = fopen(path, "wb");
+#endif
+    if (!file) {
+      return false;
+    }
+    flight_recording::FileHeader header;
+    std::memcpy(header.magic, flight_recording::FILE_MAGIC, sizeof(header.magic));
+    header.version = flight_recording::FILE_VERSION;
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, file);
+    start_ns = MonotonicTimeNs();
+    return true;
+  }
+
+  /* Starts a new recording if the given environment variable names a file.
+     Returns false only if the file could not be created. */
+  bool OpenFromEnvironment(const char* variable) {
+    std::string path;
+#ifdef _WIN32
+    char* value = nullptr;
+    size_t length = 0;
+    if (_dupenv_s(&value, &length, variable) == 0 && value) {
+      path = value;
+      free(value);
+    }
+#else
+    const char* value = getenv(variable);
+    if (value) {
+      path = value;
+    }
+#endif
+    return path.empty() || Open(path.c_str());
+  }
+
+  bool IsOpen() const {
+    return file != nullptr;
+  }
+
+  /* Records a message passed to the dispatch handler */
+  void RecordReceived(const void* message, uint32_t size) {
+    if (!file) {
+      return;
+    }
+    /* dwID follows dwSize and dwVersion in SIMCONNECT_RECV */
+    uint32_t id = 0;
+    if (size >= 3 * sizeof(uint32_t)) {
+      std::memcpy(&id, static_cast<const uint8_t*>(message) + 2 * sizeof(uint32_t), sizeof(id));
+    }
+    Record(FLIGHT_RECORD_RECEIVED, id, 0, message, size);
+  }
+
+  /* Records data sent with SimConnect_SetDataOnSimObject */
+  void RecordOutput(uint32_t define_id, uint32_t object_id, const void* data, uint32_t size) {
+    if (!file) {
+      return;
+    }
+    Record(FLIGHT_RECORD_OUTPUT, define_id, object_id, data, size);
+  }
+
+  /* Writes any buffered records and closes the recording */
+  void Close() {
+    if (!file) {
+      return;
+    }
+    WriteBlock();
+    fclose(file);
+    file = nullptr;
+  }
+
+private:
+  void Record(FlightRecordKind kind, uint32_t id, uint32_t object_id, const void* data, uint32_t size) {
+    timestamps.push_back(MonotonicTimeNs() - start_ns);
+    kinds.push_back(kind);
+    ids.push_back(id);
+    object_ids.push_back(object_id);
+    sizes.push_back(size);
+    offsets.push_back(static_cast<uint32_t>(payloads.size()));
+    payloads.resize(payloads.size() + flight_recording::Pad8(size), 0);
+    if (size > 0) {
+      std::memcpy(&payloads[offsets.back()], data, size);
+    }
+
+    if (timestamps.size() >= flight_recording::RECORDS_PER_BLOCK) {
+      WriteBlock();
+    }
+  }
+
+  /* Writes a column padded to a multiple of 8 bytes */
+  template <typename T>
+  void WriteColumn(const std::vector<T>& column) {
+    size_t bytes = column.size() * sizeof(T);
+    fwrite(column.data(), 1, bytes, file);
+    static const uint8_t padding[8] = {};
+    fwrite(padding, 1, flight_recording::Pad8(bytes) - bytes, file);
+  }
+
+  void WriteBlock() {
+    if (timestamps.empty()) {
+      return;
+    }
+    flight_recording::BlockHeader header;
+    header.magic = flight_recording::BLOCK_MAGIC;
+    header.count = static_cast<uint32_t>(timestamps.size());
+    header.payload_bytes = static_cast<uint32_t>(payloads.size());
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, file);
+
+    WriteColumn(timestamps);
+    WriteColumn(kinds);
+    WriteColumn(ids);
+    WriteColumn(object_ids);
+    WriteColumn(sizes);
+    WriteColumn(offsets);
+    fwrite(payloads.data(), 1, payloads.size(), file);
+
+    timestamps.clear();
+    kinds.clear();
+    ids.clear();
+    object_ids.clear();
+    sizes.clear();
+    offsets.clear();
+    payloads.clear();
+  }
+
+  FILE* file;
+  uint64_t start_ns;
+
+  /* columns of the block being built */
+  std::vector<uint64_t> timestamps;
+  std::vector<uint8_t> kinds;
+  std::vector<uint32_t> ids;
+  std::vector<uint32_t> object_ids;
+  std::vector<uint32_t> sizes;
+  std::vector<uint32_t> offsets;
+  std::vector<uint8_t> payloads;
+};
+
+/* A recording mapped into memory */
+class FlightRecording
+{
+public:
+  /* Position in a recording, records are read in order with Next */
+  struct Cursor {
+    size_t block = 0;
+    size_t row = 0;
+  };
+
+  FlightRecording()
+    : base(nullptr), length(0) {}
+
+  ~FlightRecording() {
+    Unmap();
+  }
+
+  FlightRecording(const FlightRecording&) = delete;
+  FlightRecording& operator=(const FlightRecording&) = delete;
+
+  /*
+    Maps a recording, returns false if it could not be read or is not a
+    recording. The mapping is copy-on-write: payloads may be modified in
+    memory, but the file is never changed. A truncated final block is ignored.
+  */
+  bool Open(const char* path) {
+    Unmap();
+    if (!Map(path)) {
+      return false;
+    }
+    if (length < sizeof(flight_recording::FileHeader)) {
+      Unmap();
+      return false;
+    }
+    const flight_recording::FileHeader* header = reinterpret_cast<const flight_recording::FileHeader*>(base);
+    if (std::memcmp(header->magic, flight_recording::FILE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != flight_recording::FILE_VERSION) {
+      Unmap();
+      return false;
+    }
+
+    /* index the blocks */
+    size_t offset = sizeof(flight_recording::FileHeader);
+    while (offset + sizeof(flight_recording::BlockHeader) <= length) {
+      const flight_recording::BlockHeader* block =
+        reinterpret_cast<const flight_recording::BlockHeader*>(base + offset);
+      size_t columns = offset + sizeof(flight_recording::BlockHeader);
+      size_t end = columns + flight_recording::ColumnBytes(block->count) + block->payload_bytes;
+      if (block->magic != flight_recording::BLOCK_MAGIC || end > length) {
+        break;
+      }
+      blocks.push_back(Block(base + columns, block->count, block->payload_bytes));
+      if (!blocks.back().Valid()) {
+        blocks.pop_back();
+        break;
+      }
+      count += block->count;
+      offset = end;
+    }
+    return true;
+  }
+
+  /* Number of records */
+  size_t Count() const {
+    return count;
+  }
+
+  /* Reads the record at the cursor and advances it, returns false at the end */
+  bool Next(Cursor& cursor, FlightRecord* record) const {
+    while (cursor.block < blocks.size() && cursor.row >= blocks[cursor.block].count) {
+      cursor.block++;
+      cursor.row = 0;
+    }
+    if (cursor.block >= blocks.size()) {
+      return false;
+    }
+    blocks[cursor.block].Get(cursor.row++, record);
+    return true;
+  }
+
+  /* As Next, but skips records of other kinds */
+  bool Next(Cursor& cursor, FlightRecordKind kind, FlightRecord* record) const {
+    while (Next(cursor, record)) {
+      if (record->kind == kind) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  /* Pointers to the columns of a block */
+  struct Block {
+    Block(uint8_t* columns, uint32_t count, uint32_t payload_bytes)
+      : count(count), payload_bytes(payload_bytes) {
+      timestamps = reinterpret_cast<const uint64_t*>(columns);
+      columns += flight_recording::Pad8(count * sizeof(uint64_t));
+      kinds = columns;
+      columns += flight_recording::Pad8(count * sizeof(uint8_t));
+      ids = reinterpret_cast<const uint32_t*>(columns);
+      columns += flight_recording::Pad8(count * sizeof(uint32_t));
+      object_ids = reinterpret_cast<const uint32_t*>(columns);
+      columns += flight_recording::Pad8(count * sizeof(uint32_t));
+      sizes = reinterpret_cast<const uint32_t*>(columns);
+      columns += flight_recording::Pad8(count * sizeof(uint32_t));
+      offsets = reinterpret_cast<const uint32_t*>(columns);
+      columns += flight_recording::Pad8(count * sizeof(uint32_t));
+      payloads = columns;
+    }
+
+    /* true if every payload lies within the block */
+    bool Valid() const {
+      for (uint32_t i = 0; i < count; i++) {
+        if (static_cast<uint64_t>(offsets[i]) + sizes[i] > payload_bytes) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    void Get(size_t row, FlightRecord* record) const {
+      record->kind = static_cast<FlightRecordKind>(kinds[row]);
+      record->id = ids[row];
+      record->object_id = object_ids[row];
+      record->size = sizes[row];
+      record->timestamp_ns = timestamps[row];
+      record->data = payloads + offsets[row];
+    }
+
+    uint32_t count;
+    uint32_t payload_bytes;
+    const uint64_t* timestamps;
+    const uint8_t* kinds;
+    const uint32_t* ids;
+    const uint32_t* object_ids;
+    const uint32_t* sizes;
+    const uint32_t* offsets;
+    uint8_t* payloads;
+  };
+
+  bool Map(const char* path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+      CloseHandle(file);
+      return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) {
+      return false;
+    }
+    base = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+    CloseHandle(mapping);
+    length = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return false;
+    }
+    void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    base = (mapped == MAP_FAILED) ? nullptr : static_cast<uint8_t*>(mapped);
+    length = static_cast<size_t>(st.st_size);
+    if (base) {
+      /* replay reads the file once, front to back */
+      madvise(base, length, MADV_SEQUENTIAL);
+    }
+#endif
+    if (!base) {
+      length = 0;
+    }
+    return base != nullptr;
+  }
+
+  void Unmap() {
+    if (base) {
+#ifdef _WIN32
+      UnmapViewOfFile(base);
+#else
+      munmap(base, length);
+#endif
+    }
+    base = nullptr;
+    length = 0;
+    blocks.clear();
+    count = 0;
+  }
+
+  uint8_t* base;
+  size_t length;
+  std::vector<Block> blocks;
+  size_t count = 0;
+};
+
+#endif
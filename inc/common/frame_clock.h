@@ -0,0 +1,125 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#include "common/util.h"
+
+/*
+  Measures the time elapsed between received frames, to pass to the control
+  blocks as their timestep.
+
+  Stamp is called as soon as a frame's data is received, with the frame's
+  SIMULATION TIME if it was requested. The simulation time is used when it is
+  given, as it is exact and stops while the simulator is paused, so the
+  timesteps do not depend on when messages happen to be dispatched (and a
+  replayed flight sees the same timesteps as the recorded one). Otherwise the
+  time the frame was received is used.
+
+  The timestep is sanitised before it reaches the blocks:
+  * a frame with no time elapsed since the previous one (a repeated frame, or
+    the simulation time going backwards after a reset) gives 0, which the
+    blocks treat as "hold the current output"
+  * a gap longer than max_period_s (e.g. the simulator stalled, or a debugger
+    stopped the client) is clamped, so integrators do not jump
+  * gaps between nominal_period_s and max_period_s are passed on unchanged,
+    so missed frames are made up for by a longer timestep; they are counted
+  Frames arriving in bursts simply give short timesteps.
+*/
+
+class FrameClock
+{
+public:
+  /* nominal_period_s is the expected time between frames, used for the first
+     frame and to count missed frames. By default gaps of up to 5 nominal
+     periods are passed on unclamped. */
+  explicit FrameClock(double nominal_period_s, double max_period_s = 0)
+    : nominal_period(nominal_period_s),
+      max_period(max_period_s > 0 ? max_period_s : 5 * nominal_period_s) {}
+
+  /*
+    Stamps a frame received now, sent at sim_time_s if known (negative if
+    not). Returns the timestep to update the control blocks with.
+  */
+  double Stamp(double sim_time_s = -1) {
+    received_ns = MonotonicTimeNs();
+    double time = (sim_time_s >= 0) ? sim_time_s : received_ns * 1e-9;
+    frames++;
+
+    if (frames == 1) {
+      last_time = time;
+      return period = nominal_period;
+    }
+
+    double dt = time - last_time;
+    if (dt <= 0) {
+      /* restart from the new time if it went backwards */
+      last_time = time;
+      stale_frames++;
+      return period = 0;
+    }
+    last_time = time;
+
+    /* only count whole missed frames, not jitter */
+    if (dt > 1.5 * nominal_period) {
+      missed_frames += static_cast<uint64_t>(std::floor(dt / nominal_period + 0.5)) - 1;
+    }
+    if (dt > max_period) {
+      long_gaps++;
+      dt = max_period;
+    }
+    return period = dt;
+  }
+
+  /* Monotonic time the last frame was received, see MonotonicTimeNs */
+  uint64_t ReceivedNs() const {
+    return received_ns;
+  }
+
+  /* Time of the last frame, and the timestep returned for it */
+  double Time() const {
+    return last_time;
+  }
+  double Period() const {
+    return period;
+  }
+
+  /* Frames stamped, frames that appear to be missing between them, frames
+     with no time elapsed and gaps that were clamped */
+  uint64_t Frames() const {
+    return frames;
+  }
+  uint64_t MissedFrames() const {
+    return missed_frames;
+  }
+  uint64_t StaleFrames() const {
+    return stale_frames;
+  }
+  uint64_t LongGaps() const {
+    return long_gaps;
+  }
+
+  void PrintStats(FILE* out) const {
+    fprintf(out, "Frames: %llu received, %llu missed, %llu stale, %llu gaps clamped to %.3f s\n",
+      static_cast<unsigned long long>(frames), static_cast<unsigned long long>(missed_frames),
+      static_cast<unsigned long long>(stale_frames), static_cast<unsigned long long>(long_gaps),
+      max_period);
+  }
+
+private:
+  double nominal_period;
+  double max_period;
+
+  uint64_t received_ns = 0;
+  double last_time = 0;
+  double period = 0;
+
+  uint64_t frames = 0;
+  uint64_t missed_frames = 0;
+  uint64_t stale_frames = 0;
+  uint64_t long_gaps = 0;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef GAIN_SCHEDULE_H
+#define GAIN_SCHEDULE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "common/PIDController.h"
+
+/*
+  Gain scheduling: controller gains interpolated from tables keyed on the
+  flight condition (e.g. indicated airspeed and altitude), so that one
+  controller covers the envelope rather than a single tuning point.
+
+  Table values are stored contiguously, in row-major order for two keys, so
+  a lookup touches two (or four) adjacent entries. The flight condition
+  changes slowly from frame to frame, so the breakpoint search starts from
+  the interval found by the previous lookup and usually ends there: lookups
+  are O(1) amortised, however many breakpoints there are. Keys outside the
+  table are clamped to its first or last breakpoint, as holding the edge
+  gains is safer than extrapolating them.
+
+  A table keeps the hint of its last lookup, so each controller should hold
+  its own copy rather than share one.
+*/
+
+/* Ascending breakpoints of one key of a table */
+class Breakpoints
+{
+public:
+  Breakpoints(const std::vector<double>& values)
+    : values(values), hint(0) {}
+
+  /* Finds the interval [values[index], values[index + 1]] holding key and
+     the fraction of the way along it, starting from the last interval found */
+  void Find(double key, size_t& index, double& fraction) {
+    size_t i = hint;
+    while (i > 0 && key < values[i]) {
+      i--;
+    }
+    while (i + 2 < values.size() && key >= values[i + 1]) {
+      i++;
+    }
+    hint = i;
+    index = i;
+
+    if (values.size() < 2) {
+      fraction = 0;
+      return;
+    }
+    fraction = (key - values[i]) / (values[i + 1] - values[i]);
+    fraction = (fraction < 0) ? 0 : (fraction > 1) ? 1 : fraction;
+  }
+
+  size_t Size() const {
+    return values.size();
+  }
+
+private:
+  std::vector<double> values;
+  size_t hint;
+};
+
+/* Linear interpolation from a to b, exact at both ends */
+inline double Interpolate(double a, double b, double fraction) {
+  return (fraction == 0) ? a : (fraction == 1) ? b : a + (b - a) * fraction;
+}
+
+/* Gains of a PID controller, in the order of its constructor */
+struct PIDGains {
+  double p, d, i;
+};
+
+inline PIDGains Interpolate(const PIDGains& a, const PIDGains& b, double fraction) {
+  PIDGains gains = {
+    Interpolate(a.p, b.p, fraction), Interpolate(a.d, b.d, fraction), Interpolate(a.i, b.i, fraction)
+  };
+  return gains;
+}
+
+/* Table of values (double or PIDGains) keyed on one variable */
+template <typename Value>
+class LookupTable1D
+{
+public:
+  /* values[k] is the value at breakpoints[k] */
+  LookupTable1D(const std::vector<double>& breakpoints, const std::vector<Value>& values)
+    : keys(breakpoints), values(values) {}
+
+  Value Lookup(double key) {
+    size_t index;
+    double fraction;
+    keys.Find(key, index, fraction);
+    if (keys.Size() < 2) {
+      return values[0];
+    }
+    return Interpolate(values[index], values[index + 1], fraction);
+  }
+
+private:
+  Breakpoints keys;
+  std::vector<Value> values;
+};
+
+/* Table of values (double or PIDGains) keyed on two variables, interpolated
+   bilinearly */
+template <typename Value>
+class LookupTable2D
+{
+public:
+  /* values[r * columns.size() + c] is the value at rows[r] and columns[c] */
+  LookupTable2D(const std::vector<double>& rows, const std::vector<double>& columns,
+    const std::vector<Value>& values)
+    : rows(rows), columns(columns), column_count(columns.size()), values(values) {}
+
+  Value Lookup(double row_key, double column_key) {
+    size_t r, c;
+    double row_fraction, column_fraction;
+    rows.Find(row_key, r, row_fraction);
+    columns.Find(column_key, c, column_fraction);
+    size_t r1 = (rows.Size() < 2) ? r : r + 1;
+    size_t c1 = (column_count < 2) ? c : c + 1;
+
+    const Value* row0 = &values[r * column_count];
+    const Value* row1 = &values[r1 * column_count];
+    return Interpolate(Interpolate(row0[c], row0[c1], column_fraction),
+      Interpolate(row1[c], row1[c1], column_fraction), row_fraction);
+  }
+
+private:
+  Breakpoints rows, columns;
+  size_t column_count;
+  std::vector<Value> values;
+};
+
+/*
+  Clamped PID controller whose gains are scheduled from a table of PIDGains,
+  a LookupTable1D or LookupTable2D. Call Schedule with the table's keys
+  before each update, e.g.
+
+    GainScheduledPIDController<LookupTable2D<PIDGains>> controller(table, -1, 1);
+    controller.Schedule(airspeed_kts, altitude_ft);
+    controller.Update(error, timestep);
+
+  The gains change with the flight condition, not in steps, so the output
+  does not jump when they do. The integral gain is set bumplessly, so that
+  the integral term the controller has built up is kept when the gain
+  changes, rather than rescaled with it.
+*/
+template <typename Table>
+class GainScheduledPIDController : public ClampedPIDController
+{
+public:
+  GainScheduledPIDController(const Table& table, double lowClamp, double highClamp)
+    : ClampedPIDController(0, 0, 0, lowClamp, highClamp), table(table) {}
+
+  /* Sets the gains for the flight condition given by the table's keys */
+  template <typename... Keys>
+  void Schedule(Keys... keys) {
+    PIDGains gains = table.Lookup(keys...);
+    SetPCoefficient(gains.p);
+    SetDCoefficient(gains.d);
+    SetICoefficientBumpless(gains.i);
+  }
+
+private:
+  Table table;
+};
+
+#endif
@@ -0,0 +1,396 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "common/latency_histogram.h"
+#include "common/telemetry.h"
+#include "common/util.h"
+
+/*
+  Always-on instrumentation of a control path: how long each stage of a
+  frame takes, and how often the frames of each data request are missed.
+
+    Instrumentation instrumentation;
+    const size_t STAGE_ROLL_LAW = instrumentation.AddStage("Roll control law");
+    instrumentation.WatchRequest(SimData<structFrameData>::RequestID(), "Frame data", 1 / SIM_UPDATE_RATE);
+    instrumentation.StartFromEnvironment("INSTRUMENTATION");
+    ...
+    instrumentation.Received(pObjData->dwRequestID, frame.sim_time_s);
+    {
+      ScopedTimer timer(instrumentation, STAGE_ROLL_LAW);
+      ...
+    }
+    instrumentation.Tick();   // once per frame
+    ...
+    instrumentation.Stop();
+    instrumentation.Print(stdout);
+
+  Stages are timed with the CPU's timestamp counter, which costs a few
+  nanoseconds to read (the steady clock elsewhere on platforms without
+  one), and recorded in a LatencyHistogram, so a stage costs two counter
+  reads and a bucket increment, without allocating or taking a lock. The
+  counter is converted to time from its rate measured over the run, which
+  assumes an invariant TSC, as on any recent x86.
+
+  A stage can be given a budget, e.g. a share of the frame period for the
+  control laws, and the times it takes longer are counted:
+
+    instrumentation.SetBudget(STAGE_LAWS, 0.05 / SIM_UPDATE_RATE);
+
+  A request's messages are expected period_s apart, in the time passed to
+  Received (the SIMULATION TIME, if the request has it, or the time of
+  receipt). A gap of more than one and a half periods counts as a gap, and
+  the whole periods in it as missed frames.
+
+  If started, a snapshot of the counters is dumped every interval (10 s by
+  default) and the counters restarted, so that each dump shows how the last
+  interval went. The dumps are formatted and written by the background
+  thread of a Telemetry, so Tick only costs a copy of the counters when one
+  is due; a dump is dropped rather than waited for if the last one has not
+  been written yet. Print shows the counters over the whole run.
+
+  All the members are called from the instrumented thread, and the stages
+  and requests are added before its first frame. SimConnect.h must be
+  included first.
+*/
+
+/* Returns the CPU's timestamp counter, or the steady clock in nanoseconds
+   on platforms without one */
+inline uint64_t ReadTimestampCounter() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return MonotonicTimeNs();
+#endif
+}
+
+/* The counters of an Instrumentation over an interval */
+struct InstrumentationSnapshot {
+  static const size_t MAX_STAGES = 8;
+  static const size_t MAX_REQUESTS = 8;
+
+  struct Stage {
+    const char* name;
+    LatencyHistogram ticks;
+    double budget_us = 0;       /* 0 if the stage has no budget */
+    uint64_t over_budget = 0;   /* times the stage took longer */
+  };
+
+  struct Request {
+    const char* name;
+    DWORD request_id;
+    double period_s;
+    uint64_t messages;
+    uint64_t gaps;
+    uint64_t missed;         /* whole periods missed in the gaps */
+    double longest_gap_s;
+  };
+
+  double start_s = 0;        /* seconds since the instrumentation was created */
+  double end_s = 0;
+  double ns_per_tick = 1;
+
+  size_t stage_count = 0;
+  Stage stages[MAX_STAGES];
+  size_t request_count = 0;
+  Request requests[MAX_REQUESTS];
+
+  /* Restarts the counters from time_s */
+  void Reset(double time_s) {
+    start_s = end_s = time_s;
+    for (size_t i = 0; i < stage_count; i++) {
+      stages[i].ticks.Reset();
+      stages[i].over_budget = 0;
+    }
+    for (size_t i = 0; i < request_count; i++) {
+      requests[i].messages = requests[i].gaps = requests[i].missed = 0;
+      requests[i].longest_gap_s = 0;
+    }
+  }
+
+  /* Adds the counters of the interval that follows this one */
+  void Merge(const InstrumentationSnapshot& next) {
+    end_s = next.end_s;
+    ns_per_tick = next.ns_per_tick;
+    for (size_t i = 0; i < stage_count; i++) {
+      stages[i].ticks.Merge(next.stages[i].ticks);
+      stages[i].over_budget += next.stages[i].over_budget;
+    }
+    for (size_t i = 0; i < request_count; i++) {
+      requests[i].messages += next.requests[i].messages;
+      requests[i].gaps += next.requests[i].gaps;
+      requests[i].missed += next.requests[i].missed;
+      requests[i].longest_gap_s = std::fmax(requests[i].longest_gap_s, next.requests[i].longest_gap_s);
+    }
+  }
+
+  void Print(FILE* out) const {
+    fprintf(out, "Instrumentation from %.1f s to %.1f s:\n", start_s, end_s);
+    for (size_t i = 0; i < stage_count; i++) {
+      const LatencyHistogram& h = stages[i].ticks;
+      fprintf(out, "  %s: n=%llu mean=%.3fus p50=%.3fus p90=%.3fus p99=%.3fus p99.9=%.3fus max=%.3fus",
+        stages[i].name, static_cast<unsigned long long>(h.Count()), Microseconds(h.Mean()),
+        Microseconds(h.Percentile(50)), Microseconds(h.Percentile(90)), Microseconds(h.Percentile(99)),
+        Microseconds(h.Percentile(99.9)), Microseconds(h.Max()));
+      if (stages[i].budget_us > 0) {
+        fprintf(out, " budget=%.1fus over=%llu", stages[i].budget_us,
+          static_cast<unsigned long long>(stages[i].over_budget));
+      }
+      fprintf(out, "\n");
+    }
+    for (size_t i = 0; i < request_count; i++) {
+      const Request& r = requests[i];
+      fprintf(out, "  %s (request %lu): %llu messages, %llu gaps, %llu frames missed, longest gap %.3f s\n",
+        r.name, static_cast<unsigned long>(r.request_id), static_cast<unsigned long long>(r.messages),
+        static_cast<unsigned long long>(r.gaps), static_cast<unsigned long long>(r.missed), r.longest_gap_s);
+    }
+  }
+
+private:
+  double Microseconds(double ticks) const {
+    return ticks * ns_per_tick / 1000;
+  }
+};
+
+class Instrumentation
+{
+public:
+  Instrumentation()
+    : dumps(FormatSnapshot), start_ns(MonotonicTimeNs()), start_ticks(ReadTimestampCounter()) {}
+
+  Instrumentation(const Instrumentation&) = delete;
+  Instrumentation& operator=(const Instrumentation&) = delete;
+
+  ~Instrumentation() {
+    Stop();
+  }
+
+  /* Adds a stage to time, returns its index for ScopedTimer. Stages beyond
+     MAX_STAGES are not recorded. */
+  size_t AddStage(const char* name) {
+    size_t index = current.stage_count;
+    if (index < InstrumentationSnapshot::MAX_STAGES) {
+      current.stages[index].name = name;
+      current.stage_count++;
+      totals.stages[index].name = name;
+      totals.stage_count++;
+    }
+    return index;
+  }
+
+  /* Counts the times a stage takes longer than budget_s. The budget is
+     converted to timestamp counter ticks at the counter's rate, measured
+     over 10 ms on the first call. */
+  void SetBudget(size_t stage, double budget_s) {
+    if (stage >= current.stage_count) {
+      return;
+    }
+    if (!(calibrated_ns_per_tick > 0)) {
+      calibrated_ns_per_tick = MeasureNsPerTick();
+    }
+    budget_ticks[stage] = static_cast<uint64_t>(budget_s * 1e9 / calibrated_ns_per_tick);
+    current.stages[stage].budget_us = budget_s * 1e6;
+    totals.stages[stage].budget_us = budget_s * 1e6;
+  }
+
+  /* Counts the gaps between the messages of a data request, expected
+     period_s apart. Requests beyond MAX_REQUESTS are not counted. */
+  void WatchRequest(DWORD request_id, const char* name, double period_s) {
+    size_t index = current.request_count;
+    if (index >= InstrumentationSnapshot::MAX_REQUESTS) {
+      return;
+    }
+    InstrumentationSnapshot::Request request = { name, request_id, period_s, 0, 0, 0, 0 };
+    current.requests[index] = request;
+    current.request_count++;
+    totals.requests[index] = request;
+    totals.request_count++;
+    last_time_s[index] = -1;
+  }
+
+  /* Records the time a stage took, in timestamp counter ticks */
+  void Record(size_t stage, uint64_t ticks) {
+    if (stage < current.stage_count) {
+      current.stages[stage].ticks.Record(ticks);
+      if (budget_ticks[stage] > 0 && ticks > budget_ticks[stage]) {
+        current.stages[stage].over_budget++;
+      }
+    }
+  }
+
+  /* Counts a message of a watched request, sent at time_s */
+  void Received(DWORD request_id, double time_s) {
+    for (size_t i = 0; i < current.request_count; i++) {
+      InstrumentationSnapshot::Request& request = current.requests[i];
+      if (request.request_id != request_id) {
+        continue;
+      }
+      request.messages++;
+      double gap = time_s - last_time_s[i];
+      if (last_time_s[i] >= 0 && gap > 1.5 * request.period_s) {
+        request.gaps++;
+        request.missed += static_cast<uint64_t>(std::floor(gap / request.period_s + 0.5)) - 1;
+        request.longest_gap_s = std::fmax(request.longest_gap_s, gap);
+      }
+      last_time_s[i] = time_s;
+      return;
+    }
+  }
+
+  /* Counts a message of a watched request with no time of its own */
+  void Received(DWORD request_id) {
+    Received(request_id, (MonotonicTimeNs() - start_ns) * 1e-9);
+  }
+
+  /* Starts dumping the counters to the file named by the environment
+     variable, every interval_s. Returns false only if the file could not be
+     created. */
+  bool StartFromEnvironment(const char* variable, double interval_s = 10) {
+    std::string path;
+#ifdef _WIN32
+    char* value = nullptr;
+    size_t length = 0;
+    if (_dupenv_s(&value, &length, variable) == 0 && value) {
+      path = value;
+      free(value);
+    }
+#else
+    const char* value = getenv(variable);
+    if (value) {
+      path = value;
+    }
+#endif
+    if (path.empty()) {
+      return true;
+    }
+#ifdef _WIN32
+    if (fopen_s(&dump_file, path.c_str(), "w") != 0) {
+      dump_file = nullptr;
+    }
+#else
+    dump_file = fopen(path.c_str(), "w");
+#endif
+    if (!dump_file) {
+      return false;
+    }
+    interval_ns = static_cast<uint64_t>(interval_s * 1e9);
+    next_dump_ns = MonotonicTimeNs() + interval_ns;
+    dumps.Start(dump_file);
+    return true;
+  }
+
+  /* Dumps the counters if an interval has passed, called once a frame */
+  void Tick() {
+    if (!dump_file) {
+      return;
+    }
+    uint64_t now_ns = MonotonicTimeNs();
+    if (now_ns < next_dump_ns) {
+      return;
+    }
+    next_dump_ns += interval_ns;
+    if (next_dump_ns <= now_ns) {
+      next_dump_ns = now_ns + interval_ns;
+    }
+
+    Snapshot();
+    dumps.Log(current);
+    totals.Merge(current);
+    current.Reset(current.end_s);
+  }
+
+  /* Writes the dumps still waiting and closes the file */
+  void Stop() {
+    if (!dump_file) {
+      return;
+    }
+    dumps.Stop();
+    fclose(dump_file);
+    dump_file = nullptr;
+  }
+
+  /* Prints the counters over the whole run */
+  void Print(FILE* out) {
+    Snapshot();
+    InstrumentationSnapshot run = totals;
+    run.Merge(current);
+    run.Print(out);
+  }
+
+private:
+  static void FormatSnapshot(FILE* out, const InstrumentationSnapshot& snapshot) {
+    snapshot.Print(out);
+  }
+
+  static double MeasureNsPerTick() {
+    const uint64_t INTERVAL_NS = 10000000;
+    uint64_t start_ns = MonotonicTimeNs();
+    uint64_t start_ticks = ReadTimestampCounter();
+    uint64_t now_ns;
+    do {
+      now_ns = MonotonicTimeNs();
+    } while (now_ns - start_ns < INTERVAL_NS);
+    uint64_t ticks = ReadTimestampCounter() - start_ticks;
+    return (ticks > 0) ? static_cast<double>(now_ns - start_ns) / ticks : 1;
+  }
+
+  /* Ends the current interval now, measuring the rate of the timestamp
+     counter over the whole run */
+  void Snapshot() {
+    uint64_t now_ns = MonotonicTimeNs();
+    uint64_t ticks = ReadTimestampCounter() - start_ticks;
+    current.end_s = (now_ns - start_ns) * 1e-9;
+    current.ns_per_tick = (ticks > 0) ? static_cast<double>(now_ns - start_ns) / ticks : 1;
+  }
+
+  InstrumentationSnapshot current;   /* counters since the last dump */
+  InstrumentationSnapshot totals;    /* counters up to the last dump */
+  double last_time_s[InstrumentationSnapshot::MAX_REQUESTS];
+  uint64_t budget_ticks[InstrumentationSnapshot::MAX_STAGES] = {};   /* 0 if none */
+  double calibrated_ns_per_tick = 0;
+
+  Telemetry<InstrumentationSnapshot, 2> dumps;
+  FILE* dump_file = nullptr;
+  uint64_t interval_ns = 0;
+  uint64_t next_dump_ns = 0;
+
+  uint64_t start_ns;
+  uint64_t start_ticks;
+};
+
+/* Records the time from its construction to the end of its scope as a stage
+   of an Instrumentation */
+class ScopedTimer
+{
+public:
+  ScopedTimer(Instrumentation& instrumentation, size_t stage)
+    : instrumentation(instrumentation), stage(stage), start(ReadTimestampCounter()) {}
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+  ~ScopedTimer() {
+    instrumentation.Record(stage, ReadTimestampCounter() - start);
+  }
+
+private:
+  Instrumentation& instrumentation;
+  size_t stage;
+  uint64_t start;
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+/*
+  Fixed size histogram for recording latencies in nanoseconds.
+
+  Values are bucketed logarithmically: every power of two is split into eight
+  linear sub-buckets, so any recorded value is reported to within 12.5% while
+  the whole 64 bit range fits in a few kilobytes. Recording never allocates.
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+class LatencyHistogram
+{
+public:
+  LatencyHistogram() {
+    Reset();
+  }
+
+  /* Records a single value */
+  void Record(uint64_t ns) {
+    buckets[BucketIndex(ns)]++;
+    count++;
+    sum += ns;
+    if (ns < min) {
+      min = ns;
+    }
+    if (ns > max) {
+      max = ns;
+    }
+  }
+
+  /* Adds all values recorded in another histogram */
+  void Merge(const LatencyHistogram& other) {
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+      buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    if (other.min < min) {
+      min = other.min;
+    }
+    if (other.max > max) {
+      max = other.max;
+    }
+  }
+
+  void Reset() {
+    std::memset(buckets, 0, sizeof(buckets));
+    count = 0;
+    sum = 0;
+    min = UINT64_MAX;
+    max = 0;
+  }
+
+  uint64_t Count() const {
+    return count;
+  }
+  uint64_t Min() const {
+    return count ? min : 0;
+  }
+  uint64_t Max() const {
+    return max;
+  }
+  double Mean() const {
+    return count ? static_cast<double>(sum) / count : 0;
+  }
+
+  /* Returns an upper bound on the given percentile (in the range [0, 100]) */
+  uint64_t Percentile(double percentile) const {
+    if (count == 0) {
+      return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(percentile / 100 * count + 0.5);
+    if (rank < 1) {
+      rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+      seen += buckets[i];
+      if (seen >= rank) {
+        uint64_t upper = BucketUpperBound(i);
+        return (upper < max) ? upper : max;
+      }
+    }
+    return max;
+  }
+
+  /* Prints a one line summary, with values in microseconds */
+  void Print(FILE* out, const char* name) const {
+    fprintf(out, "%s: n=%llu mean=%.2fus p50=%.2fus p90=%.2fus p99=%.2fus p99.9=%.2fus max=%.2fus\n",
+      name, static_cast<unsigned long long>(count), Mean() / 1000,
+      Percentile(50) / 1000.0, Percentile(90) / 1000.0, Percentile(99) / 1000.0,
+      Percentile(99.9) / 1000.0, Max() / 1000.0);
+  }
+
+private:
+  static const int SUB_BUCKETS = 8;
+  static const int SUB_BUCKET_BITS = 3;
+  static const int NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  /* Index of the highest set bit, v must be non-zero */
+  static int HighestBit(uint64_t v) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#else
+    int bit = 0;
+    while (v >>= 1) {
+      bit++;
+    }
+    return bit;
+#endif
+  }
+
+  static int BucketIndex(uint64_t v) {
+    if (v < SUB_BUCKETS) {
+      return static_cast<int>(v);
+    }
+    int e = HighestBit(v);
+    int sub = static_cast<int>((v >> (e - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return (e - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+  }
+
+  static uint64_t BucketUpperBound(int index) {
+    if (index < SUB_BUCKETS) {
+      return index;
+    }
+    int e = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t sub = index % SUB_BUCKETS;
+    uint64_t width = 1ull << (e - SUB_BUCKET_BITS);
+    return ((SUB_BUCKETS + sub) << (e - SUB_BUCKET_BITS)) + width - 1;
+  }
+
+  uint64_t buckets[NUM_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+};
+
+#endif
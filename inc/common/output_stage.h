@@ -0,0 +1,231 @@
+#ifndef OUTPUT_STAGE_H
+#define OUTPUT_STAGE_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "common/sim_data.h"
+
+/*
+  Stages the outputs of all the control loops in one struct, T, declared
+  with SIM_DATA_DEFINITION, and sends them to the simulator in a single
+  SimConnect_SetDataOnSimObject call per frame, however many loops write to
+  it:
+
+    OutputStage<structControlOutputs> outputs(1e-6);
+    ...
+    outputs.Frame().aileronDeflect = ...;   // each loop writes its fields
+    outputs.Frame().elevatorDeflect = ...;
+    ...
+    outputs.Flush(hSimConnect);             // once, at the end of the frame
+
+  Only the fields which have changed by more than their epsilon since they
+  were last sent are sent, in SimConnect's tagged format (each value
+  preceded by its datum ID, the field's index, see SimData::Register). When
+  enough of them have changed that the whole struct is smaller it is sent
+  untagged instead, exactly as SimData::Set would, and when none have
+  nothing is sent at all, so a surface held still costs no IPC. A value
+  suppressed by its epsilon stays pending: it is sent as soon as the drift
+  from the value last sent exceeds the epsilon.
+
+  Suppression assumes that nothing but the client moves the surfaces. On
+  FSX that does not hold for the user aircraft while the joystick events
+  are not masked: the simulator's own stick handling moves the surfaces
+  too, and only a write from the client puts them back, so a suppressed
+  write leaves the stick driving them, e.g. while a saturated command
+  holds the law's output still. SetRefreshInterval(n) resends every field
+  at least every n flushes whether or not it has changed; the examples
+  which fly the user aircraft through its joystick resend every frame.
+
+  SimConnect has no call which sets several data definitions at once, so the
+  outputs are coalesced by keeping them in one definition.
+*/
+template <typename T>
+class OutputStage
+{
+public:
+  /* Fields which change by no more than epsilon are not sent; an epsilon of
+     0 sends every change */
+  explicit OutputStage(double epsilon = 0) : frame(), sent() {
+    size_t count;
+    fields = SimDataTraits<T>::Fields(&count);
+    field_count = count;
+    epsilons.assign(count, epsilon);
+
+    size_t tagged_size = 0;
+    for (size_t i = 0; i < count; i++) {
+      tagged_size += sizeof(DWORD) + fields[i].size;
+    }
+    buffer.resize(tagged_size);
+  }
+
+  /* The outputs of the current frame, for the loops to write to */
+  T& Frame() {
+    return frame;
+  }
+
+  /* Resends every field at least every frames flushes, changed or not; 0,
+     the default, only sends changes */
+  void SetRefreshInterval(uint64_t frames) {
+    refresh_interval = frames;
+  }
+
+  /* Sets the epsilon of one field, by its index in the definition */
+  void SetEpsilon(size_t field, double epsilon) {
+    epsilons[field] = epsilon;
+  }
+
+  /*
+    Sends the fields of the frame which have changed to object, in one call
+    or none. The first flush sends every field. Returns the result of the
+    call, or S_OK if there was nothing to send; see Sent.
+  */
+  HRESULT Flush(HANDLE hSimConnect, SIMCONNECT_OBJECT_ID object = SIMCONNECT_OBJECT_ID_USER) {
+    stats.frames++;
+    sent_size = 0;
+
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(&frame);
+    const uint8_t* last = reinterpret_cast<const uint8_t*>(&sent);
+    size_t changed = 0;
+    size_t tagged_size = 0;
+    bool refresh = refresh_interval > 0 && stats.frames - last_refresh >= refresh_interval;
+    for (size_t i = 0; i < field_count; i++) {
+      const SimDataField& field = fields[i];
+      if (stats.calls > 0 && !refresh && !Changed(field, src + field.offset, last + field.offset, epsilons[i])) {
+        continue;
+      }
+      DWORD datum_id = static_cast<DWORD>(i);
+      std::memcpy(&buffer[tagged_size], &datum_id, sizeof(datum_id));
+      std::memcpy(&buffer[tagged_size + sizeof(datum_id)], src + field.offset, field.size);
+      tagged_size += sizeof(datum_id) + field.size;
+      changed++;
+    }
+    if (changed == 0) {
+      stats.fields_suppressed += field_count;
+      return S_OK;
+    }
+
+    /* send whichever of the tagged fields and the whole struct is smaller */
+    bool tagged = tagged_size < sizeof(T);
+    const void* data = tagged ? static_cast<const void*>(buffer.data()) : static_cast<const void*>(&frame);
+    DWORD size = static_cast<DWORD>(tagged ? tagged_size : sizeof(T));
+    HRESULT res = SimConnect_SetDataOnSimObject(hSimConnect, SimData<T>::DefineID(), object,
+      tagged ? SIMCONNECT_DATA_SET_FLAG_TAGGED : SIMCONNECT_DATA_SET_FLAG_DEFAULT, 1, size,
+      const_cast<void*>(data));
+    if (res != S_OK) {
+      return res;
+    }
+
+    if (tagged) {
+      for (size_t offset = 0; offset < tagged_size;) {
+        DWORD datum_id;
+        std::memcpy(&datum_id, &buffer[offset], sizeof(datum_id));
+        const SimDataField& field = fields[datum_id];
+        std::memcpy(reinterpret_cast<uint8_t*>(&sent) + field.offset, src + field.offset, field.size);
+        offset += sizeof(datum_id) + field.size;
+      }
+    }
+    else {
+      sent = frame;
+      changed = field_count;
+      last_refresh = stats.frames;
+    }
+    sent_data = data;
+    sent_size = size;
+    stats.calls++;
+    stats.bytes += size;
+    stats.fields_sent += changed;
+    stats.fields_suppressed += field_count - changed;
+    return S_OK;
+  }
+
+  /* Whether the last flush sent anything, and if so the data it sent, e.g.
+     to record it */
+  bool Sent() const {
+    return sent_size > 0;
+  }
+  const void* SentData() const {
+    return sent_data;
+  }
+  DWORD SentSize() const {
+    return sent_size;
+  }
+
+  struct Stats {
+    uint64_t frames = 0;              /* calls to Flush */
+    uint64_t calls = 0;               /* calls to SimConnect_SetDataOnSimObject */
+    uint64_t bytes = 0;               /* bytes of data sent by them */
+    uint64_t fields_sent = 0;
+    uint64_t fields_suppressed = 0;   /* unchanged, or changed by no more than the epsilon */
+  };
+
+  const Stats& GetStats() const {
+    return stats;
+  }
+
+  void PrintStats(FILE* out) const {
+    double frames = static_cast<double>(stats.frames > 0 ? stats.frames : 1);
+    fprintf(out, "Outputs: %llu frames, %.2f SetDataOnSimObject calls and %.1f bytes per frame, "
+      "%llu fields sent, %llu suppressed\n",
+      static_cast<unsigned long long>(stats.frames), stats.calls / frames, stats.bytes / frames,
+      static_cast<unsigned long long>(stats.fields_sent),
+      static_cast<unsigned long long>(stats.fields_suppressed));
+  }
+
+private:
+  /* Whether the field at value differs from the one at last by more than
+     epsilon; a NaN always counts as a change */
+  static bool Changed(const SimDataField& field, const uint8_t* value, const uint8_t* last, double epsilon) {
+    if (std::memcmp(value, last, field.size) == 0) {
+      return false;
+    }
+    return !(std::abs(Decode(field, value) - Decode(field, last)) <= epsilon);
+  }
+
+  static double Decode(const SimDataField& field, const uint8_t* data) {
+    switch (field.type) {
+    case SIMCONNECT_DATATYPE_FLOAT32: {
+      float value;
+      std::memcpy(&value, data, sizeof(value));
+      return value;
+    }
+    case SIMCONNECT_DATATYPE_INT32: {
+      int32_t value;
+      std::memcpy(&value, data, sizeof(value));
+      return value;
+    }
+    case SIMCONNECT_DATATYPE_INT64: {
+      int64_t value;
+      std::memcpy(&value, data, sizeof(value));
+      return static_cast<double>(value);
+    }
+    default: {
+      double value;
+      std::memcpy(&value, data, sizeof(value));
+      return value;
+    }
+    }
+  }
+
+  T frame;
+  T sent;   /* the values the simulator was last sent */
+
+  const SimDataField* fields;
+  size_t field_count;
+  std::vector<double> epsilons;
+  std::vector<uint8_t> buffer;   /* tagged data */
+
+  uint64_t refresh_interval = 0;
+  uint64_t last_refresh = 0;   /* the flush which last sent every field */
+
+  const void* sent_data = nullptr;
+  DWORD sent_size = 0;
+
+  Stats stats;
+};
+
+#endif
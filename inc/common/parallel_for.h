@@ -0,0 +1,67 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/*
+  Runs independent iterations on all hardware threads, for batch jobs such as
+  parameter sweeps.
+
+  The range is split into chunks which the threads claim from a shared
+  counter, so a thread that finishes its chunk early simply takes the next
+  one and uneven iterations are balanced without any other coordination.
+*/
+
+/* Returns the number of threads ParallelFor uses by default */
+inline unsigned HardwareThreads() {
+  unsigned n = std::thread::hardware_concurrency();
+  return (n > 0) ? n : 1;
+}
+
+/*
+  Calls body(begin, end, thread) for consecutive chunks of [0, count) of at
+  most chunk iterations, using the given number of threads (0 for all
+  hardware threads). thread is in [0, threads) and identifies the calling
+  thread, e.g. to index per-thread scratch data. Returns once every chunk has
+  been processed.
+*/
+template <typename Body>
+void ParallelFor(size_t count, size_t chunk, const Body& body, unsigned threads = 0) {
+  if (threads == 0) {
+    threads = HardwareThreads();
+  }
+  if (chunk == 0) {
+    chunk = 1;
+  }
+  size_t chunks = (count + chunk - 1) / chunk;
+  if (threads > chunks) {
+    threads = static_cast<unsigned>(std::max<size_t>(chunks, 1));
+  }
+
+  std::atomic<size_t> next(0);
+  auto worker = [&](unsigned thread) {
+    for (;;) {
+      size_t begin = next.fetch_add(chunk, std::memory_order_relaxed);
+      if (begin >= count) {
+        break;
+      }
+      body(begin, std::min(begin + chunk, count), thread);
+    }
+  };
+
+  /* the calling thread works too */
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; t++) {
+    pool.emplace_back(worker, t);
+  }
+  worker(0);
+  for (std::thread& t : pool) {
+    t.join();
+  }
+}
+
+#endif
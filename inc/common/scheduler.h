@@ -0,0 +1,121 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+  Runs several control loops at their own rates from a single stream of
+  frames, e.g. an outer heading loop at a few Hz and an inner roll rate loop
+  on every frame of one SimConnect connection.
+
+  Tick is called on every frame with the frame's timestamp (normally the
+  SIMULATION TIME SimVar), and runs each task whose next run is due. Tasks
+  are scheduled from these measured timestamps rather than by counting
+  frames, so they keep their rates when the frame rate varies, and every
+  task is passed the time actually elapsed since its previous run.
+
+  Tasks due on the same frame run in the order they were added, so adding
+  outer loops before inner loops means an inner loop always sees its outer
+  loop's output from the same frame. If frames are missed, a task runs once
+  when the next frame arrives rather than once per missed period.
+*/
+
+class Scheduler
+{
+public:
+  /* A task is passed the time elapsed since its previous run */
+  typedef std::function<void(double dt)> Task;
+
+  /* Adds a task run every period_s seconds, or on every frame after the
+     first if period_s is 0. Returns the index of the task. */
+  size_t Add(const char* name, double period_s, Task task) {
+    Entry entry;
+    entry.name = name;
+    entry.period_s = period_s;
+    entry.task = task;
+    tasks.push_back(entry);
+    return tasks.size() - 1;
+  }
+
+  /* Runs every task due at time now_s */
+  void Tick(double now_s) {
+    for (Entry& entry : tasks) {
+      if (!entry.started || now_s < entry.last_run_s) {
+        /* first frame, or time has gone backwards (e.g. the simulation was
+           reset): run now, as if the previous run was one period ago.
+           Tasks run on every frame have no period, so wait for the next
+           frame to measure one. */
+        entry.started = true;
+        entry.next_due_s = now_s;
+        entry.last_run_s = now_s - entry.period_s;
+        if (entry.period_s <= 0) {
+          entry.last_run_s = now_s;
+          continue;
+        }
+      }
+      if (now_s < entry.next_due_s - TOLERANCE_S || now_s <= entry.last_run_s) {
+        continue;
+      }
+
+      double dt = now_s - entry.last_run_s;
+      entry.last_run_s = now_s;
+      entry.runs++;
+      entry.total_dt_s += dt;
+
+      /* keep the phase of the schedule, skipping any missed runs */
+      entry.next_due_s += entry.period_s;
+      if (entry.next_due_s <= now_s + TOLERANCE_S) {
+        double missed = (entry.period_s > 0) ? std::floor((now_s - entry.next_due_s) / entry.period_s + TOLERANCE_S) + 1 : 0;
+        entry.next_due_s += missed * entry.period_s;
+      }
+
+      entry.task(dt);
+    }
+  }
+
+  /* Number of times a task has run */
+  size_t Runs(size_t index) const {
+    return tasks[index].runs;
+  }
+
+  /* Average time between runs of a task */
+  double MeanPeriod(size_t index) const {
+    const Entry& entry = tasks[index];
+    return entry.runs ? entry.total_dt_s / entry.runs : 0;
+  }
+
+  /* Prints the measured rate of every task */
+  void PrintStats(FILE* out) const {
+    for (size_t i = 0; i < tasks.size(); i++) {
+      double period = MeanPeriod(i);
+      fprintf(out, "%s: %zu runs, mean period %.4f s (%.2f Hz)\n",
+        tasks[i].name.c_str(), tasks[i].runs, period, period > 0 ? 1 / period : 0);
+    }
+  }
+
+private:
+  /* Timestamps within this of a task's due time count as due, so that
+     rounding in accumulated frame times does not delay a run by a frame */
+  static constexpr double TOLERANCE_S = 1e-6;
+
+  struct Entry {
+    std::string name;
+    double period_s = 0;
+    Task task;
+
+    bool started = false;
+    double next_due_s = 0;
+    double last_run_s = 0;
+
+    size_t runs = 0;
+    double total_dt_s = 0;
+  };
+
+  std::vector<Entry> tasks;
+};
+
+#endif
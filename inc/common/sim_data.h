@@ -0,0 +1,219 @@
+#ifndef SIM_DATA_H
+#define SIM_DATA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+  Typed SimConnect data definitions: the SimVar, units and datatype of each
+  field of a struct are declared once, next to the struct, e.g.
+
+    struct structAircraftPosition {
+      float bank_rad;
+      float rotation_vel_x_rad_s;
+    };
+
+    SIM_DATA_DEFINITION(structAircraftPosition,
+      SIM_DATA_FIELD(bank_rad, "PLANE BANK DEGREES", "Radians"),
+      SIM_DATA_FIELD(rotation_vel_x_rad_s, "ROTATION VELOCITY BODY X", "Radians per second"));
+
+  and SimData<structAircraftPosition> then registers the definition, requests
+  it and decodes received data:
+
+    SimData<structAircraftPosition>::Register(hSimConnect);
+    SimData<structAircraftPosition>::Request(hSimConnect, SIMCONNECT_OBJECT_ID_USER, SIMCONNECT_PERIOD_SIM_FRAME);
+    ...
+    const structAircraftPosition* position = SimData<structAircraftPosition>::Get(pObjData, cbData);
+
+  The SimConnect datatype of each field follows from its C++ type (double,
+  float, int32_t or int64_t), so a field can be requested as FLOAT32 just by
+  declaring it as a float. SimConnect packs fields back to back, so they
+  must be declared in order and cover the struct without padding; Register
+  fails otherwise. Each struct is given its own data definition ID and
+  request ID, and each field is given its index as its datum ID, which
+  identifies it in tagged data. Data received in tagged format holds only
+  some of the fields, so it is merged into the last values received with
+  Update rather than read in place with Get.
+
+  SimConnect.h must be included first.
+*/
+
+/* A single field of a data definition */
+struct SimDataField {
+  const char* simvar;
+  const char* units;
+  SIMCONNECT_DATATYPE type;
+  size_t offset;
+  size_t size;
+};
+
+/* SimConnect datatype of a field's C++ type */
+template <typename T> struct SimDataType;
+template <> struct SimDataType<double> {
+  static const SIMCONNECT_DATATYPE value = SIMCONNECT_DATATYPE_FLOAT64;
+};
+template <> struct SimDataType<float> {
+  static const SIMCONNECT_DATATYPE value = SIMCONNECT_DATATYPE_FLOAT32;
+};
+template <> struct SimDataType<int32_t> {
+  static const SIMCONNECT_DATATYPE value = SIMCONNECT_DATATYPE_INT32;
+};
+template <> struct SimDataType<int64_t> {
+  static const SIMCONNECT_DATATYPE value = SIMCONNECT_DATATYPE_INT64;
+};
+
+/* Fields of a struct, specialised by SIM_DATA_DEFINITION */
+template <typename T> struct SimDataTraits;
+
+/* Declares the fields of Type, must be used at global scope */
+#define SIM_DATA_DEFINITION(Type, ...)                                  \
+  template <> struct SimDataTraits<Type> {                              \
+    typedef Type DataType;                                              \
+    static const SimDataField* Fields(size_t* count) {                  \
+      static const SimDataField fields[] = { __VA_ARGS__ };             \
+      *count = sizeof(fields) / sizeof(fields[0]);                      \
+      return fields;                                                    \
+    }                                                                   \
+  }
+
+/* Declares that member holds the given SimVar, in the given units */
+#define SIM_DATA_FIELD(member, simvar, units)                           \
+  { simvar, units, SimDataType<decltype(DataType::member)>::value,      \
+    offsetof(DataType, member), sizeof(DataType::member) }
+
+/* Allocates data definition IDs (kind 0) and request IDs (kind 1) */
+inline DWORD NextSimDataID(int kind) {
+  static std::atomic<DWORD> next[2];
+  return next[kind]++;
+}
+
+template <typename T>
+class SimData
+{
+public:
+  /* The data definition ID of T */
+  static SIMCONNECT_DATA_DEFINITION_ID DefineID() {
+    static const SIMCONNECT_DATA_DEFINITION_ID id = NextSimDataID(0);
+    return id;
+  }
+
+  /* The ID used by Request */
+  static SIMCONNECT_DATA_REQUEST_ID RequestID() {
+    static const SIMCONNECT_DATA_REQUEST_ID id = NextSimDataID(1);
+    return id;
+  }
+
+  /* Number of fields in the definition */
+  static DWORD FieldCount() {
+    size_t count;
+    SimDataTraits<T>::Fields(&count);
+    return static_cast<DWORD>(count);
+  }
+
+  /* Adds every field to the data definition. epsilons, if given, holds the
+     smallest change in each field, in its units, which counts as a change
+     for requests with SIMCONNECT_DATA_REQUEST_FLAG_CHANGED */
+  static HRESULT Register(HANDLE hSimConnect, const float* epsilons = nullptr) {
+    size_t count;
+    const SimDataField* fields = SimDataTraits<T>::Fields(&count);
+
+    /* the fields must match SimConnect's packing exactly */
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (fields[i].offset != offset) {
+        return E_FAIL;
+      }
+      offset += fields[i].size;
+    }
+    if (offset != sizeof(T)) {
+      return E_FAIL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      HRESULT res = SimConnect_AddToDataDefinition(hSimConnect, DefineID(),
+        fields[i].simvar, fields[i].units, fields[i].type, epsilons ? epsilons[i] : 0, static_cast<DWORD>(i));
+      if (res != S_OK) {
+        return res;
+      }
+    }
+    return S_OK;
+  }
+
+  /* Requests the data, see SimConnect_RequestDataOnSimObject */
+  static HRESULT Request(HANDLE hSimConnect, SIMCONNECT_OBJECT_ID object, SIMCONNECT_PERIOD period,
+    SIMCONNECT_DATA_REQUEST_FLAG flags = 0, DWORD origin = 0, DWORD interval = 0, DWORD limit = 0) {
+    return SimConnect_RequestDataOnSimObject(hSimConnect, RequestID(), DefineID(), object, period,
+      flags, origin, interval, limit);
+  }
+
+  /* Sets the data on an object */
+  static HRESULT Set(HANDLE hSimConnect, SIMCONNECT_OBJECT_ID object, const T& data) {
+    return SimConnect_SetDataOnSimObject(hSimConnect, DefineID(), object, SIMCONNECT_DATA_SET_FLAG_DEFAULT,
+      1, sizeof(T), const_cast<T*>(&data));
+  }
+
+  /*
+    Returns the received data in place, or null if the message does not hold
+    this definition in full, untagged
+  */
+  static const T* Get(const SIMCONNECT_RECV_SIMOBJECT_DATA* msg, DWORD size) {
+    const size_t HEADER_SIZE = sizeof(SIMCONNECT_RECV_SIMOBJECT_DATA) - sizeof(DWORD);
+    if (msg->dwDefineID != DefineID() || msg->dwDefineCount != FieldCount() ||
+        (msg->dwFlags & SIMCONNECT_DATA_REQUEST_FLAG_TAGGED) || size < HEADER_SIZE + sizeof(T)) {
+      return nullptr;
+    }
+    return reinterpret_cast<const T*>(&msg->dwData);
+  }
+
+  /*
+    Copies the received data into data, whether the message holds the whole
+    definition or, in tagged format, only some of its fields. Returns false,
+    leaving data unchanged, if the message does not hold this definition.
+  */
+  static bool Update(const SIMCONNECT_RECV_SIMOBJECT_DATA* msg, DWORD size, T& data) {
+    if (!(msg->dwFlags & SIMCONNECT_DATA_REQUEST_FLAG_TAGGED)) {
+      const T* received = Get(msg, size);
+      if (received) {
+        data = *received;
+      }
+      return received != nullptr;
+    }
+
+    const size_t HEADER_SIZE = sizeof(SIMCONNECT_RECV_SIMOBJECT_DATA) - sizeof(DWORD);
+    if (msg->dwDefineID != DefineID() || size < HEADER_SIZE) {
+      return false;
+    }
+    size_t count;
+    const SimDataField* fields = SimDataTraits<T>::Fields(&count);
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(&msg->dwData);
+    size_t remaining = size - HEADER_SIZE;
+
+    /* check every field before copying any */
+    const uint8_t* pos = src;
+    for (DWORD i = 0; i < msg->dwDefineCount; i++) {
+      DWORD datum_id;
+      if (remaining < sizeof(datum_id)) {
+        return false;
+      }
+      std::memcpy(&datum_id, pos, sizeof(datum_id));
+      if (datum_id >= count || remaining - sizeof(datum_id) < fields[datum_id].size) {
+        return false;
+      }
+      pos += sizeof(datum_id) + fields[datum_id].size;
+      remaining -= sizeof(datum_id) + fields[datum_id].size;
+    }
+    pos = src;
+    for (DWORD i = 0; i < msg->dwDefineCount; i++) {
+      DWORD datum_id;
+      std::memcpy(&datum_id, pos, sizeof(datum_id));
+      std::memcpy(reinterpret_cast<uint8_t*>(&data) + fields[datum_id].offset, pos + sizeof(datum_id),
+        fields[datum_id].size);
+      pos += sizeof(datum_id) + fields[datum_id].size;
+    }
+    return true;
+  }
+};
+
+#endif
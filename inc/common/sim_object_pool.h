@@ -0,0 +1,66 @@
+#ifndef SIM_OBJECT_POOL_H
+#define SIM_OBJECT_POOL_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+/*
+  Gives each SimObject a client controls (the user aircraft, AI traffic, the
+  members of a formation) a dense index, so that the state of their
+  controllers can be held in arrays indexed by it, e.g. a PIDBank, and
+  updated for every object in one batch rather than one object at a time:
+
+    size_t index = pool.Add(pObjData->dwObjectID);   // when the object is found
+    headingControllers.Add(...);                      // its controllers take the same index
+    ...
+    size_t index;
+    if (pool.Find(pObjData->dwObjectID, index)) {     // route its data to them
+      headings[index] = ...;
+    }
+
+  SimConnect object IDs are arbitrary, so they are looked up in a hash table;
+  indices are allocated in the order objects are added and never reused.
+
+  SimConnect.h must be included first.
+*/
+class SimObjectPool
+{
+public:
+  /* Adds an object and returns its index, or the index it already has */
+  size_t Add(SIMCONNECT_OBJECT_ID object) {
+    auto it = indices.find(object);
+    if (it != indices.end()) {
+      return it->second;
+    }
+    size_t index = objects.size();
+    indices.emplace(object, index);
+    objects.push_back(object);
+    return index;
+  }
+
+  /* Finds the index of an object, returns false if it is not in the pool */
+  bool Find(SIMCONNECT_OBJECT_ID object, size_t& index) const {
+    auto it = indices.find(object);
+    if (it == indices.end()) {
+      return false;
+    }
+    index = it->second;
+    return true;
+  }
+
+  /* The object at index */
+  SIMCONNECT_OBJECT_ID ObjectID(size_t index) const {
+    return objects[index];
+  }
+
+  size_t Size() const {
+    return objects.size();
+  }
+
+private:
+  std::unordered_map<SIMCONNECT_OBJECT_ID, size_t> indices;
+  std::vector<SIMCONNECT_OBJECT_ID> objects;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef SISO_BLOCKS_H
 #define SISO_BLOCKS_H
 
+#include <cmath>
+
 /*
   This file contains a set of Single-Input Single-Output (SISO) blocks used for
   the simulation and control of systems.
@@ -13,8 +15,12 @@ public:
   SISOBlock(double inital_output = 0)
     : last_output(inital_output) {};
 
-  /* Updates the output based on the input and time */
+  /* Updates the output based on the input and time. If no time has elapsed
+     the output is held, see FrameClock */
   double Update(double input, double timestep) {
+    if (!(timestep > 0)) {
+      return last_output;
+    }
     last_output = InternalUpdate(input, timestep);
     return last_output;
   }
@@ -25,31 +31,219 @@ public:
   }
 protected:
   virtual double InternalUpdate(double input, double timestep) = 0;
+
+  /* Stores the output of an update made other than through Update */
+  double SetOutput(double output) {
+    return last_output = output;
+  }
 private:
   double last_output;
 };
 
-/* Simulates a First-Order response of the form a(dy/dt) + by = x */
-class FirstOrderResponseBlock : public SISOBlock
+/*
+  Statically dispatched counterpart of SISOBlock. Blocks derive from this using
+  the curiously recurring template pattern and provide InternalUpdate as a
+  non-virtual member, so that calls to Update can be fully inlined (see
+  siso_chain.h for composing them).
+*/
+template <typename Derived>
+class StaticSISOBlock
 {
 public:
-  FirstOrderResponseBlock(double a, double b)
-    : a(a), b(b) {};
+  StaticSISOBlock(double initial_output = 0)
+    : last_output(initial_output) {};
+
+  /* Updates the output based on the input and time. If no time has elapsed
+     the output is held, see FrameClock */
+  double Update(double input, double timestep) {
+    if (!(timestep > 0)) {
+      return last_output;
+    }
+    last_output = static_cast<Derived*>(this)->InternalUpdate(input, timestep);
+    return last_output;
+  }
+
+  /* Returns last computed output */
+  double Output() const {
+    return last_output;
+  }
 protected:
-  virtual double InternalUpdate(double input, double timestep) {
-    /* Get last output */
-    double y = Output();
+  /* Stores the output of an update made other than through Update */
+  double SetOutput(double output) {
+    return last_output = output;
+  }
+private:
+  double last_output;
+};
+
+/*
+  How a continuous block is discretised over each timestep. The input is
+  taken to be constant over the step, as it is when it comes from a
+  controller updated once per frame.
+*/
+enum Discretisation {
+  DISCRETISE_EULER,       /* forward Euler: unstable once timestep*b/a exceeds 2 */
+  DISCRETISE_TRAPEZOIDAL, /* trapezoidal rule: stable for any timestep */
+  DISCRETISE_RK4,         /* classic fourth order Runge-Kutta */
+  DISCRETISE_EXACT,       /* exact solution, the zero-order hold equivalent */
+};
 
-    /* Calculate time derivatives from response formula */
-    double ydot = (1 / a) * input - (b / a) * y;
+/*
+  Relative difference between two timesteps below which a block reuses the
+  discretisation computed for one for the other. Timesteps measured from the
+  simulation time differ in their last bits from frame to frame, which would
+  otherwise recompute it every frame; the error from reusing it is far below
+  that of the timestamps themselves.
+*/
+const double TIMESTEP_TOLERANCE = 1e-9;
 
-    /* Apply Euler integration */
-    y = (1 - (timestep*b) / a) * y + (timestep / a)*input;
+inline bool SameTimestep(double timestep, double cached_timestep) {
+  return std::fabs(timestep - cached_timestep) <= TIMESTEP_TOLERANCE * cached_timestep;
+}
+
+/*
+  Statically dispatched First-Order response of the form a(dy/dt) + by = x.
 
-    return y;
+  Every method reduces to y[n+1] = alpha*y[n] + beta*x[n] for a given
+  timestep, so alpha and beta are computed once and reused for as long as
+  the timestep stays the same. The default, Euler, gives the same results as
+  it always has; the exact method stays accurate at steps many times longer.
+*/
+class FirstOrderResponse : public StaticSISOBlock<FirstOrderResponse>
+{
+  friend class StaticSISOBlock<FirstOrderResponse>;
+public:
+  FirstOrderResponse(double a, double b, double initial_output = 0,
+    Discretisation method = DISCRETISE_EULER)
+    : StaticSISOBlock<FirstOrderResponse>(initial_output), a(a), b(b), method(method),
+      cached_timestep(0), alpha(1), beta(0) {};
+
+  Discretisation GetDiscretisation() const {
+    return method;
+  }
+protected:
+  double InternalUpdate(double input, double timestep) {
+    if (!SameTimestep(timestep, cached_timestep)) {
+      ComputeCoefficients(timestep);
+    }
+    return alpha * Output() + beta * input;
   }
 private:
+  void ComputeCoefficients(double timestep) {
+    cached_timestep = timestep;
+    switch (method) {
+    case DISCRETISE_TRAPEZOIDAL: {
+      double h = (timestep * b) / (2 * a);
+      alpha = (1 - h) / (1 + h);
+      beta = (timestep / a) / (1 + h);
+      break;
+    }
+    case DISCRETISE_RK4: {
+      /* for a linear equation RK4 gives the Taylor series of the exact
+         solution up to z^4, where z = -timestep*b/a */
+      double z = -(timestep * b) / a;
+      alpha = 1 + z * (1 + z * (1.0 / 2 + z * (1.0 / 6 + z * (1.0 / 24))));
+      beta = (timestep / a) * (1 + z * (1.0 / 2 + z * (1.0 / 6 + z * (1.0 / 24))));
+      break;
+    }
+    case DISCRETISE_EXACT: {
+      double z = -(timestep * b) / a;
+      alpha = std::exp(z);
+      beta = (b != 0) ? -std::expm1(z) / b : timestep / a;
+      break;
+    }
+    case DISCRETISE_EULER:
+    default:
+      /* same operations as y = (1 - (timestep*b) / a) * y + (timestep / a)*input */
+      alpha = 1 - (timestep * b) / a;
+      beta = timestep / a;
+      break;
+    }
+  }
+
   double a, b;
+  Discretisation method;
+
+  double cached_timestep;
+  double alpha, beta;
+};
+
+/* Statically dispatched integrator: dy/dt = x */
+class Integrator : public StaticSISOBlock<Integrator>
+{
+  friend class StaticSISOBlock<Integrator>;
+public:
+  Integrator(double initial_output = 0)
+    : StaticSISOBlock<Integrator>(initial_output) {};
+protected:
+  double InternalUpdate(double input, double timestep) {
+    return Output() + input * timestep;
+  }
+};
+
+/* Statically dispatched saturation: clamps the input to [low, high] */
+class Saturation : public StaticSISOBlock<Saturation>
+{
+  friend class StaticSISOBlock<Saturation>;
+public:
+  Saturation(double low, double high)
+    : low(low), high(high) {};
+protected:
+  double InternalUpdate(double input, double timestep) {
+    if (input > high) {
+      return high;
+    }
+    else if (input < low) {
+      return low;
+    }
+    return input;
+  }
+private:
+  double low, high;
+};
+
+/* Statically dispatched gain: y = kx */
+class Gain : public StaticSISOBlock<Gain>
+{
+  friend class StaticSISOBlock<Gain>;
+public:
+  Gain(double k)
+    : k(k) {};
+protected:
+  double InternalUpdate(double input, double timestep) {
+    return k * input;
+  }
+private:
+  double k;
+};
+
+/* Simulates a First-Order response of the form a(dy/dt) + by = x */
+class FirstOrderResponseBlock : public SISOBlock
+{
+public:
+  FirstOrderResponseBlock(double a, double b, double initial_output = 0,
+    Discretisation method = DISCRETISE_EULER)
+    : SISOBlock(initial_output), response(a, b, initial_output, method) {};
+protected:
+  virtual double InternalUpdate(double input, double timestep) {
+    return response.Update(input, timestep);
+  }
+private:
+  FirstOrderResponse response;
+};
+
+/* Integrates the input over time: dy/dt = x */
+class IntegratorBlock : public SISOBlock
+{
+public:
+  IntegratorBlock(double initial_output = 0)
+    : SISOBlock(initial_output), integrator(initial_output) {};
+protected:
+  virtual double InternalUpdate(double input, double timestep) {
+    return integrator.Update(input, timestep);
+  }
+private:
+  Integrator integrator;
 };
 
 #endif
@@ -0,0 +1,88 @@
+#ifndef SISO_CHAIN_H
+#define SISO_CHAIN_H
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+
+#include "common/siso_blocks.h"
+
+/*
+  Composes statically dispatched SISO blocks into pipelines, in which the
+  output of each block is the input of the next, e.g.
+
+    Chain<ClampedPID, FirstOrderResponse> aileron(
+      ClampedPID(10, 0, 0, -1, 1), FirstOrderResponse(0.1, 1));
+    double deflection = aileron.Update(roll_rate_error, timestep);
+
+  Every call is resolved at compile time, so a chain compiles to the same
+  straight-line arithmetic as updating each block by hand. A chain is itself a
+  StaticSISOBlock, so chains can be nested.
+*/
+
+template <typename... Blocks>
+class Chain : public StaticSISOBlock<Chain<Blocks...>>
+{
+  friend class StaticSISOBlock<Chain<Blocks...>>;
+public:
+  explicit Chain(const Blocks&... blocks)
+    : blocks(blocks...) {};
+
+  /* Returns the I'th block of the chain */
+  template <size_t I>
+  typename std::tuple_element<I, std::tuple<Blocks...>>::type& Get() {
+    return std::get<I>(blocks);
+  }
+  template <size_t I>
+  const typename std::tuple_element<I, std::tuple<Blocks...>>::type& Get() const {
+    return std::get<I>(blocks);
+  }
+
+protected:
+  double InternalUpdate(double input, double timestep) {
+    return UpdateFrom(input, timestep, std::integral_constant<size_t, 0>());
+  }
+
+private:
+  /* Updates block I and passes its output on to the rest of the chain */
+  template <size_t I>
+  double UpdateFrom(double input, double timestep, std::integral_constant<size_t, I>) {
+    return UpdateFrom(std::get<I>(blocks).Update(input, timestep), timestep,
+      std::integral_constant<size_t, I + 1>());
+  }
+
+  /* End of the chain */
+  double UpdateFrom(double input, double timestep, std::integral_constant<size_t, sizeof...(Blocks)>) {
+    return input;
+  }
+
+  std::tuple<Blocks...> blocks;
+};
+
+/* Creates a chain, deducing the block types from the arguments */
+template <typename... Blocks>
+Chain<Blocks...> MakeChain(const Blocks&... blocks) {
+  return Chain<Blocks...>(blocks...);
+}
+
+/* Wraps a statically dispatched block so it can be used where a SISOBlock is expected */
+template <typename Block>
+class SISOBlockAdapter : public SISOBlock
+{
+public:
+  explicit SISOBlockAdapter(const Block& block)
+    : SISOBlock(block.Output()), block(block) {};
+
+  /* Returns the wrapped block */
+  Block& Get() {
+    return block;
+  }
+protected:
+  virtual double InternalUpdate(double input, double timestep) override {
+    return block.Update(input, timestep);
+  }
+private:
+  Block block;
+};
+
+#endif
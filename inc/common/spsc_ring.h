@@ -0,0 +1,82 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+
+/*
+  Fixed capacity, lock-free ring buffer for passing items from exactly one
+  producer thread to exactly one consumer thread.
+
+  Neither side ever blocks or allocates: TryPush fails when the ring is full
+  and TryPop fails when it is empty. The producer and consumer indices live on
+  separate cache lines, and each side keeps a cached copy of the other's
+  index so that the shared line is only read when the cached copy says the
+  ring is full (or empty).
+
+  Items are copied in and out, so T should be a small, trivially copyable
+  record. Capacity must be a power of two.
+*/
+
+template <typename T, size_t Capacity>
+class SPSCRing
+{
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  SPSCRing()
+    : head(0), cached_tail(0), tail(0), cached_head(0) {}
+
+  SPSCRing(const SPSCRing&) = delete;
+  SPSCRing& operator=(const SPSCRing&) = delete;
+
+  /* Producer: appends an item, returns false if the ring is full */
+  bool TryPush(const T& item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - cached_tail == Capacity) {
+      cached_tail = tail.load(std::memory_order_acquire);
+      if (h - cached_tail == Capacity) {
+        return false;
+      }
+    }
+    items[h & MASK] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* Consumer: removes the oldest item, returns false if the ring is empty */
+  bool TryPop(T& item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == cached_head) {
+      cached_head = head.load(std::memory_order_acquire);
+      if (t == cached_head) {
+        return false;
+      }
+    }
+    item = items[t & MASK];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* Number of items waiting, exact only when called from one of the two threads
+     while the other is idle */
+  size_t Size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+
+private:
+  static const size_t MASK = Capacity - 1;
+  static const size_t CACHE_LINE = 64;
+
+  /* written by the producer */
+  alignas(CACHE_LINE) std::atomic<size_t> head;
+  size_t cached_tail;
+
+  /* written by the consumer */
+  alignas(CACHE_LINE) std::atomic<size_t> tail;
+  size_t cached_head;
+
+  alignas(CACHE_LINE) T items[Capacity];
+};
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef STATE_SPACE_H
+#define STATE_SPACE_H
+
+#include <cmath>
+#include <cstddef>
+
+#include "common/siso_blocks.h"
+
+/*
+  General linear blocks of any order, for actuators, sensor filters and
+  plant modes that do not fit the first order response.
+
+  A block is described by continuous time state-space matrices
+
+    dx/dt = A x + B u
+        y = C x + D u
+
+  or, for a single input and output, by a transfer function, and is
+  discretised exactly for an input held constant over each timestep (the
+  zero-order hold equivalent, through the matrix exponential). As with
+  FirstOrderResponse, the discrete matrices are computed once and reused for
+  as long as the timestep stays the same.
+
+  The order and the number of inputs and outputs are template parameters,
+  so every loop has a fixed trip count which the compiler unrolls: an update
+  of StateSpace<2> is a handful of multiply-adds with no loop overhead.
+  There are no hand-written specialisations for StateSpace<2> or
+  StateSpace<4>, and no explicit SIMD: a single block's update is a chain
+  of dependent multiply-adds, too short to gain from vectorisation, and the
+  generic template compiles to the same unrolled code a specialisation
+  would. The build also turns off floating-point contraction
+  (-ffp-contract=off), so the multiply-adds are not fused, and results are
+  the same whichever instructions the compiler chooses.
+
+  On each update the state is advanced over the timestep and the output is
+  computed from the new state, the same convention as FirstOrderResponse.
+*/
+
+namespace state_space {
+
+/* out = a b, for square K x K matrices */
+template <size_t K>
+void Multiply(const double (&a)[K][K], const double (&b)[K][K], double (&out)[K][K]) {
+  for (size_t i = 0; i < K; i++) {
+    for (size_t j = 0; j < K; j++) {
+      double sum = 0;
+      for (size_t k = 0; k < K; k++) {
+        sum += a[i][k] * b[k][j];
+      }
+      out[i][j] = sum;
+    }
+  }
+}
+
+/*
+  Matrix exponential by scaling and squaring: m is scaled down by a power of
+  two until its norm is below 1/2, where a Taylor series of 16 terms is
+  accurate to double precision, and the result is squared back up.
+*/
+template <size_t K>
+void Exponential(const double (&m)[K][K], double (&out)[K][K]) {
+  /* infinity norm */
+  double norm = 0;
+  for (size_t i = 0; i < K; i++) {
+    double row = 0;
+    for (size_t j = 0; j < K; j++) {
+      row += std::abs(m[i][j]);
+    }
+    norm = (row > norm) ? row : norm;
+  }
+  int squarings = 0;
+  if (norm > 0.5) {
+    squarings = static_cast<int>(std::ceil(std::log2(norm / 0.5)));
+  }
+  double scale = std::ldexp(1.0, -squarings);
+
+  double scaled[K][K], term[K][K], next[K][K];
+  for (size_t i = 0; i < K; i++) {
+    for (size_t j = 0; j < K; j++) {
+      scaled[i][j] = m[i][j] * scale;
+      term[i][j] = (i == j) ? 1 : 0;
+      out[i][j] = term[i][j];
+    }
+  }
+
+  const int TERMS = 16;
+  for (int n = 1; n <= TERMS; n++) {
+    Multiply(term, scaled, next);
+    for (size_t i = 0; i < K; i++) {
+      for (size_t j = 0; j < K; j++) {
+        term[i][j] = next[i][j] / n;
+        out[i][j] += term[i][j];
+      }
+    }
+  }
+
+  for (int s = 0; s < squarings; s++) {
+    Multiply(out, out, next);
+    for (size_t i = 0; i < K; i++) {
+      for (size_t j = 0; j < K; j++) {
+        out[i][j] = next[i][j];
+      }
+    }
+  }
+}
+
+} // namespace state_space
+
+/* Linear block of order N with M inputs and P outputs */
+template <size_t N, size_t M, size_t P>
+class StateSpaceMIMO
+{
+public:
+  StateSpaceMIMO(const double (&A)[N][N], const double (&B)[N][M],
+    const double (&C)[P][N], const double (&D)[P][M])
+    : cached_timestep(0) {
+    for (size_t i = 0; i < N; i++) {
+      for (size_t j = 0; j < N; j++) {
+        a[i][j] = A[i][j];
+        ad[i][j] = (i == j) ? 1 : 0;
+      }
+      for (size_t j = 0; j < M; j++) {
+        b[i][j] = B[i][j];
+        bd[i][j] = 0;
+      }
+      x[i] = 0;
+    }
+    for (size_t i = 0; i < P; i++) {
+      for (size_t j = 0; j < N; j++) {
+        c[i][j] = C[i][j];
+      }
+      for (size_t j = 0; j < M; j++) {
+        d[i][j] = D[i][j];
+      }
+      y[i] = 0;
+    }
+  }
+
+  /*
+    Advances the state by timestep with the inputs u held, and computes the
+    outputs from the new state. If no time has elapsed the outputs are held.
+  */
+  const double* Update(const double* u, double timestep) {
+    if (!(timestep > 0)) {
+      return y;
+    }
+    if (!SameTimestep(timestep, cached_timestep)) {
+      ComputeDiscreteModel(timestep);
+    }
+
+    double next[N];
+    for (size_t i = 0; i < N; i++) {
+      double sum = 0;
+      for (size_t j = 0; j < N; j++) {
+        sum += ad[i][j] * x[j];
+      }
+      for (size_t j = 0; j < M; j++) {
+        sum += bd[i][j] * u[j];
+      }
+      next[i] = sum;
+    }
+    for (size_t i = 0; i < N; i++) {
+      x[i] = next[i];
+    }
+
+    for (size_t i = 0; i < P; i++) {
+      double sum = 0;
+      for (size_t j = 0; j < N; j++) {
+        sum += c[i][j] * x[j];
+      }
+      for (size_t j = 0; j < M; j++) {
+        sum += d[i][j] * u[j];
+      }
+      y[i] = sum;
+    }
+    return y;
+  }
+
+  /* Outputs computed by the last update */
+  const double* Outputs() const {
+    return y;
+  }
+  double Output(size_t index) const {
+    return y[index];
+  }
+
+  /* The state vector, x */
+  const double* State() const {
+    return x;
+  }
+  void SetState(const double (&state)[N]) {
+    for (size_t i = 0; i < N; i++) {
+      x[i] = state[i];
+    }
+  }
+
+  /*
+    Discretises the model for timestep ahead of the first update. Copies of
+    a block made afterwards share the result, so that many instances of the
+    same model do not each compute it.
+  */
+  void Discretise(double timestep) {
+    if (timestep > 0 && !SameTimestep(timestep, cached_timestep)) {
+      ComputeDiscreteModel(timestep);
+    }
+  }
+
+private:
+  /* Zero-order hold: exp([A B; 0 0] timestep) = [Ad Bd; 0 I] */
+  void ComputeDiscreteModel(double timestep) {
+    const size_t K = N + M;
+    double augmented[K][K], result[K][K];
+    for (size_t i = 0; i < K; i++) {
+      for (size_t j = 0; j < K; j++) {
+        double value = 0;
+        if (i < N) {
+          value = (j < N) ? a[i][j] : b[i][j - N];
+        }
+        augmented[i][j] = value * timestep;
+      }
+    }
+    state_space::Exponential(augmented, result);
+    for (size_t i = 0; i < N; i++) {
+      for (size_t j = 0; j < N; j++) {
+        ad[i][j] = result[i][j];
+      }
+      for (size_t j = 0; j < M; j++) {
+        bd[i][j] = result[i][N + j];
+      }
+    }
+    cached_timestep = timestep;
+  }
+
+  /* continuous time model */
+  double a[N][N], b[N][M], c[P][N], d[P][M];
+
+  /* discretised for cached_timestep */
+  double ad[N][N], bd[N][M];
+  double cached_timestep;
+
+  double x[N];
+  double y[P];
+};
+
+/*
+  Statically dispatched single input, single output linear block of order N,
+  e.g. a second order actuator model:
+
+    const double num[] = { 0, 0, 400 };
+    const double den[] = { 1, 28, 400 };  // 400 / (s^2 + 28s + 400)
+    auto actuator = StateSpace<2>::FromTransferFunction(num, den);
+*/
+template <size_t N>
+class StateSpace : public StaticSISOBlock<StateSpace<N>>
+{
+  friend class StaticSISOBlock<StateSpace<N>>;
+public:
+  StateSpace(const double (&A)[N][N], const double (&B)[N], const double (&C)[N], double D)
+    : model(Model(A, B, C, D)) {}
+
+  /*
+    Realises num(s) / den(s), with the coefficients of both in order of
+    descending powers of s. The numerator may not be of higher order than
+    the denominator, whose leading coefficient must not be zero.
+  */
+  static StateSpace FromTransferFunction(const double (&num)[N + 1], const double (&den)[N + 1]) {
+    /* controllable canonical form */
+    double A[N][N] = {}, B[N] = {}, C[N];
+    double lead = den[0];
+    double D = num[0] / lead;
+    for (size_t j = 0; j < N; j++) {
+      /* the last row holds the characteristic polynomial, and each other
+         state is the derivative of the one before it */
+      A[N - 1][j] = -den[N - j] / lead;
+      if (j + 1 < N) {
+        A[j][j + 1] = 1;
+      }
+      C[j] = num[N - j] / lead - D * den[N - j] / lead;
+    }
+    B[N - 1] = 1;
+    return StateSpace(A, B, C, D);
+  }
+
+  /* Discretises the model ahead of the first update, see StateSpaceMIMO */
+  void Discretise(double timestep) {
+    model.Discretise(timestep);
+  }
+
+  /* The state vector */
+  const double* State() const {
+    return model.State();
+  }
+  void SetState(const double (&state)[N]) {
+    model.SetState(state);
+  }
+
+protected:
+  double InternalUpdate(double input, double timestep) {
+    return *model.Update(&input, timestep);
+  }
+
+private:
+  /* The block as a MIMO block with one input and one output */
+  static StateSpaceMIMO<N, 1, 1> Model(const double (&A)[N][N], const double (&B)[N],
+    const double (&C)[N], double D) {
+    double b[N][1], c[1][N], d[1][1] = { { D } };
+    for (size_t i = 0; i < N; i++) {
+      b[i][0] = B[i];
+      c[0][i] = C[i];
+    }
+    return StateSpaceMIMO<N, 1, 1>(A, b, c, d);
+  }
+
+  StateSpaceMIMO<N, 1, 1> model;
+};
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef SUBSCRIPTIONS_H
+#define SUBSCRIPTIONS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/sim_data.h"
+
+/*
+  Data subscriptions planned from what their consumers need, rather than
+  every struct being streamed in full on every frame.
+
+  Each consumer declares how it uses the data in a struct (declared with
+  SIM_DATA_DEFINITION), and the manager picks the request's period,
+  interval, flags and per-field epsilons:
+
+  * EveryFrame() - the consumer runs when the data arrives (e.g. the frame
+    data that drives the control loops), so it is sent in full every frame
+  * Periodic(rate_hz) - as EveryFrame, but the consumer runs at a lower
+    rate, so the data is only sent as often as that
+  * OnChange(rate_hz) - the consumer holds on to the last values received
+    (e.g. a selected heading, or the flight condition a gain schedule is
+    keyed on), so the data is only sent when it changes, checked at rate_hz
+    (every frame by default). Only the fields which changed are sent if
+    there are several, in tagged format, and Resolution sets the smallest
+    change in a field that matters to the consumer, in its units
+
+  e.g.
+
+    SubscriptionManager subscriptions(30);   // simulator frames per second
+    subscriptions.Subscribe<structFrameData>(hSimConnect, "Frame data", SubscriptionNeeds::EveryFrame());
+    subscriptions.Subscribe<structFlightCondition>(hSimConnect, "Flight condition",
+      SubscriptionNeeds::OnChange(2).Resolution("AIRSPEED INDICATED", 1).Resolution("PLANE ALTITUDE", 50));
+    ...
+    if (subscriptions.Receive(pObjData, cbData, condition)) { ... }
+
+  Receive merges tagged data into the last values received, so a consumer
+  always sees a whole struct. The manager counts the messages and bytes
+  received for each subscription, and PrintStats compares them with what
+  streaming every struct in full on every frame would have cost.
+*/
+
+/* What a consumer needs of the data in one struct */
+class SubscriptionNeeds
+{
+public:
+  /* The consumer runs on every frame's data */
+  static SubscriptionNeeds EveryFrame() {
+    return SubscriptionNeeds(0, false);
+  }
+
+  /* The consumer runs on data received at rate_hz */
+  static SubscriptionNeeds Periodic(double rate_hz) {
+    return SubscriptionNeeds(rate_hz, false);
+  }
+
+  /* The consumer keeps the last values received, which need to be no more
+     than 1 / rate_hz out of date, or a frame if rate_hz is 0 */
+  static SubscriptionNeeds OnChange(double rate_hz = 0) {
+    return SubscriptionNeeds(rate_hz, true);
+  }
+
+  /* Changes in the field holding simvar (as declared by SIM_DATA_FIELD) of
+     no more than resolution, in the field's units, do not matter to the
+     consumer. Only applies to OnChange. */
+  SubscriptionNeeds& Resolution(const char* simvar, double resolution) {
+    resolutions.push_back(std::make_pair(simvar, resolution));
+    return *this;
+  }
+
+  double RateHz() const {
+    return rate_hz;
+  }
+  bool IsOnChange() const {
+    return on_change;
+  }
+  const std::vector<std::pair<const char*, double>>& Resolutions() const {
+    return resolutions;
+  }
+
+private:
+  SubscriptionNeeds(double rate_hz, bool on_change)
+    : rate_hz(rate_hz), on_change(on_change) {}
+
+  double rate_hz;
+  bool on_change;
+  std::vector<std::pair<const char*, double>> resolutions;
+};
+
+/* The parameters of SimConnect_RequestDataOnSimObject for a subscription */
+struct SubscriptionPlan {
+  SIMCONNECT_PERIOD period;
+  DWORD interval;    /* periods skipped between transmissions */
+  SIMCONNECT_DATA_REQUEST_FLAG flags;
+};
+
+class SubscriptionManager
+{
+public:
+  /* frame_rate_hz is the simulator's frame rate, to convert rates to frames */
+  explicit SubscriptionManager(double frame_rate_hz)
+    : frame_rate_hz(frame_rate_hz) {}
+
+  /*
+    Plans the request for a struct of field_count fields. The data is never
+    sent less often than needed: the interval is rounded down.
+  */
+  static SubscriptionPlan Plan(const SubscriptionNeeds& needs, size_t field_count, double frame_rate_hz) {
+    SubscriptionPlan plan;
+    double rate = needs.RateHz();
+    if (!(rate > 0) || rate >= frame_rate_hz) {
+      plan.period = SIMCONNECT_PERIOD_SIM_FRAME;
+      plan.interval = 0;
+    }
+    else if (rate >= 1) {
+      plan.period = SIMCONNECT_PERIOD_SIM_FRAME;
+      plan.interval = static_cast<DWORD>(std::floor(frame_rate_hz / rate)) - 1;
+    }
+    else {
+      plan.period = SIMCONNECT_PERIOD_SECOND;
+      plan.interval = static_cast<DWORD>(std::floor(1 / rate)) - 1;
+    }
+
+    plan.flags = 0;
+    if (needs.IsOnChange()) {
+      plan.flags |= SIMCONNECT_DATA_REQUEST_FLAG_CHANGED;
+      if (field_count > 1) {
+        plan.flags |= SIMCONNECT_DATA_REQUEST_FLAG_TAGGED;
+      }
+    }
+    return plan;
+  }
+
+  /*
+    Registers the data definition of T, with the epsilons of the fields
+    given a resolution, and requests it as planned from needs. Fails if a
+    resolution names a SimVar which T does not hold.
+  */
+  template <typename T>
+  HRESULT Subscribe(HANDLE hSimConnect, const char* name, const SubscriptionNeeds& needs,
+    SIMCONNECT_OBJECT_ID object = SIMCONNECT_OBJECT_ID_USER) {
+    size_t count;
+    const SimDataField* fields = SimDataTraits<T>::Fields(&count);
+    std::vector<float> epsilons(count, 0.0f);
+    for (const auto& resolution : needs.Resolutions()) {
+      size_t i = 0;
+      while (i < count && std::strcmp(fields[i].simvar, resolution.first) != 0) {
+        i++;
+      }
+      if (i == count) {
+        return E_FAIL;
+      }
+      epsilons[i] = static_cast<float>(resolution.second);
+    }
+
+    HRESULT res = SimData<T>::Register(hSimConnect, epsilons.data());
+    if (res != S_OK) {
+      return res;
+    }
+    SubscriptionPlan plan = Plan(needs, count, frame_rate_hz);
+    res = SimData<T>::Request(hSimConnect, object, plan.period, plan.flags, 0, plan.interval);
+    if (res != S_OK) {
+      return res;
+    }
+
+    Subscription subscription;
+    subscription.name = name;
+    subscription.request_id = SimData<T>::RequestID();
+    subscription.plan = plan;
+    subscription.full_size = HEADER_SIZE + sizeof(T);
+    subscriptions.push_back(subscription);
+    return S_OK;
+  }
+
+  /*
+    Copies the data received for T's subscription into data, merging tagged
+    data into the values already there. Returns false if the message is not
+    for that subscription.
+  */
+  template <typename T>
+  bool Receive(const SIMCONNECT_RECV_SIMOBJECT_DATA* msg, DWORD size, T& data) {
+    if (msg->dwRequestID != SimData<T>::RequestID() || !SimData<T>::Update(msg, size, data)) {
+      return false;
+    }
+    for (Subscription& subscription : subscriptions) {
+      if (subscription.request_id == msg->dwRequestID) {
+        subscription.messages++;
+        subscription.bytes += size;
+      }
+    }
+    return true;
+  }
+
+  /*
+    Prints the messages and bytes received for each subscription over
+    elapsed_s simulated seconds, and what they would have been had every
+    struct been sent in full on every frame.
+  */
+  void PrintStats(FILE* out, double elapsed_s) const {
+    double seconds = (elapsed_s > 0) ? elapsed_s : 1;
+    double frames = (elapsed_s > 0) ? elapsed_s * frame_rate_hz : 1;
+    uint64_t messages = 0, bytes = 0;
+    size_t full_size = 0;
+    for (const Subscription& subscription : subscriptions) {
+      fprintf(out, "%s: %s, %llu messages (%.2f per second), %.2f bytes per frame\n",
+        subscription.name, Describe(subscription.plan).c_str(),
+        static_cast<unsigned long long>(subscription.messages), subscription.messages / seconds,
+        subscription.bytes / frames);
+      messages += subscription.messages;
+      bytes += subscription.bytes;
+      full_size += subscription.full_size;
+    }
+    fprintf(out, "Subscriptions: %.1f messages per second and %.1f bytes per frame, "
+      "against %.1f and %zu if sent in full every frame\n",
+      messages / seconds, bytes / frames, subscriptions.size() * frame_rate_hz, full_size);
+  }
+
+private:
+  static const size_t HEADER_SIZE = sizeof(SIMCONNECT_RECV_SIMOBJECT_DATA) - sizeof(DWORD);
+
+  struct Subscription {
+    const char* name;
+    SIMCONNECT_DATA_REQUEST_ID request_id;
+    SubscriptionPlan plan;
+    size_t full_size;   /* size of a message holding the whole struct */
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+  };
+
+  /* e.g. "every 15 frames, on change, tagged" */
+  static std::string Describe(const SubscriptionPlan& plan) {
+    char description[80];
+    const char* unit = (plan.period == SIMCONNECT_PERIOD_SECOND) ? "second" : "frame";
+    if (plan.interval == 0) {
+      snprintf(description, sizeof(description), "every %s", unit);
+    }
+    else {
+      snprintf(description, sizeof(description), "every %lu %ss", static_cast<unsigned long>(plan.interval) + 1, unit);
+    }
+    std::string res(description);
+    if (plan.flags & SIMCONNECT_DATA_REQUEST_FLAG_CHANGED) {
+      res += ", on change";
+    }
+    if (plan.flags & SIMCONNECT_DATA_REQUEST_FLAG_TAGGED) {
+      res += ", tagged";
+    }
+    return res;
+  }
+
+  double frame_rate_hz;
+  std::vector<Subscription> subscriptions;
+};
+
+#endif
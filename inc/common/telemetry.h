@@ -0,0 +1,115 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#include "common/spsc_ring.h"
+
+/*
+  Logging for the control path, which must never wait on console or file I/O.
+
+  The control thread copies fixed-size binary records into a lock-free ring
+  and a background thread formats them to the console or a file. If the ring
+  is full the record is dropped and counted instead of blocking the control
+  thread. The background thread polls the ring every DRAIN_INTERVAL, so the
+  control thread never has to wake it.
+
+  Only one thread may call Log.
+*/
+
+template <typename Record, size_t Capacity = 4096>
+class Telemetry
+{
+public:
+  /* Writes a record to the output, called on the background thread */
+  typedef void (*Formatter)(FILE* out, const Record& record);
+
+  explicit Telemetry(Formatter format)
+    : format(format), out(nullptr), logged(0), dropped(0), stopping(false) {}
+
+  ~Telemetry() {
+    Stop();
+  }
+
+  /* Starts writing records to out */
+  void Start(FILE* output) {
+    if (drain_thread.joinable()) {
+      return;
+    }
+    out = output;
+    stopping.store(false);
+    drain_thread = std::thread(&Telemetry::Drain, this);
+  }
+
+  /* Writes any records still waiting, prints the record counts and stops */
+  void Stop() {
+    if (!drain_thread.joinable()) {
+      return;
+    }
+    stopping.store(true);
+    drain_thread.join();
+    fprintf(out, "Telemetry: %llu records, %llu dropped\n",
+      static_cast<unsigned long long>(Logged()), static_cast<unsigned long long>(Dropped()));
+    fflush(out);
+  }
+
+  /* Queues a record, returns false if it was dropped because the ring was full */
+  bool Log(const Record& record) {
+    /* only this thread writes the counters, so no read-modify-write is needed */
+    if (!ring.TryPush(record)) {
+      dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    logged.store(logged.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /* Number of records queued and dropped */
+  uint64_t Logged() const {
+    return logged.load(std::memory_order_relaxed);
+  }
+  uint64_t Dropped() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  /* How long the background thread sleeps when it finds the ring empty */
+  static constexpr std::chrono::milliseconds DRAIN_INTERVAL{ 10 };
+
+  void Drain() {
+    Record record;
+    for (;;) {
+      bool stop = stopping.load();
+      while (ring.TryPop(record)) {
+        format(out, record);
+      }
+      /* records logged before stopping was set have all been written */
+      if (stop) {
+        break;
+      }
+      fflush(out);
+      std::this_thread::sleep_for(DRAIN_INTERVAL);
+    }
+    fflush(out);
+  }
+
+  Formatter format;
+  FILE* out;
+
+  std::atomic<uint64_t> logged;
+  std::atomic<uint64_t> dropped;
+
+  std::atomic<bool> stopping;
+  std::thread drain_thread;
+
+  SPSCRing<Record, Capacity> ring;
+};
+
+template <typename Record, size_t Capacity>
+constexpr std::chrono::milliseconds Telemetry<Record, Capacity>::DRAIN_INTERVAL;
+
+#endif
@@ -3,7 +3,11 @@
 
 /* util.h defines a set of useful utility functions and macros */
 
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 
 /* macro for checking result of SimConnect operations */
 #define ASSERT_SC_SUCCESS(expr)                                    \
@@ -27,4 +31,10 @@ constexpr double sign(double val) {
   return (val > 0) ? 1.0 : -1.0;
 }
 
+/* returns a monotonic timestamp in nanoseconds */
+inline uint64_t MonotonicTimeNs() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
 #endif
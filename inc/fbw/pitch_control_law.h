@@ -0,0 +1,96 @@
+#ifndef PITCH_CONTROL_LAW_H
+#define PITCH_CONTROL_LAW_H
+
+#include <cmath>
+
+#include "common/util.h"
+
+/*
+  The pitch control law of the FBW example: fore-aft side-stick deflection
+  commands a load factor, with load factor and pitch attitude protection.
+
+  As in the Airbus normal law, with the stick neutral the law demands the
+  load factor which holds the flight path, so the aircraft keeps its pitch
+  attitude hands off, compensated for bank up to NOMINAL_PITCH_COMPENSATION_BANK
+  (beyond that the pilot has to pull to hold the nose up in a turn).
+
+  Kept free of any SimConnect state, like the roll control law.
+*/
+
+/* The load factor limits, those of an airliner in the clean configuration */
+const double MAX_LOAD_FACTOR = 2.5;
+const double MIN_LOAD_FACTOR = -1;
+
+/* The pitch attitude limits */
+const double MAX_PITCH_UP_ANGLE = radians(30);
+const double MAX_PITCH_DOWN_ANGLE = radians(15);
+
+/* The margin inside each pitch attitude limit over which the stick's
+   authority towards it is reduced to nothing */
+const double PITCH_CLAMPING_MARGIN = radians(5);
+
+/* The load factor increment commanded back from beyond a pitch attitude limit */
+const double RESTORING_LOAD_FACTOR = 0.2;
+
+/* The bank angle up to which the law compensates for the bank */
+const double NOMINAL_PITCH_COMPENSATION_BANK = radians(33);
+
+/*
+  The pitch protection as data, in the style of RollProtectionEnvelope:
+
+  * Full back stick commands max_load_factor and full forward stick
+    min_load_factor, linearly from the 1 g (compensated) of stick neutral
+  * Pulling towards max_pitch_up, the load factor increment allowed falls
+    linearly from full at clamping_margin below it to none at it, and
+    likewise pushing towards max_pitch_down
+  * Beyond either limit, the law commands restoring_load_factor back
+    towards it, whatever the stick and the bank
+*/
+struct PitchProtectionEnvelope {
+  double max_load_factor = MAX_LOAD_FACTOR;
+  double min_load_factor = MIN_LOAD_FACTOR;
+  double max_pitch_up = MAX_PITCH_UP_ANGLE;
+  double max_pitch_down = MAX_PITCH_DOWN_ANGLE;
+  double clamping_margin = PITCH_CLAMPING_MARGIN;
+  double restoring_load_factor = RESTORING_LOAD_FACTOR;
+  double compensation_bank = NOMINAL_PITCH_COMPENSATION_BANK;
+
+  /*
+    Computes the desired load factor from the stick input in [-1, 1]
+    (positive pulled back), the pitch angle (positive nose down) and the
+    bank angle, including applying protection
+  */
+  double DesiredLoadFactor(double stick_input, double pitch_rad, double bank_rad) const {
+    double nose_up = -pitch_rad;
+
+    /* the load factor which holds the flight path */
+    double bank = std::fmin(std::abs(bank_rad), compensation_bank);
+    double hold = std::cos(nose_up) / std::cos(bank);
+
+    double increment = (stick_input > 0) ? stick_input * (max_load_factor - 1) :
+      stick_input * (1 - min_load_factor);
+
+    /* the stick's authority towards each pitch limit fades out within the
+       clamping margin of it */
+    double up_room = std::fmax(0.0, std::fmin(1.0, (max_pitch_up - nose_up) / clamping_margin));
+    double down_room = std::fmax(0.0, std::fmin(1.0, (nose_up + max_pitch_down) / clamping_margin));
+    increment *= (increment > 0) ? up_room : down_room;
+
+    double demand = hold + increment;
+
+    /* and beyond the limits the aircraft is brought back inside them, with
+       the bank compensated in full: hands off in a steep turn the nose
+       drops, but not beyond max_pitch_down */
+    double full_hold = std::cos(nose_up) / std::cos(bank_rad);
+    if (nose_up > max_pitch_up) {
+      demand = std::fmin(demand, full_hold - restoring_load_factor);
+    }
+    else if (nose_up < -max_pitch_down) {
+      demand = std::fmax(demand, full_hold + restoring_load_factor);
+    }
+
+    return std::fmax(min_load_factor, std::fmin(max_load_factor, demand));
+  }
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef ROLL_CONTROL_LAW_H
+#define ROLL_CONTROL_LAW_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+
+#include "common/util.h"
+
+/*
+  The roll control law of the roll FBW example: horizontal side-stick
+  deflection commands a roll rate, with bank angle protection.
+
+  Kept free of any SimConnect state so that the same law can be flown by the
+  example and evaluated offline (see RollEnvelopeSweep).
+*/
+
+/* Relationship between requested roll rate and joystick input */
+const double RAD_S_PER_UNIT_DEFLECTION = 0.15;
+const double MAX_REQUESTABLE_ROLL_RATE = RAD_S_PER_UNIT_DEFLECTION;
+
+/* The roll rate to command when roll protection activates */
+const double RESTORING_ROLL_RATE = radians(5); // per second
+
+/* The bank angle at which clamping begins to prevent overbank */
+const double BANK_CLAMPING_ANGLE = radians(60);
+
+/* The maximum bank angle allowed */
+const double MAX_BANK_ANGLE = radians(67);
+
+/* The nominal bank angle: the usual bank angle for turns */
+const double NOMINAL_BANK_ANGLE = radians(33);
+
+/*
+  The bank angle protection as data: a piecewise-linear description of the
+  roll rates allowed at each bank angle.
+
+  * Side-stick deflection commands rate_per_deflection per unit
+  * Rolling towards the bank, the allowed roll rate falls linearly from the
+    full rate at clamping_bank to 0 at max_bank
+  * Hands off beyond nominal_bank, the aircraft rolls back towards it at
+    restoring_rate
+  * At or beyond max_bank, it rolls back at restoring_rate whatever the stick
+
+  The default envelope is that of the constants above, and is the one flown
+  by CalculateDesiredRollRate. It is evaluated without branches: every case
+  is computed and the applicable one selected, so a batch of aircraft can be
+  evaluated in a vectorised loop (DesiredRollRates). WriteTable exports the
+  roll rates commanded across the envelope, from which
+  doc/AllowedRollRatesvsBank.png is plotted (see doc/AllowedRollRatesvsBank.gp).
+*/
+struct RollProtectionEnvelope {
+  double rate_per_deflection = RAD_S_PER_UNIT_DEFLECTION;
+  double restoring_rate = RESTORING_ROLL_RATE;
+  double nominal_bank = NOMINAL_BANK_ANGLE;
+  double clamping_bank = BANK_CLAMPING_ANGLE;
+  double max_bank = MAX_BANK_ANGLE;
+
+  /*
+    Computes the desired roll rate (positive right) from the joystick input in
+    [-1, 1] and the bank angle (positive left), including applying protection
+  */
+  double DesiredRollRate(double joystick_input, double bank_rad) const {
+    double desired_roll_rate_rad_s = rate_per_deflection * joystick_input;
+    double bank = std::abs(bank_rad);
+
+    /* directions as sign() gives them: zero counts as negative */
+    bool banked_left = (bank_rad > 0);
+    bool rolling_right = (desired_roll_rate_rad_s > 0);
+
+    /* roll rate back towards the nominal bank */
+    double restoring = banked_left ? restoring_rate : -restoring_rate;
+
+    /* rolling in the direction of bank: the allowed roll rate reduces
+       linearly as the maximum bank angle is approached */
+    bool isRollingBankDir = (banked_left != rolling_right);
+    double max_roll_rate = rate_per_deflection +
+      (bank - clamping_bank) * (0 - rate_per_deflection) / (max_bank - clamping_bank);
+    double limit = rolling_right ? max_roll_rate : -max_roll_rate;
+    bool over_limit = (std::abs(desired_roll_rate_rad_s) > max_roll_rate);
+
+    /* select the applicable case; & and | rather than && and || so that
+       every condition is evaluated without branching */
+    bool hands_off = (joystick_input == 0);
+    bool clamp = (bank > clamping_bank) & isRollingBankDir & !hands_off & over_limit;
+    bool restore = ((bank > nominal_bank) & hands_off) | (bank >= max_bank);
+    double result = clamp ? limit : desired_roll_rate_rad_s;
+    return restore ? restoring : result;
+  }
+
+  /* Computes the desired roll rates of count aircraft */
+  void DesiredRollRates(size_t count, const double* joystick_inputs, const double* banks_rad,
+    double* roll_rates_rad_s) const {
+    Kernel(*this, count, joystick_inputs, banks_rad, roll_rates_rad_s);
+  }
+
+  /*
+    Writes the desired roll rate in degrees per second at every step_deg of
+    bank from -max_deg to max_deg, as CSV with a column per stick position
+  */
+  void WriteTable(FILE* out, double max_deg = 80, double step_deg = 0.25) const {
+    const double STICKS[] = { -1, -0.5, 0, 0.5, 1 };
+    fprintf(out, "bank_deg,full_left,half_left,hands_off,half_right,full_right\n");
+    int steps = static_cast<int>(std::floor(max_deg / step_deg + 0.5));
+    for (int k = -steps; k <= steps; k++) {
+      double bank_deg = k * step_deg;
+      fprintf(out, "%.2f", bank_deg);
+      for (double stick : STICKS) {
+        fprintf(out, ",%.4f", degrees(DesiredRollRate(stick, radians(bank_deg))));
+      }
+      fprintf(out, "\n");
+    }
+  }
+
+private:
+  /* The batch loop, with the arrays declared not to alias so that the
+     compiler can vectorise it */
+  static void Kernel(RollProtectionEnvelope envelope, size_t count, const double* __restrict joystick_inputs,
+    const double* __restrict banks_rad, double* __restrict roll_rates_rad_s) {
+    for (size_t k = 0; k < count; k++) {
+      roll_rates_rad_s[k] = envelope.DesiredRollRate(joystick_inputs[k], banks_rad[k]);
+    }
+  }
+};
+
+/*
+  Computes the desired roll rate (positive right) from the joystick input in
+  [-1, 1] and the bank angle (positive left), including applying protection
+*/
+inline double CalculateDesiredRollRate(double joystick_input, double bank_rad) {
+  return RollProtectionEnvelope().DesiredRollRate(joystick_input, bank_rad);
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef YAW_DAMPER_H
+#define YAW_DAMPER_H
+
+#include "common/PIDController.h"
+#include "common/siso_chain.h"
+#include "common/state_space.h"
+
+/*
+  The yaw damper of the FBW example: damps the Dutch roll by deflecting the
+  rudder against the yaw rate.
+
+  The yaw rate is washed out (high-pass filtered) first, so that the damper
+  only acts on its oscillations and does not oppose the steady yaw rate of a
+  turn, then multiplied by the gain and clamped to the damper's authority.
+  Built from the common blocks:
+
+    YawDamper yaw_damper = MakeYawDamper();
+    double rudder = yaw_damper.Update(0 - yaw_rate_rad_s, timestep);   // error from no yaw rate
+
+  The gain and authority are those of the ClampedPID, Get<1>(), and can be
+  changed with its setters while the damper runs.
+*/
+
+/* Rudder deflection per rad/s of yaw rate */
+const double YAW_DAMPER_GAIN = 2;
+
+/* Time constant of the washout filter: yaw rates held for longer than this
+   are let through */
+const double YAW_DAMPER_WASHOUT_S = 3;
+
+/* The largest rudder deflection the damper commands */
+const double YAW_DAMPER_AUTHORITY = 0.3;
+
+typedef Chain<StateSpace<1>, ClampedPID> YawDamper;
+
+/* High-pass filter tau s / (tau s + 1) */
+inline StateSpace<1> Washout(double time_constant_s) {
+  const double num[] = { time_constant_s, 0 };
+  const double den[] = { time_constant_s, 1 };
+  return StateSpace<1>::FromTransferFunction(num, den);
+}
+
+inline YawDamper MakeYawDamper(double gain = YAW_DAMPER_GAIN, double authority = YAW_DAMPER_AUTHORITY,
+  double washout_s = YAW_DAMPER_WASHOUT_S) {
+  return YawDamper(Washout(washout_s), ClampedPID(gain, 0, 0, -authority, authority));
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef LOCALSIMCONNECT_H
+#define LOCALSIMCONNECT_H
+
+/*
+  Configuration and statistics interface of the local SimConnect
+  implementation.
+
+  The local simulator implements the subset of the SimConnect API used by the
+  examples (data definitions with per-datum epsilons, data requests with
+  the changed and tagged flags, data requests by object type,
+  SetDataOnSimObject in full or tagged format, input event mapping and the
+  quit message) on top of AircraftModel, for the user aircraft and any
+  number of AI aircraft.
+
+  By default the simulator runs in lockstep with the client: every call to
+  SimConnect_CallDispatch that finds no pending messages advances the
+  simulation by one frame, so each frame is handled to completion before
+  the next is simulated, and clients run as fast as they can process
+  frames. Nothing in a lockstep run depends on the wall clock: the frame
+  jitter and dropped frames are drawn from a sequence chosen by the seed,
+  so a run is bitwise reproducible. To check that, a hash of every message
+  delivered to the client and all the data it sets is printed on close.
+  Alternatively, in real time mode frames are generated at the configured
+  rate by a separate thread, as they would be by the simulator.
+
+  Instead of simulating, the local simulator can replay a recording made with
+  FlightRecorder (inc/common/flight_recording.h): the recorded messages are
+  delivered to the client as fast as it dispatches them, and the data it
+  sets is compared with the recorded outputs. If the recording cannot be
+  read SimConnect_Open fails with E_INVALIDARG.
+
+  If an event handle is passed to SimConnect_Open it is signalled whenever
+  messages are waiting. The latency between a data message being posted and
+  the client's next call to SimConnect_SetDataOnSimObject is recorded.
+
+  Unless LocalSim_SetConfig is called, SimConnect_Open configures the
+  simulator from the following environment variables:
+  * LOCALSIM_DURATION    - simulated seconds before the quit message (600)
+  * LOCALSIM_FRAME_RATE  - simulated frames per second (30)
+  * LOCALSIM_STICK       - joystick profile: "steps", "sine" or "none" (steps)
+  * LOCALSIM_PITCH_STICK - joystick y-axis profile, as LOCALSIM_STICK (steps)
+  * LOCALSIM_REALTIME    - if set, run in real time scaled by this factor
+  * LOCALSIM_FRAME_JITTER - vary the frame length by up to this fraction (0)
+  * LOCALSIM_DROP_FRAMES - fraction of frames that send no data (0)
+  * LOCALSIM_SEED        - seed of the frame jitter and dropped frames (0)
+  * LOCALSIM_AI_AIRCRAFT - number of AI aircraft to simulate (0)
+  * LOCALSIM_QUIET       - set to suppress the statistics printed on close
+  * LOCALSIM_REPLAY      - replay the recording in this file
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "common/aircraft_model.h"
+#include "common/latency_histogram.h"
+
+/* Configuration of a local simulator session */
+struct LocalSimConfig {
+  double frame_rate_hz = 30;    /* simulated frames per simulated second */
+  double duration_s = 600;      /* simulated seconds before quit is sent */
+  double realtime_speed = 0;    /* if > 0, generate frames in real time scaled by this factor */
+
+  /* Irregular frames, to exercise the clients' timestep handling: each
+     frame's length varies randomly by up to this fraction of the nominal
+     frame, and this fraction of frames send no data */
+  double frame_jitter = 0;
+  double frame_drop_rate = 0;
+  uint64_t seed = 0;            /* selects the frames jittered and dropped */
+
+  /* AI aircraft simulated alongside the user aircraft, with the same
+     parameters and initial state except for their headings */
+  size_t ai_aircraft = 0;
+
+  AircraftModel::Parameters aircraft;
+  AircraftModel::State initial_state;
+
+  /* Joystick x-axis in [-1, 1] as a function of simulated time */
+  std::function<double(double)> joystick_x;
+
+  /* Joystick y-axis in [-1, 1], positive pulled back, as a function of
+     simulated time */
+  std::function<double(double)> joystick_y;
+
+  /* Autopilot selected heading in degrees as a function of simulated time */
+  std::function<double(double)> autopilot_heading_deg;
+
+  bool print_stats = true;      /* print statistics to stderr on close */
+
+  /* If set, replay this recording instead of simulating */
+  std::string replay_path;
+};
+
+/* Statistics gathered over a local simulator session */
+struct LocalSimStats {
+  uint64_t frames = 0;            /* simulated frames generated */
+  uint64_t dropped_frames = 0;    /* of which sent no data, see frame_drop_rate */
+  uint64_t messages = 0;          /* messages passed to the dispatch procedure */
+  uint64_t data_messages = 0;     /* of which SIMOBJECT_DATA */
+  uint64_t data_bytes = 0;        /* size of the SIMOBJECT_DATA messages, headers included */
+  uint64_t set_data_calls = 0;    /* calls to SimConnect_SetDataOnSimObject */
+  uint64_t set_data_bytes = 0;    /* bytes of data set by them */
+  double   sim_time_s = 0;        /* simulated time elapsed */
+  double   wall_time_s = 0;       /* real time elapsed since open */
+  double   dispatch_time_s = 0;   /* real time spent in the client's handler for data messages */
+  double   cpu_time_s = 0;        /* process CPU time used since open */
+
+  /* time from a data message being posted to the client's first
+     SetDataOnSimObject call while handling it */
+  LatencyHistogram output_latency;
+
+  /* FNV-1a hash of the messages delivered to the client and the data it
+     set, in order: the same for every lockstep run of the same client with
+     the same configuration */
+  uint64_t run_hash = 0xCBF29CE484222325ull;
+
+  /* when replaying a recording */
+  uint64_t replayed_messages = 0;   /* recorded messages passed to the dispatch procedure */
+  uint64_t replayed_outputs = 0;    /* SetDataOnSimObject calls compared with the recording */
+  uint64_t output_mismatches = 0;   /* of which differed from the recorded output */
+  double   max_output_difference = 0;  /* largest difference between doubles in mismatching outputs */
+};
+
+/* Returns the configuration described by the LOCALSIM_* environment variables */
+LocalSimConfig LocalSim_ConfigFromEnvironment();
+
+/* Sets the configuration used by subsequent calls to SimConnect_Open */
+void LocalSim_SetConfig(const LocalSimConfig& config);
+
+/* Returns the statistics of an open connection */
+LocalSimStats LocalSim_GetStats(HANDLE hSimConnect);
+
+/* Returns whether an open connection only simulates, or replays, a frame
+   when the client dispatches with no messages waiting: in lockstep and when
+   replaying, but not in real time */
+bool LocalSim_IsLockstep(HANDLE hSimConnect);
+
+/* Returns the aircraft model of an open connection */
+const AircraftModel& LocalSim_GetAircraft(HANDLE hSimConnect);
+
+#endif
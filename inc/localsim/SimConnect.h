@@ -0,0 +1,14 @@
+#ifndef LOCALSIM_SIMCONNECT_H
+#define LOCALSIM_SIMCONNECT_H
+
+/*
+  Drop-in replacement for external/SimConnect.h on platforms without the
+  SimConnect SDK. The declarations are the SDK's own; the functions are
+  implemented by the local simulator in LocalSim/LocalSimConnect.cpp.
+*/
+
+#include "localsim/win_compat.h"
+#include "external/SimConnect.h"
+#include "localsim/LocalSimConnect.h"
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef WIN_COMPAT_H
+#define WIN_COMPAT_H
+
+/*
+  Minimal definitions of the Windows types and macros used by SimConnect.h and
+  the examples, so that they can be compiled against the local SimConnect
+  implementation on other platforms.
+
+  DWORD is 32 bits wide on Windows, and the SimConnect message structures rely
+  on this, so fixed width types are used throughout.
+*/
+
+#include <cstdint>
+
+typedef uint32_t  DWORD;
+typedef int32_t   HRESULT;
+typedef int       BOOL;
+typedef uint8_t   BYTE;
+typedef void*     HANDLE;
+typedef void*     HWND;
+typedef const char* LPCSTR;
+typedef char      _TCHAR;
+
+struct GUID {
+  uint32_t Data1;
+  uint16_t Data2;
+  uint16_t Data3;
+  uint8_t  Data4[8];
+};
+
+#ifndef TRUE
+#define TRUE  1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define S_OK    ((HRESULT)0)
+#define E_FAIL  ((HRESULT)0x80004005)
+#define E_INVALIDARG  ((HRESULT)0x80070057)
+
+#define MAX_PATH 260
+
+#define CALLBACK
+#define __stdcall
+
+/*
+  Event objects, as passed to SimConnect_Open to be signalled when messages
+  are waiting. Only unnamed events are supported.
+*/
+
+#define INFINITE       0xFFFFFFFF
+#define WAIT_OBJECT_0  0x00000000
+#define WAIT_TIMEOUT   0x00000102
+#define WAIT_FAILED    0xFFFFFFFF
+
+HANDLE CreateEvent(void* lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCSTR lpName);
+BOOL SetEvent(HANDLE hEvent);
+BOOL ResetEvent(HANDLE hEvent);
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds);
+BOOL CloseHandle(HANDLE hObject);
+
+#endif